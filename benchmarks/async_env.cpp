@@ -0,0 +1,67 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "async_env.hpp"
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+
+// Thousands of environment coroutines multiplexed onto the scheduler's worker threads, each
+// playing episodes with actions from a batched inference function on the main thread. Reports
+// environment steps per second and the mean inference batch size.
+
+EnvTask actor(AsyncEnvironment &env, i32 episodes) {
+  for (i32 episode = 0; episode < episodes; ++episode) {
+    env.reset();
+    while (not env.get_state_ref().completed) {
+      MovementDirection action = co_await env.act_async();
+      co_await env.step_async(action);
+    }
+  }
+}
+
+void benchmark_scheduler(const Config &config, i32 num_envs, i32 max_batch_size, i32 threads, i32 episodes) {
+  Random random(0);
+  auto inference = [&] (const u8 *, i32 count, i32 *actions) {
+    for (i32 i = 0; i < count; ++i)
+      actions[i] = (i32)random.uniform(4);
+  };
+  CoroutineScheduler scheduler(observation_size(config.rows, config.cols), inference, max_batch_size, threads);
+
+  std::vector<std::unique_ptr<PacmanEnvironment21x19>> envs;
+  std::vector<std::unique_ptr<AsyncEnvironment>> async_envs;
+  for (i32 i = 0; i < num_envs; ++i) {
+    envs.push_back(std::make_unique<PacmanEnvironment21x19>(config));
+    async_envs.push_back(std::make_unique<AsyncEnvironment>(*envs.back(), scheduler));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto &env: async_envs)
+    scheduler.spawn(actor(*env, episodes));
+  scheduler.run();
+  const f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf(
+    "%6d envs, batch %4d, %2d threads %14.1f %14.1f\n",
+    num_envs, max_batch_size, scheduler.get_threads(),
+    scheduler.get_steps() / seconds, (f64)scheduler.get_requests() / scheduler.get_batches()
+  );
+}
+
+int main() {
+  Config config = {
+    .rows = 21,
+    .cols = 19,
+    .max_episode_steps = 500,
+    .map = classic_map,
+  };
+
+  std::printf("%-38s %14s %14s\n", "benchmark", "env steps/s", "mean batch");
+  for (i32 max_batch_size: {64, 256})
+    for (i32 threads: {1, 0})
+      benchmark_scheduler(config, 4096, max_batch_size, threads, 2);
+
+  return 0;
+}
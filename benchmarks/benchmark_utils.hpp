@@ -0,0 +1,67 @@
+#ifndef BENCHMARKS_BENCHMARK_UTILS_H
+#define BENCHMARKS_BENCHMARK_UTILS_H
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+inline const std::vector<std::string> classic_map = {
+  "###################",
+  "#........#........#",
+  "#@##.###.#.###.##@#",
+  "#.................#",
+  "#.##.#.#####.#.##.#",
+  "#....#...#...#....#",
+  "####.###.#.###.####",
+  "####.#...0...#.####",
+  "####.#.##G##.#.####",
+  "#......#123#......#",
+  "####.#.#####.#.####",
+  "####.#...P...#.####",
+  "####.#.#####.#.####",
+  "#........#........#",
+  "#.##.###.#.###.##.#",
+  "#@.#...........#.@#",
+  "##.#.#.#####.#.#.##",
+  "#....#...#...#....#",
+  "#.######.#.######.#",
+  "#.................#",
+  "###################",
+};
+
+struct BenchmarkResult {
+  i64 iterations;
+  f64 seconds;
+
+  f64 per_second() const {
+    return iterations / seconds;
+  }
+
+  f64 ns_per_iteration() const {
+    return seconds * 1e9 / iterations;
+  }
+};
+
+// Calls fn() in batches until at least `budget_seconds` have passed
+template <typename Function>
+BenchmarkResult measure(f64 budget_seconds, Function &&fn) {
+  using clock = std::chrono::steady_clock;
+  i64 iterations = 0, batch = 1;
+  auto start = clock::now();
+  f64 elapsed = 0.0;
+  while (elapsed < budget_seconds) {
+    for (i64 i = 0; i < batch; ++i)
+      fn();
+    iterations += batch;
+    elapsed = std::chrono::duration<f64>(clock::now() - start).count();
+    if (batch < (i64(1) << 20))
+      batch *= 2;
+  }
+  return BenchmarkResult{iterations, elapsed};
+}
+
+#endif // BENCHMARKS_BENCHMARK_UTILS_H
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "pacman/maze_generator.hpp"
+
+// Step throughput against the number of ghosts on generated mazes. Pacman has enough lives to
+// never run out, so that resets do not dilute the cost of moving the ghosts. The last column is
+// the time per step added by each ghost beyond the classic four.
+int main() {
+  const std::vector<std::pair<i32, i32>> sizes = {{64, 64}, {128, 128}};
+  const std::vector<i32> ghost_counts = {4, 8, 16, 32, 64};
+  const f64 budget_seconds = 0.5;
+
+  std::printf("%-11s %7s %14s %14s %14s\n", "size", "ghosts", "steps/s", "ns/step", "ns/extra ghost");
+
+  for (const auto &[rows, cols]: sizes) {
+    MazeGeneratorConfig maze_config;
+    maze_config.rows = rows;
+    maze_config.cols = cols;
+
+    f64 baseline = 0;
+    for (i32 ghosts: ghost_counts) {
+      Config config = {
+        .rows = rows,
+        .cols = cols,
+        .max_episode_steps = 1 << 30,
+        .map = generate_maze(maze_config),
+        .pacman_lives = 1 << 30,
+        .ghost_count = ghosts,
+      };
+
+      PacmanEnvironment env(config);
+      Random random(0);
+      BenchmarkResult stepping = measure(budget_seconds, [&] {
+        env.advance(static_cast<MovementDirection>(random.uniform(4)));
+      });
+
+      const f64 ns = stepping.ns_per_iteration();
+      if (ghosts == Actors::classic_ghosts)
+        baseline = ns;
+      std::printf(
+        "%4dx%-6d %7d %14.1f %14.1f %14.2f\n",
+        rows, cols, ghosts,
+        stepping.per_second(),
+        ns,
+        ghosts > Actors::classic_ghosts ? (ns - baseline) / (ghosts - Actors::classic_ghosts) : 0.0
+      );
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "render/image_exporter.hpp"
+#include "render/render_utils.hpp"
+
+// Frames per second written by render_grid_to_png() one at a time and by ImageExporter with an
+// increasing number of threads, for a random trajectory on the classic map.
+int main() {
+  const i32 frames = 512;
+  const std::filesystem::path directory = std::filesystem::temp_directory_path() / "pacman_rl_image_export";
+  std::filesystem::create_directories(directory);
+
+  Config config = {
+    .rows = 21,
+    .cols = 19,
+    .max_episode_steps = 1 << 30,
+    .map = classic_map,
+  };
+  PacmanEnvironment env(config);
+  Random random(0);
+  std::vector<std::vector<std::string>> grids;
+  for (i32 i = 0; i < frames; ++i) {
+    State state = env.step(static_cast<MovementDirection>(random.uniform(4)));
+    if (state.completed)
+      state = env.reset();
+    grids.push_back(state.grid);
+  }
+
+  using clock = std::chrono::steady_clock;
+  auto seconds_since = [] (clock::time_point start) {
+    return std::chrono::duration<f64>(clock::now() - start).count();
+  };
+
+  std::printf("%-28s %14s\n", "exporter", "frames/s");
+
+  auto start = clock::now();
+  for (i32 i = 0; i < frames; ++i)
+    render_grid_to_png(grids[i], (directory / (std::to_string(i) + ".png")).string());
+  std::printf("%-28s %14.1f\n", "render_grid_to_png", frames / seconds_since(start));
+
+  const i32 hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (i32 threads = 1; threads <= hardware_threads; threads *= 2) {
+    ImageExporter exporter(threads);
+    start = clock::now();
+    exporter.export_grids(grids, directory.string());
+    std::string name = "ImageExporter (" + std::to_string(threads) + " threads)";
+    std::printf("%-28s %14.1f\n", name.c_str(), frames / seconds_since(start));
+  }
+
+  std::filesystem::remove_all(directory);
+  return 0;
+}
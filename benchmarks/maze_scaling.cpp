@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "pacman/map_bank.hpp"
+#include "pacman/maze_generator.hpp"
+
+// Maps cannot be added to a bank while an environment reads from it, and attaching another bank,
+// with a larger map under the same id, leaves nothing pointing into the previous one
+bool check_map_bank(const Config &config) {
+  MazeGeneratorConfig maze_config;
+  maze_config.rows = 61;
+  maze_config.cols = 61;
+  const std::vector<std::string> large_map = MazeGenerator(maze_config).generate(0);
+
+  auto bank = std::make_shared<MapBank>();
+  bank->add(config.map);
+  PacmanEnvironment env(config);
+  env.set_map_bank(bank);
+  env.reset(0);
+  try {
+    bank->add(large_map);
+    std::printf("map bank: add() succeeded on an attached bank\n");
+    return false;
+  }
+  catch (const std::runtime_error &) { }
+
+  auto replacement = std::make_shared<MapBank>();
+  replacement->add(large_map);
+  replacement->add(config.map);
+  env.set_map_bank(replacement);
+  bank.reset();
+  replacement.reset();
+  const State &state = env.reset();
+  if (state.grid.size() != large_map.size() or env.reset(1).grid.size() != config.map.size()) {
+    std::printf("map bank: reset() did not switch to the map of the new bank\n");
+    return false;
+  }
+  return true;
+}
+
+// Generation rate, environment construction time and step throughput on generated mazes
+// from the classic 21x19 size up to 1000x1000, after a check of map bank attachment.
+int main() {
+  const std::vector<std::pair<i32, i32>> sizes = {
+    {21, 19}, {31, 28}, {64, 64}, {128, 128}, {256, 256}, {512, 512}, {1000, 1000},
+  };
+  const f64 budget_seconds = 0.5;
+
+  if (not check_map_bank(Config{.rows = 21, .cols = 19, .max_episode_steps = 500, .map = classic_map}))
+    return 1;
+
+  std::printf("%-11s %14s %14s %14s %14s\n", "size", "maps/s", "construct ms", "steps/s", "ns/step/cell");
+
+  for (const auto &[rows, cols]: sizes) {
+    MazeGeneratorConfig maze_config;
+    maze_config.rows = rows;
+    maze_config.cols = cols;
+    MazeGenerator generator(maze_config);
+
+    u64 seed = 0;
+    BenchmarkResult generation = measure(budget_seconds, [&] {
+      generator.generate(seed++);
+    });
+
+    Config config = {
+      .rows = rows,
+      .cols = cols,
+      .max_episode_steps = 1 << 30,
+      .map = generator.generate(0),
+    };
+    validate_map(config.map, rows, cols);
+
+    std::vector<PacmanEnvironment> environments;
+    BenchmarkResult construction = measure(budget_seconds, [&] {
+      environments.emplace_back(config);
+    });
+    environments.clear();
+
+    PacmanEnvironment env(config);
+    Random random(0);
+    BenchmarkResult stepping = measure(budget_seconds, [&] {
+      if (env.step(static_cast<MovementDirection>(random.uniform(4))).completed)
+        env.reset();
+    });
+
+    std::printf(
+      "%4dx%-6d %14.1f %14.3f %14.1f %14.3f\n",
+      rows, cols,
+      generation.per_second(),
+      construction.seconds * 1e3 / construction.iterations,
+      stepping.per_second(),
+      stepping.ns_per_iteration() / (rows * cols)
+    );
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include <array>
+#include <cstdio>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "pacman/maze_generator.hpp"
+
+// Throughput of multi-agent stepping against the number of Pacmen sharing a generated maze, with
+// and without writing the window observations of every agent. Agent steps are steps times the
+// number of Pacmen, the rate a batched policy consumes transitions at.
+int main() {
+  const std::vector<i32> pacman_counts = {1, 2, 4, 8};
+  const i32 window_radius = 5;
+  const f64 budget_seconds = 0.5;
+
+  MazeGeneratorConfig maze_config;
+  maze_config.rows = 41;
+  maze_config.cols = 41;
+  const std::vector<std::string> map = generate_maze(maze_config);
+
+  std::printf("%7s %14s %14s %18s\n", "pacmen", "steps/s", "agent steps/s", "with observations");
+
+  for (i32 pacmen: pacman_counts) {
+    Config config = {
+      .rows = maze_config.rows,
+      .cols = maze_config.cols,
+      .max_episode_steps = 1 << 30,
+      .map = map,
+      .pacman_lives = 1 << 30,
+      .pacman_count = pacmen,
+    };
+
+    PacmanEnvironment env(config);
+    Random random(0);
+    std::array<MovementDirection, Actors::max_pacmen> directions;
+    auto step = [&] {
+      for (i32 pacman = 0; pacman < pacmen; ++pacman)
+        directions[pacman] = static_cast<MovementDirection>(random.uniform(4));
+      env.advance_agents(directions.data());
+    };
+
+    std::vector<u8> observations(pacmen * agent_observation_size(config.rows, config.cols, window_radius));
+    BenchmarkResult stepping = measure(budget_seconds, step);
+    BenchmarkResult observed = measure(budget_seconds, [&] {
+      step();
+      env.get_agent_observations(window_radius, observations.data());
+    });
+
+    std::printf(
+      "%7d %14.1f %14.1f %18.1f\n",
+      pacmen,
+      stepping.per_second(),
+      stepping.per_second() * pacmen,
+      observed.per_second() * pacmen
+    );
+  }
+
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "pacman/maze_generator.hpp"
+#include "wrappers/vector_env.hpp"
+
+// Frames per second of VectorEnvironment::render_pixels() for full-size RGB frames and for
+// downscaled grayscale frames the size of common pixel-based agents, with one thread and with
+// one per hardware thread. Envs are stepped between renders so that actors and pellets change,
+// and the step time is reported separately so it can be subtracted.
+
+void benchmark_pixels(const char *label, const Config &config, i32 num_envs, i32 threads, i32 height, i32 width, bool grayscale, f64 budget_seconds) {
+  VectorEnvironment envs(config, num_envs, threads);
+  envs.set_pixel_rendering(height, width, grayscale);
+  envs.reset();
+
+  Random random(0);
+  std::vector<i32> actions(num_envs);
+  auto step = [&] {
+    for (i32 &action: actions)
+      action = (i32)random.uniform(4);
+    envs.step(actions.data());
+  };
+  BenchmarkResult stepping = measure(budget_seconds, step);
+  BenchmarkResult rendering = measure(budget_seconds, [&] {
+    step();
+    envs.render_pixels();
+  });
+
+  const auto [h, w, c] = envs.get_pixel_shape();
+  const f64 render_ns = rendering.ns_per_iteration() - stepping.ns_per_iteration();
+  std::string name = std::string(label) + " " + std::to_string(h) + "x" + std::to_string(w) + "x" + std::to_string(c) + ", " + std::to_string(envs.get_threads()) + " threads";
+  std::printf("%-36s %14.1f %14.1f %14.1f\n", name.c_str(), rendering.per_second() * num_envs, stepping.ns_per_iteration() / num_envs, render_ns / num_envs);
+}
+
+int main() {
+  MazeGeneratorConfig maze_config;
+  Config config = {
+    .rows = maze_config.rows,
+    .cols = maze_config.cols,
+    .max_episode_steps = 1000,
+    .map = generate_maze(maze_config),
+  };
+  const i32 num_envs = 64;
+  const f64 budget_seconds = 0.5;
+
+  std::printf("%-36s %14s %14s %14s\n", "frames", "frames/s", "step ns/env", "render ns/env");
+  for (i32 threads: {1, 0}) {
+    benchmark_pixels("rgb", config, num_envs, threads, 0, 0, false, budget_seconds);
+    benchmark_pixels("grayscale", config, num_envs, threads, 84, 84, true, budget_seconds);
+  }
+
+  return 0;
+}
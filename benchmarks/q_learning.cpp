@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "q_learning.hpp"
+#include "pacman/maze_generator.hpp"
+
+// Tabular Q-learning on a small generated maze: the learning curve of a single-threaded run, as
+// mean score per block of episodes (the first ones are close to a random policy), and training
+// throughput with different numbers of threads.
+
+f64 mean_score(const std::vector<QLearningEpisode> &curve, u64 begin, u64 end) {
+  f64 sum = 0;
+  for (u64 i = begin; i < end; ++i)
+    sum += curve[i].score;
+  return sum / (end - begin);
+}
+
+int main() {
+  const i64 episodes = 20000;
+  const i64 block = 2000;
+
+  MazeGeneratorConfig maze_config;
+  maze_config.rows = 11;
+  maze_config.cols = 11;
+  maze_config.power_pellets = 2;
+  Config config = {
+    .rows = 11,
+    .cols = 11,
+    .max_episode_steps = 200,
+    .map = MazeGenerator(maze_config).generate(0),
+  };
+
+  QLearningConfig q_config;
+  q_config.epsilon_decay = 0.9995f;
+
+  QLearningTrainer trainer(config, q_config, 1, 0);
+  trainer.train(episodes);
+  const std::vector<QLearningEpisode> &curve = trainer.get_curve();
+
+  std::printf("%-20s %10s %12s\n", "episodes", "epsilon", "mean score");
+  for (i64 begin = 0; begin < episodes; begin += block)
+    std::printf("%8lld-%-11lld %10.3f %12.1f\n", (long long)begin, (long long)(begin + block), curve[begin + block - 1].epsilon, mean_score(curve, begin, begin + block));
+  std::printf("%lld states in the table\n\n", (long long)trainer.get_table().size());
+
+  std::printf("%-20s %14s %14s\n", "threads", "episodes/s", "steps/s");
+  for (i32 threads: {1, 2, 0}) {
+    QLearningTrainer timed(config, q_config, threads, 0);
+    i64 steps = 0;
+    BenchmarkResult training = measure(1.0, [&] {
+      timed.train(100);
+    });
+    for (const QLearningEpisode &episode: timed.get_curve())
+      steps += episode.length;
+    std::printf("%-20d %14.1f %14.1f\n", timed.get_threads(), timed.get_episodes() / training.seconds, steps / training.seconds);
+  }
+
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "trace.hpp"
+#include "pacman/map_bank.hpp"
+#include "pacman/maze_generator.hpp"
+#include "render/render_utils.hpp"
+
+// Throughput of the paths that go through the per-cell lookup tables of constants.hpp:
+// stepping (update_state), building the draw list of a frame and parsing maps. Stepping is also
+// measured with tracing on, to give the cost of recording one trace event.
+
+template <typename Environment>
+void benchmark_step(const char *name, const Config &config, f64 budget_seconds) {
+  Environment env(config);
+  Random random(0);
+  BenchmarkResult stepping = measure(budget_seconds, [&] {
+    if (env.step(static_cast<MovementDirection>(random.uniform(4))).completed)
+      env.reset();
+  });
+  std::printf("%-28s %14.1f %14.1f\n", name, stepping.per_second(), stepping.ns_per_iteration());
+}
+
+// Stepping with tracing off and on, the number of events per step, and the cost of recording
+// one event: the median over several rounds of back to back events, each round filling a cleared
+// buffer so that no event is dropped
+void benchmark_tracing(const Config &config, f64 budget_seconds) {
+  constexpr i64 events_per_round = 1 << 15;
+  constexpr i32 rounds = 15;
+  constexpr i64 clear_interval = 4096;
+
+  PacmanEnvironment env(config);
+  Random random(0);
+  auto step = [&] {
+    if (env.step(static_cast<MovementDirection>(random.uniform(4))).completed)
+      env.reset();
+  };
+
+  BenchmarkResult untraced = measure(budget_seconds, step);
+
+  Tracer &tracer = Tracer::instance();
+  tracer.enable("", 2 * clear_interval * 16);
+  tracer.clear();
+  for (i64 i = 0; i < clear_interval; ++i)
+    step();
+  const f64 events_per_step = (f64)tracer.get_event_count() / clear_interval;
+
+  i64 steps = 0;
+  BenchmarkResult traced = measure(budget_seconds, [&] {
+    step();
+    if (++steps % clear_interval == 0)
+      tracer.clear();
+  });
+
+  std::vector<f64> event_ns;
+  for (i32 round = 0; round < rounds; ++round) {
+    tracer.clear();
+    auto start = std::chrono::steady_clock::now();
+    for (i64 i = 0; i < events_per_round; ++i) {
+      TRACE_SCOPE("benchmark", "benchmark");
+    }
+    event_ns.push_back(std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count() / events_per_round);
+  }
+  Tracer::disable();
+  tracer.clear();
+  std::nth_element(event_ns.begin(), event_ns.begin() + rounds / 2, event_ns.end());
+
+  std::printf("%-28s %14.1f %14.1f\n", "step (tracing off)", untraced.per_second(), untraced.ns_per_iteration());
+  std::printf("%-28s %14.1f %14.1f\n", "step (tracing on)", traced.per_second(), traced.ns_per_iteration());
+  std::printf("%-28s %14.1f %14s\n", "trace events per step", events_per_step, "");
+  std::printf("%-28s %14.1f %14.1f\n", "trace event (median)", 1e9 / event_ns[rounds / 2], event_ns[rounds / 2]);
+}
+
+int main() {
+  const f64 budget_seconds = 0.5;
+
+  Config config = {
+    .rows = 21,
+    .cols = 19,
+    .max_episode_steps = 1 << 30,
+    .map = classic_map,
+  };
+
+  std::printf("%-28s %14s %14s\n", "benchmark", "per second", "ns each");
+
+  benchmark_step<PacmanEnvironment>("step (runtime size)", config, budget_seconds);
+  benchmark_step<PacmanEnvironment21x19>("step (21x19)", config, budget_seconds);
+  benchmark_tracing(config, budget_seconds);
+
+  // Frames of a short random episode, so that the draw list sees moving actors
+  PacmanEnvironment env(config);
+  Random random(0);
+  std::vector<std::vector<std::string>> frames;
+  for (i32 i = 0; i < 64; ++i)
+    frames.push_back(env.step(static_cast<MovementDirection>(random.uniform(4))).grid);
+
+  std::vector<std::pair<Location, EntityType>> entities;
+  u64 frame = 0;
+  BenchmarkResult drawing = measure(budget_seconds, [&] {
+    build_draw_list(frames[frame++ % frames.size()], entities);
+  });
+  std::printf("%-28s %14.1f %14.1f\n", "draw list (21x19)", drawing.per_second(), drawing.ns_per_iteration());
+
+  for (i32 size: {21, 256, 1000}) {
+    MazeGeneratorConfig maze_config;
+    maze_config.rows = size;
+    maze_config.cols = size;
+    std::vector<std::string> map = MazeGenerator(maze_config).generate(0);
+
+    std::vector<EntityType> tiles;
+    BenchmarkResult parsing = measure(budget_seconds, [&] {
+      compile_map(map, size, size, tiles);
+    });
+
+    std::string name = "compile_map (" + std::to_string(size) + "x" + std::to_string(size) + ")";
+    std::printf("%-28s %14.1f %14.1f\n", name.c_str(), parsing.per_second(), parsing.ns_per_iteration());
+  }
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "random.hpp"
+#include "pacman/maze_generator.hpp"
+#include "wrappers/vector_env.hpp"
+
+// Environment steps per second of VectorEnvironment with different numbers of threads and frame
+// skips, including writing the observation tensors. Compare against "step" in step_render. On a
+// large maze, full observations are compared against egocentric windows. Last, a loop that
+// alternates between a simulated policy and stepping is compared against pipelined stepping,
+// where the policy runs on one group of envs while the others are stepped. Rollouts of short
+// episodes also check that every done flag ends up as one episode in the statistics.
+
+template <typename Environment>
+void benchmark_vector(const char *label, const Config &config, i32 num_envs, i32 threads, i32 frame_skip, i32 window_radius, f64 budget_seconds) {
+  VectorEnvironmentT<Environment> envs(config, num_envs, threads, frame_skip, false, true, 100, window_radius);
+  envs.reset();
+
+  Random random(0);
+  std::vector<i32> actions(num_envs);
+  BenchmarkResult stepping = measure(budget_seconds, [&] {
+    for (i32 &action: actions)
+      action = (i32)random.uniform(4);
+    envs.step(actions.data());
+  });
+
+  std::string name = std::string(label) + ", " + std::to_string(num_envs) + " envs, " + std::to_string(envs.get_threads()) + " threads, skip " + std::to_string(frame_skip);
+  std::printf("%-48s %14.1f %14.1f\n", name.c_str(), stepping.per_second() * num_envs, stepping.ns_per_iteration() / num_envs);
+}
+
+// Busy waits like a policy forward pass on the calling thread
+void simulate_inference(f64 ns) {
+  auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds((i64)ns);
+  while (std::chrono::steady_clock::now() < end) { }
+}
+
+void benchmark_pipeline(const Config &config, i32 num_envs, i32 groups, f64 inference_ns_per_env, f64 budget_seconds) {
+  VectorEnvironmentT<PacmanEnvironment21x19> envs(config, num_envs, 0);
+  envs.set_pipeline_groups(groups);
+  envs.reset();
+
+  Random random(0);
+  std::vector<i32> actions(num_envs);
+  BenchmarkResult stepping = measure(budget_seconds, [&] {
+    const auto [begin, count] = envs.get_group_range(envs.get_next_group());
+    simulate_inference(inference_ns_per_env * count);
+    for (i32 i = 0; i < count; ++i)
+      actions[i] = (i32)random.uniform(4);
+    if (groups == 1)
+      envs.step(actions.data());
+    else
+      envs.step_pipelined(actions.data());
+  });
+  for (i32 g = 0; g < groups; ++g)
+    envs.step_wait(g);
+
+  const f64 envs_per_call = (f64)num_envs / groups;
+  std::string name = std::string("policy + step, ") + std::to_string(groups) + (groups == 1 ? " group" : " groups");
+  std::printf("%-48s %14.1f %14.1f\n", name.c_str(), stepping.per_second() * envs_per_call, stepping.ns_per_iteration() / envs_per_call);
+}
+
+// Scripted rollouts with episodes much shorter than the rollout, so that every env finishes
+// many episodes before the statistics are committed
+void benchmark_rollout(const Config &config, i32 num_envs, i32 n_steps, f64 budget_seconds) {
+  VectorEnvironmentT<PacmanEnvironment21x19> envs(config, num_envs, 0);
+  envs.reset();
+
+  const i64 entries = (i64)num_envs * n_steps;
+  const auto [channels, rows, cols] = envs.get_observation_shape();
+  std::vector<u8> observations(entries * channels * rows * cols);
+  std::vector<i32> actions(entries), score_deltas(entries);
+  std::vector<f32> rewards(entries);
+  std::vector<u8> dones(entries);
+  const Trajectory trajectory = {observations.data(), actions.data(), rewards.data(), score_deltas.data(), dones.data()};
+
+  i64 done_flags = 0;
+  u64 seed = 0;
+  BenchmarkResult rolling = measure(budget_seconds, [&] {
+    envs.rollout(PolicyType::random, n_steps, trajectory, seed++);
+    for (u8 done: dones)
+      done_flags += done;
+  });
+  if (envs.get_statistics().get_episodes() != done_flags)
+    throw std::runtime_error("Rollout finished " + std::to_string(done_flags) + " episodes but " + std::to_string(envs.get_statistics().get_episodes()) + " were committed.");
+
+  std::string name = "rollout of " + std::to_string(n_steps) + " steps, " + std::to_string(done_flags) + " episodes";
+  std::printf("%-48s %14.1f %14.1f\n", name.c_str(), rolling.per_second() * entries, rolling.ns_per_iteration() / entries);
+}
+
+int main() {
+  const f64 budget_seconds = 0.5;
+
+  Config config = {
+    .rows = 21,
+    .cols = 19,
+    .max_episode_steps = 1000,
+    .map = classic_map,
+  };
+
+  std::printf("%-48s %14s %14s\n", "benchmark", "env steps/s", "ns per env");
+
+  for (i32 threads: {1, 0})
+    for (i32 frame_skip: {1, 4})
+      benchmark_vector<PacmanEnvironment21x19>("21x19", config, 256, threads, frame_skip, full_observation, budget_seconds);
+
+  MazeGeneratorConfig maze_config;
+  maze_config.rows = 201;
+  maze_config.cols = 201;
+  Config large_config = {
+    .rows = 201,
+    .cols = 201,
+    .max_episode_steps = 1000,
+    .map = MazeGenerator(maze_config).generate(0),
+  };
+
+  benchmark_vector<PacmanEnvironment>("201x201 full", large_config, 64, 0, 1, full_observation, budget_seconds);
+  benchmark_vector<PacmanEnvironment>("201x201 window r=7", large_config, 64, 0, 1, 7, budget_seconds);
+
+  // Inference cost per env close to the single-threaded cost of a step
+  for (i32 groups: {1, 2})
+    benchmark_pipeline(config, 256, groups, 1000, budget_seconds);
+
+  Config short_config = config;
+  short_config.max_episode_steps = 10;
+  benchmark_rollout(short_config, 64, 100, budget_seconds);
+
+  return 0;
+}
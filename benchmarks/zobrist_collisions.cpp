@@ -0,0 +1,102 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "benchmark_utils.hpp"
+#include "environment.hpp"
+#include "policy.hpp"
+#include "random.hpp"
+
+// Collision harness for State::hash. Visits states with random and scripted policies and keys
+// each full dynamic state (serialized byte for byte) by its hash, truncated to several widths.
+// A collision is a new state whose truncated hash was already taken by another one. For n distinct
+// states and m = 2^b hashes, n - m (1 - e^(-n/m)) are expected, which the narrow widths check,
+// while the full 64 bits should have none. Also checks that the incremental hash matches a recomputation.
+
+template <typename Environment>
+std::string serialize(const Environment &env) {
+  const Actors &actors = env.get_actors();
+  std::string bytes;
+  auto append = [&] (const auto &value) {
+    bytes.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  append(env.get_state_ref().lives);
+  for (i32 actor = 0; actor < actors.count; ++actor) {
+    append(actors.locations[actor]);
+    append(actors.directions[actor]);
+    if (actor >= actors.first_ghost) {
+      append(actors.modes[actor]);
+      append(actors.step_indices[actor]);
+      append(actors.house_state_updated[actor]);
+    }
+  }
+  for (u64 word: env.get_pellet_mask())
+    append(word);
+  return bytes;
+}
+
+int main() {
+  const i32 steps = 1 << 20;
+  const std::vector<i32> widths = {16, 24, 32, 40, 64};
+
+  Config config = {
+    .rows = 21,
+    .cols = 19,
+    .max_episode_steps = 2000,
+    .map = classic_map,
+  };
+
+  PacmanEnvironment21x19 env(config);
+  std::vector<Policy> policies;
+  for (PolicyType type: {PolicyType::random, PolicyType::greedy, PolicyType::avoid_ghosts})
+    policies.emplace_back(type, config.rows, config.cols, 0);
+  std::vector<u8> observation(observation_size(config.rows, config.cols));
+  Random random(0);
+
+  std::vector<std::unordered_set<u64>> seen(widths.size());
+  std::vector<i64> collisions(widths.size(), 0);
+  std::unordered_map<std::string, u64> states;
+  i64 mismatches = 0;
+
+  Policy *policy = &policies[0];
+  for (i32 step = 0; step < steps; ++step) {
+    const u64 hash = env.get_state_ref().hash;
+    mismatches += hash != env.compute_hash();
+
+    // Every distinct state is checked once, against all distinct states seen before it
+    std::string bytes = serialize(env);
+    if (states.emplace(bytes, hash).second)
+      for (u64 i = 0; i < widths.size(); ++i) {
+        const u64 key = widths[i] == 64 ? hash : hash & ((u64(1) << widths[i]) - 1);
+        collisions[i] += not seen[i].insert(key).second;
+      }
+
+    env.get_observation(observation.data());
+    env.advance(policy->act(observation.data()));
+    if (env.get_state_ref().completed) {
+      env.reset();
+      policy = &policies[random.uniform(policies.size())];
+    }
+  }
+
+  const f64 distinct = states.size();
+  std::printf("%d steps, %.0f distinct states, %lld hash mismatches\n", steps, distinct, (long long)mismatches);
+  std::printf("%-8s %14s %14s\n", "bits", "collisions", "expected");
+  for (u64 i = 0; i < widths.size(); ++i) {
+    const f64 hashes = std::ldexp(1.0, widths[i]);
+    const f64 expected = distinct + hashes * std::expm1(-distinct / hashes);
+    std::printf("%-8d %14lld %14.3g\n", widths[i], (long long)collisions[i], expected);
+  }
+
+  BenchmarkResult reading = measure(0.2, [&] {
+    env.advance(static_cast<MovementDirection>(random.uniform(4)));
+    if (env.get_state_ref().completed)
+      env.reset();
+  });
+  std::printf("step with hash maintenance: %.1f ns\n", reading.ns_per_iteration());
+
+  return mismatches == 0 ? 0 : 1;
+}
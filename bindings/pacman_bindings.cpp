@@ -3,17 +3,540 @@
 #include <pybind11/cast.h>
 #include <pybind11/detail/common.h>
 
+#include "pybind11/numpy.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
 
 #include "constants.hpp"
 #include "pretty_print.hpp"
 #include "environment.hpp"
+#include "episode_statistics.hpp"
+#include "policy.hpp"
+#include "q_learning.hpp"
+#include "rollout.hpp"
+#include "rollout_buffer.hpp"
+#include "trace.hpp"
+#include "wrappers/frame_skip_env.hpp"
 #include "wrappers/record_video_env.hpp"
+#include "wrappers/vector_env.hpp"
+#include "render/image_exporter.hpp"
 #include "render/render_utils.hpp"
+#include "pacman/map_bank.hpp"
+#include "pacman/maze_generator.hpp"
 
 namespace py = pybind11;
 
+// Read-only NumPy view of a buffer owned by `owner`, which the array keeps alive
+template <typename T>
+py::array view_of(py::object owner, const T *data, std::vector<py::ssize_t> shape, py::dtype dtype = py::dtype::of<T>()) {
+  py::array array(dtype, shape, data, owner);
+  array.attr("setflags")(py::arg("write") = false);
+  return array;
+}
+
+// Writeable NumPy view of a buffer owned by `owner`, for arrays that Python fills in
+template <typename T>
+py::array mutable_view_of(py::object owner, T *data, std::vector<py::ssize_t> shape) {
+  return py::array(py::dtype::of<T>(), shape, data, owner);
+}
+
+// Capsule that keeps a shared buffer alive, as the base of the NumPy views into it
+template <typename T>
+py::capsule shared_owner(std::shared_ptr<T> storage) {
+  return py::capsule(new std::shared_ptr<T>(std::move(storage)), [](void *owner) {
+    delete static_cast<std::shared_ptr<T> *>(owner);
+  });
+}
+
+// Closes an environment, or all environments of a vector env, then writes the trace file given to
+// trace.enable() once for the whole call
+template <typename Environment>
+void close_and_flush(const Environment &env) {
+  env.close();
+  Tracer::instance().flush();
+}
+
+// Tensor observation of an environment as a new (channels, rows, cols) uint8 array
+py::array_t<u8> get_observation(const EnvironmentBase &env) {
+  const Config &config = env.get_config();
+  auto [channels, rows, cols] = observation_shape(config.rows, config.cols);
+  py::array_t<u8> array({channels, rows, cols});
+  env.get_observation(array.mutable_data());
+  return array;
+}
+
+// Window observation of an environment as a new (channels, side, side) uint8 array
+py::array_t<u8> get_window_observation(const EnvironmentBase &env, i32 radius) {
+  if (radius < 0)
+    throw std::runtime_error("Window radius must be non-negative.");
+  const i32 side = window_side(radius);
+  py::array_t<u8> array({observation_channels, side, side});
+  env.get_window_observation(radius, array.mutable_data());
+  return array;
+}
+
+// Distance features of an environment as a new float32 array
+py::array_t<f32> get_features(EnvironmentBase &env) {
+  py::array_t<f32> array(Features::count);
+  env.get_features(array.mutable_data());
+  return array;
+}
+
+// Observations of every Pacman of a multi-agent environment as a new (pacmen, channels, height,
+// width) uint8 array
+template <typename Environment>
+py::array_t<u8> get_agent_observations(const Environment &env, i32 window_radius) {
+  const Config &config = env.get_config();
+  auto [channels, height, width] = agent_observation_shape(config.rows, config.cols, window_radius);
+  py::array_t<u8> array({env.get_actors().pacmen(), channels, height, width});
+  env.get_agent_observations(window_radius, array.mutable_data());
+  return array;
+}
+
+// One step of every Pacman of a multi-agent environment, returning (observations, rewards,
+// scores, completed) with one row per Pacman
+template <typename Environment>
+py::tuple step_agents(Environment &env, py::array_t<i32, py::array::c_style | py::array::forcecast> actions, i32 window_radius) {
+  const i32 pacmen = env.get_actors().pacmen();
+  if (actions.ndim() != 1 or actions.shape(0) != pacmen)
+    throw std::runtime_error("step_agents() expects one action per Pacman.");
+
+  std::array<MovementDirection, Actors::max_pacmen> directions;
+  for (i32 pacman = 0; pacman < pacmen; ++pacman)
+    directions[pacman] = static_cast<MovementDirection>(actions.at(pacman));
+  env.advance_agents(directions.data());
+
+  const State &state = env.get_state_ref();
+  py::array_t<f32> rewards(pacmen);
+  py::array_t<i32> scores(pacmen);
+  std::copy(state.rewards.begin(), state.rewards.end(), rewards.mutable_data());
+  std::copy(state.scores.begin(), state.scores.end(), scores.mutable_data());
+  return py::make_tuple(get_agent_observations(env, window_radius), rewards, scores, state.completed);
+}
+
+// Output array of a rollout. A given array must have the expected dtype and shape, be C-contiguous
+// and writeable, and is written into. Otherwise a new array is allocated
+template <typename T>
+py::array_t<T> output_array(py::object given, const std::vector<py::ssize_t> &shape, const char *name) {
+  if (given.is_none())
+    return py::array_t<T>(shape);
+
+  if (not py::isinstance<py::array_t<T, py::array::c_style>>(given))
+    throw std::runtime_error(std::string(name) + " must be a C-contiguous array of " + std::string(py::str(py::dtype::of<T>())) + ".");
+  auto array = given.cast<py::array_t<T, py::array::c_style>>();
+  if (not array.writeable())
+    throw std::runtime_error(std::string(name) + " must be writeable.");
+  if (std::vector<py::ssize_t>(array.shape(), array.shape() + array.ndim()) != shape)
+    throw std::runtime_error(std::string(name) + " does not have the expected shape.");
+  return array;
+}
+
+// Observations, actions, score deltas and done flags of a rollout, each with leading dimensions
+// `leading` ({n_steps} or {num_envs, n_steps})
+struct RolloutArrays {
+  py::array_t<u8> observations;
+  py::array_t<i32> actions;
+  py::array_t<f32> rewards;
+  py::array_t<i32> score_deltas;
+  py::array_t<bool> dones;
+
+  RolloutArrays(const std::vector<py::ssize_t> &leading, std::array<i32, 3> observation_shape, py::object observations, py::object actions, py::object rewards, py::object score_deltas, py::object dones) {
+    std::vector<py::ssize_t> shape = leading;
+    shape.insert(shape.end(), observation_shape.begin(), observation_shape.end());
+    this->observations = output_array<u8>(observations, shape, "observations");
+    this->actions = output_array<i32>(actions, leading, "actions");
+    this->rewards = output_array<f32>(rewards, leading, "rewards");
+    this->score_deltas = output_array<i32>(score_deltas, leading, "score_deltas");
+    this->dones = output_array<bool>(dones, leading, "dones");
+  }
+
+  Trajectory trajectory() {
+    return Trajectory{
+      .observations = observations.mutable_data(),
+      .actions = actions.mutable_data(),
+      .rewards = rewards.mutable_data(),
+      .score_deltas = score_deltas.mutable_data(),
+      .dones = reinterpret_cast<u8 *>(dones.mutable_data()),
+    };
+  }
+
+  py::tuple as_tuple() const {
+    return py::make_tuple(observations, actions, rewards, score_deltas, dones);
+  }
+};
+
+py::dict metric_summary_dict(const MetricSummary &summary) {
+  py::dict result;
+  result["mean"] = summary.mean;
+  result["min"] = summary.min;
+  result["max"] = summary.max;
+  result["p25"] = summary.p25;
+  result["p50"] = summary.p50;
+  result["p75"] = summary.p75;
+  return result;
+}
+
+i32 EpisodeRecord::* episode_metric(const std::string &name) {
+  if (name == "score")
+    return &EpisodeRecord::score;
+  if (name == "length")
+    return &EpisodeRecord::length;
+  if (name == "lives_lost")
+    return &EpisodeRecord::lives_lost;
+  if (name == "pellets_eaten")
+    return &EpisodeRecord::pellets_eaten;
+  throw std::runtime_error("Metric must be one of score, length, lives_lost or pellets_eaten, got " + name + ".");
+}
+
+template <typename Environment>
+void bind_environment(py::module_ &m, const char *name, const char *doc) {
+  const std::string repr = std::string("<pacman_rl.") + name + ">";
+
+  py::class_<Environment, EnvironmentBase>(m, name)
+    .def(py::init<const Config &, RenderMode>(), py::arg("config"), py::arg("mode") = RenderMode::none, "Constructor with config")
+    .def("reset", py::overload_cast<>(&Environment::reset), "Reset the environment")
+    .def("reset", py::overload_cast<i32>(&Environment::reset), py::arg("map_id"), "Switch to a map of the map bank and reset")
+    .def("reset_random_map", &Environment::reset_random_map, "Switch to a random map of the map bank and reset")
+    .def(
+      "set_map_bank",
+      [](Environment &env, std::shared_ptr<MapBank> bank, u64 seed) { env.set_map_bank(std::move(bank), seed); },
+      py::arg("bank"),
+      py::arg("seed") = 0,
+      "Use a map bank for reset(map_id) and reset_random_map(). Buffers are reserved for its largest map, and the bank is frozen"
+    )
+    .def("get_map_id", &Environment::get_map_id, "Index of the current map in the map bank, or -1")
+    .def("step", &Environment::step, "Perform an action in the environment")
+    .def("get_state", &Environment::get_state, "Get the current state of the environment")
+    .def("get_pellets_remaining", &Environment::get_pellets_remaining, "Number of pellets and power pellets left")
+    .def("compute_hash", &Environment::compute_hash, "Recompute the Zobrist hash of the state from scratch, equal to State.hash")
+    .def("set_journal_capacity", &Environment::set_journal_capacity, py::arg("capacity"), "Keep records of the last `capacity` steps for undo(). Zero disables it")
+    .def("get_journal_capacity", &Environment::get_journal_capacity, "Number of steps kept for undo()")
+    .def("get_journal_size", &Environment::get_journal_size, "Number of steps that can currently be undone")
+    .def("undo", &Environment::undo, "Revert the last step")
+    .def("get_observation", &get_observation, "Get the (channels, rows, cols) uint8 tensor observation, one plane per entity type")
+    .def("get_window_observation", &get_window_observation, py::arg("radius"), "Get the (channels, 2 * radius + 1, 2 * radius + 1) window of the observation centered on pacman")
+    .def("get_features", &get_features, "Get the float32 distance features: nearest pellet, nearest power pellet, each ghost and safe directions")
+    .def(
+      "get_agent_observations",
+      &get_agent_observations<Environment>,
+      py::arg("window_radius") = full_observation,
+      "Get the (pacmen, channels + 1, height, width) observations of every Pacman, each with only itself in the "
+      "pacman plane, the other Pacmen in the last plane and, for a window, the window centered on it"
+    )
+    .def(
+      "step_agents",
+      &step_agents<Environment>,
+      py::arg("actions"),
+      py::arg("window_radius") = full_observation,
+      "Step every Pacman with its action and return (observations, float32 rewards, int32 scores, completed), "
+      "one row per Pacman, with observations as in get_agent_observations()"
+    )
+    .def("render", &Environment::render, "Render the environment")
+    .def("close", &close_and_flush<Environment>, "Close the environment")
+    .def("__repr__", [repr](const Environment &) { return repr; })
+    .def("pretty", pretty_environment, "Pretty print the environment")
+    .doc() = doc;
+}
+
+template <typename Environment>
+void bind_vector_environment(py::module_ &m, const char *name, const char *doc) {
+  using Vector = VectorEnvironmentT<Environment>;
+  const std::string repr = std::string("<pacman_rl.") + name + ">";
+
+  auto observations = [](py::object self) {
+    const Vector &vector = self.cast<const Vector &>();
+    auto [channels, rows, cols] = vector.get_observation_shape();
+    return view_of(self, vector.get_observations(), {vector.size(), channels, rows, cols});
+  };
+
+  // Views of the observations, rewards and done flags of one pipeline group
+  auto group_results = [](py::object self, i32 group) {
+    const Vector &vector = self.cast<const Vector &>();
+    auto [channels, rows, cols] = vector.get_observation_shape();
+    auto [begin, count] = vector.get_group_range(group);
+    const i64 size = (i64)channels * rows * cols;
+    return py::make_tuple(
+      view_of(self, vector.get_observations() + begin * size, {count, channels, rows, cols}),
+      view_of(self, vector.get_rewards() + begin, {count}),
+      view_of(self, vector.get_dones() + begin, {count}, py::dtype::of<bool>())
+    );
+  };
+
+  py::class_<Vector>(m, name)
+    .def(
+      py::init<const Config &, i32, i32, i32, bool, bool, i32, i32, bool>(),
+      py::arg("config"),
+      py::arg("num_envs"),
+      py::arg("threads") = 0,
+      py::arg("frame_skip") = 1,
+      py::arg("max_pool") = false,
+      py::arg("autoreset") = true,
+      py::arg("statistics_window") = 100,
+      py::arg("window_radius") = full_observation,
+      py::arg("features") = false,
+      "Constructor with the config shared by all environments. Zero threads means one per hardware "
+      "thread. Episode statistics are aggregated over the last statistics_window episodes. With a "
+      "non-negative window_radius, observations are windows centered on pacman instead of the whole map. "
+      "With features, distance features are computed along with the observations"
+    )
+    .def(
+      "reset",
+      [observations](py::object self) {
+        {
+          py::gil_scoped_release release;
+          self.cast<Vector &>().reset();
+        }
+        return observations(self);
+      },
+      "Reset all environments and return the (num_envs, channels, rows, cols) observations"
+    )
+    .def(
+      "step",
+      [observations](py::object self, py::array_t<i32, py::array::c_style | py::array::forcecast> actions) {
+        Vector &vector = self.cast<Vector &>();
+        if (actions.ndim() != 1 or actions.shape(0) != vector.size())
+          throw std::runtime_error("step() expects one action per environment.");
+        {
+          py::gil_scoped_release release;
+          vector.step(actions.data());
+        }
+        return py::make_tuple(
+          observations(self),
+          view_of(self, vector.get_rewards(), {vector.size()}),
+          view_of(self, vector.get_dones(), {vector.size()}, py::dtype::of<bool>())
+        );
+      },
+      py::arg("actions"),
+      "Step every environment with its action (frame_skip ticks each) and return views of the "
+      "observations, float32 rewards and done flags. The views are overwritten by the next call"
+    )
+    .def(
+      "step",
+      [observations](py::object self, py::array_t<i32, py::array::c_style | py::array::forcecast> actions, RolloutBuffer &buffer) {
+        Vector &vector = self.cast<Vector &>();
+        if (actions.ndim() != 1 or actions.shape(0) != vector.size())
+          throw std::runtime_error("step() expects one action per environment.");
+        {
+          py::gil_scoped_release release;
+          vector.step(actions.data(), buffer);
+        }
+        return py::make_tuple(
+          observations(self),
+          view_of(self, vector.get_rewards(), {vector.size()}),
+          view_of(self, vector.get_dones(), {vector.size()}, py::dtype::of<bool>())
+        );
+      },
+      py::arg("actions"),
+      py::arg("buffer"),
+      "Same as step(actions), and also write the observations the actions are taken from, the "
+      "actions, rewards and done flags into the current step of a RolloutBuffer"
+    )
+    .def("set_pipeline_groups", &Vector::set_pipeline_groups, py::arg("groups"), "Split the environments into contiguous groups for pipelined stepping")
+    .def(
+      "step_async",
+      [](Vector &vector, i32 group, py::array_t<i32, py::array::c_style | py::array::forcecast> actions) {
+        if (actions.ndim() != 1 or actions.shape(0) != vector.get_group_range(group).second)
+          throw std::runtime_error("step_async() expects one action per environment of the group.");
+        vector.step_async(group, actions.data());
+      },
+      py::arg("group"),
+      py::arg("actions"),
+      "Start stepping the environments of a group on the worker threads and return right away"
+    )
+    .def(
+      "step_wait",
+      [group_results](py::object self, i32 group) {
+        {
+          py::gil_scoped_release release;
+          self.cast<Vector &>().step_wait(group);
+        }
+        return group_results(self, group);
+      },
+      py::arg("group"),
+      "Wait for a group to finish stepping and return views of its observations, rewards and done flags"
+    )
+    .def(
+      "step_pipelined",
+      [group_results](py::object self, py::array_t<i32, py::array::c_style | py::array::forcecast> actions) {
+        Vector &vector = self.cast<Vector &>();
+        if (actions.ndim() != 1 or actions.shape(0) != vector.get_group_range(vector.get_next_group()).second)
+          throw std::runtime_error("step_pipelined() expects one action per environment of the next group.");
+        i32 group;
+        {
+          py::gil_scoped_release release;
+          group = vector.step_pipelined(actions.data());
+        }
+        py::tuple results = group_results(self, group);
+        return py::make_tuple(group, results[0], results[1], results[2]);
+      },
+      py::arg("actions"),
+      "Start stepping the next group with its actions, wait for the group after it and return "
+      "(group, observations, rewards, dones) of that group, whose actions are expected next"
+    )
+    .def_property_readonly("pipeline_groups", &Vector::get_pipeline_groups, "Number of pipeline groups")
+    .def_property_readonly("next_group", &Vector::get_next_group, "Group whose actions step_pipelined() expects next")
+    .def("group_range", &Vector::get_group_range, py::arg("group"), "First environment of a group and its number of environments")
+    .def_property_readonly(
+      "features",
+      [](py::object self) {
+        const Vector &vector = self.cast<const Vector &>();
+        if (not vector.get_features_enabled())
+          throw std::runtime_error("Features are not enabled, construct with features=True.");
+        return view_of(self, vector.get_features(), {vector.size(), Features::count});
+      },
+      "View of the (num_envs, FEATURE_COUNT) distance features after the last reset or step"
+    )
+    .def_property_readonly(
+      "score_deltas",
+      [](py::object self) {
+        const Vector &vector = self.cast<const Vector &>();
+        return view_of(self, vector.get_score_deltas(), {vector.size()});
+      },
+      "View of the score gained by every environment during the last step"
+    )
+    .def(
+      "rollout",
+      [](Vector &vector, PolicyType type, i32 n_steps, u64 seed, py::object observations, py::object actions, py::object rewards, py::object score_deltas, py::object dones) {
+        if (n_steps < 0)
+          throw std::runtime_error("rollout() requires a non-negative number of steps.");
+        RolloutArrays arrays({vector.size(), n_steps}, vector.get_observation_shape(), observations, actions, rewards, score_deltas, dones);
+        Trajectory trajectory = arrays.trajectory();
+        {
+          py::gil_scoped_release release;
+          vector.rollout(type, n_steps, trajectory, seed);
+        }
+        return arrays.as_tuple();
+      },
+      py::arg("policy"),
+      py::arg("n_steps"),
+      py::arg("seed") = 0,
+      py::arg("observations") = py::none(),
+      py::arg("actions") = py::none(),
+      py::arg("rewards") = py::none(),
+      py::arg("score_deltas") = py::none(),
+      py::arg("dones") = py::none(),
+      "Roll out a scripted policy for n_steps in every environment and return (observations, actions, "
+      "rewards, score_deltas, dones) with shape (num_envs, n_steps, ...). Arrays that are passed in are written into"
+    )
+    .def(
+      "get_statistics",
+      [](const Vector &vector) { return vector.get_statistics().summary(); },
+      "Summary of the episodes in the statistics window"
+    )
+    .def(
+      "percentile",
+      [](const Vector &vector, const std::string &metric, f64 q) { return vector.get_statistics().percentile(episode_metric(metric), q); },
+      py::arg("metric"),
+      py::arg("q"),
+      "Percentile q in [0, 100] of score, length, lives_lost or pellets_eaten over the statistics window"
+    )
+    .def(
+      "set_pixel_rendering",
+      &Vector::set_pixel_rendering,
+      py::arg("height") = 0,
+      py::arg("width") = 0,
+      py::arg("grayscale") = false,
+      py::arg("cell_size") = 8,
+      "Set up render_pixels() to draw height x width frames, grayscale or RGB, with cells of cell_size "
+      "pixels before scaling. Zero height or width means rows * cell_size or cols * cell_size. Later "
+      "frames go into a new array, so views returned by earlier render_pixels() calls keep their last "
+      "frames"
+    )
+    .def(
+      "render_pixels",
+      [](Vector &vector) {
+        {
+          py::gil_scoped_release release;
+          vector.render_pixels();
+        }
+        // The view owns the pixel array it points into, which set_pixel_rendering() replaces
+        // rather than reallocates
+        auto [height, width, channels] = vector.get_pixel_shape();
+        return view_of(shared_owner(vector.get_pixel_storage()), vector.get_pixels(), {vector.size(), height, width, channels});
+      },
+      "Draw the current frame of every environment on the worker threads and return a view of the "
+      "(num_envs, height, width, channels) uint8 pixels. The view is overwritten by the next call, "
+      "until set_pixel_rendering() moves the frames to a new array"
+    )
+    .def_property_readonly("pixel_shape", &Vector::get_pixel_shape, "Height, width and channels of the frames of render_pixels()")
+    .def("clear_statistics", &Vector::clear_statistics, "Forget all finished episodes and restart counting the running ones")
+    .def("get_state", &Vector::get_state, py::arg("index"), "Get the current state of one environment")
+    .def("close", &close_and_flush<Vector>, "Close all environments")
+    .def_property_readonly("num_envs", &Vector::size, "Number of environments")
+    .def_property_readonly("threads", &Vector::get_threads, "Number of threads stepping the environments")
+    .def_property_readonly("observation_shape", &Vector::get_observation_shape, "Shape of the observation of one environment")
+    .def_property_readonly("window_radius", &Vector::get_window_radius, "Radius of the observation window, or FULL_OBSERVATION")
+    .def("__len__", &Vector::size)
+    .def("__repr__", [repr](const Vector &) { return repr; })
+    .doc() = doc;
+}
+
+template <typename Environment>
+void bind_q_learning_trainer(py::module_ &m, const char *name, const char *doc) {
+  using Trainer = QLearningTrainerT<Environment>;
+
+  py::class_<Trainer>(m, name)
+    .def(
+      py::init<const Config &, const QLearningConfig &, i32, u64>(),
+      py::arg("config"),
+      py::arg("q_config") = QLearningConfig{},
+      py::arg("threads") = 0,
+      py::arg("seed") = 0,
+      "Constructor with the environment config. Zero threads means one per hardware thread, each playing its own environment"
+    )
+    .def("train", &Trainer::train, py::arg("episodes"), py::call_guard<py::gil_scoped_release>(), "Play and learn from more episodes")
+    .def(
+      "act",
+      [](const Trainer &trainer, const Environment &env) { return trainer.act(env.get_state_ref(), env.get_actors()); },
+      py::arg("env"),
+      "Greedy action for the current state of an environment"
+    )
+    .def(
+      "get_table",
+      [](const Trainer &trainer) {
+        std::vector<u64> table_keys;
+        std::vector<f32> table_values;
+        trainer.get_table().export_to(table_keys, table_values);
+
+        const py::ssize_t size = table_keys.size();
+        py::array_t<u64> keys(size);
+        py::array_t<f32> values({size, (py::ssize_t)QTable::actions});
+        std::copy(table_keys.begin(), table_keys.end(), keys.mutable_data());
+        std::copy(table_values.begin(), table_values.end(), values.mutable_data());
+        return py::make_tuple(keys, values);
+      },
+      "Copy of the learned table as (keys, values): the state keys and their (states, 4) action values"
+    )
+    .def(
+      "get_curve",
+      [](const Trainer &trainer) {
+        const std::vector<QLearningEpisode> &curve = trainer.get_curve();
+        const py::ssize_t size = curve.size();
+        py::array_t<f32> epsilon(size), reward(size);
+        py::array_t<i32> score(size), length(size);
+        for (py::ssize_t i = 0; i < size; ++i) {
+          epsilon.mutable_at(i) = curve[i].epsilon;
+          score.mutable_at(i) = curve[i].score;
+          length.mutable_at(i) = curve[i].length;
+          reward.mutable_at(i) = curve[i].reward;
+        }
+        py::dict result;
+        result["epsilon"] = epsilon;
+        result["score"] = score;
+        result["length"] = length;
+        result["reward"] = reward;
+        return result;
+      },
+      "Learning curve as a dict of arrays with one entry per episode, in the order they started"
+    )
+    .def("get_epsilon", &Trainer::get_epsilon, py::arg("episode"), "Exploration rate of an episode")
+    .def_property_readonly("episodes", &Trainer::get_episodes, "Number of episodes played")
+    .def_property_readonly("states", [](const Trainer &trainer) { return trainer.get_table().size(); }, "Number of states in the table")
+    .def_property_readonly("threads", &Trainer::get_threads, "Number of threads playing episodes")
+    .def("__repr__", [](const Trainer &) { return "<pacman_rl.QLearningTrainer>"; })
+    .doc() = doc;
+}
+
 PYBIND11_MODULE(pacman_rl, m) {
   m.doc() = "Pacman environment for Reinforcement Learning";
 
@@ -31,6 +554,18 @@ PYBIND11_MODULE(pacman_rl, m) {
     .value("down", MovementDirection::down, "Down direction")
     .value("right", MovementDirection::right, "Right direction")
     .value("none", MovementDirection::none, "No direction");
+
+  py::enum_<EntityType>(m, "EntityType")
+    .value("blinky", EntityType::blinky, "Blinky, or a ghost that chases like it")
+    .value("pinky", EntityType::pinky, "Pinky, or a ghost that chases like it")
+    .value("inky", EntityType::inky, "Inky, or a ghost that chases like it")
+    .value("clyde", EntityType::clyde, "Clyde, or a ghost that chases like it")
+    .value("pacman", EntityType::pacman, "Pacman")
+    .value("wall", EntityType::wall, "Wall")
+    .value("gate", EntityType::gate, "Gate of the ghost house")
+    .value("pellet", EntityType::pellet, "Pellet")
+    .value("power_pellet", EntityType::power_pellet, "Power pellet")
+    .value("none", EntityType::none, "Empty cell");
   
   py::class_<GhostConfig>(m, "GhostConfig")
     .def(py::init<>(), "Default constructor")
@@ -47,6 +582,20 @@ PYBIND11_MODULE(pacman_rl, m) {
     .def("__repr__", [](const GhostConfig &) { return "<pacman_rl.GhostConfig>"; })
     .def("pretty", pretty_ghost_config);
   
+  py::class_<RewardConfig>(m, "RewardConfig")
+    .def(py::init<>(), "Default constructor, the reward is the score delta")
+    .def_readwrite("score", &RewardConfig::score, "Weight of the score gained")
+    .def_readwrite("pellet", &RewardConfig::pellet, "Added for every pellet eaten")
+    .def_readwrite("power_pellet", &RewardConfig::power_pellet, "Added for every power pellet eaten")
+    .def_readwrite("ghost_eaten", &RewardConfig::ghost_eaten, "Added for every ghost eaten")
+    .def_readwrite("death", &RewardConfig::death, "Added for every life lost")
+    .def_readwrite("step", &RewardConfig::step, "Added on every step")
+    .def_readwrite("pellet_distance", &RewardConfig::pellet_distance, "Weight of the decrease of the maze distance to the nearest pellet")
+    .def_readwrite("ghost_distance", &RewardConfig::ghost_distance, "Weight of the increase of the maze distance to the nearest dangerous ghost")
+    .def_readwrite("ghost_distance_cap", &RewardConfig::ghost_distance_cap, "Ghost distances are capped at this value")
+    .def("__repr__", [](const RewardConfig &) { return "<pacman_rl.RewardConfig>"; })
+    .doc() = "Weighted terms of the per-step reward";
+
   py::class_<Config>(m, "Config")
     .def(py::init<>(), "Default constructor")
     .def(
@@ -68,25 +617,42 @@ PYBIND11_MODULE(pacman_rl, m) {
     .def_readwrite("pellet_points", &Config::pellet_points, "Points for eating a pellet")
     .def_readwrite("power_pellet_points", &Config::power_pellet_points, "Points for eating a power pellet")
     .def_readwrite("power_pellet_steps", &Config::power_pellet_steps, "Number of steps for which the effect of power pellet lasts")
+    .def_readwrite("pacman_count", &Config::pacman_count, "Number of Pacmen sharing the maze, pellets and lives, up to 8. More than one are stepped with step_agents()")
+    .def_readwrite("ghost_count", &Config::ghost_count, "Number of ghosts, up to 64. Ghosts after the fourth start in the house")
+    .def_readwrite("ghost_release_interval", &Config::ghost_release_interval, "Steps between ghosts after the fourth leaving the house")
+    .def_readwrite("ghost_behaviors", &Config::ghost_behaviors, "EntityType whose chase behaviour each ghost follows (empty means cycling blinky, pinky, inky, clyde)")
+    .def_readwrite("max_rows", &Config::max_rows, "Rows reserved for maps switched to on reset (0 means rows)")
+    .def_readwrite("max_cols", &Config::max_cols, "Columns reserved for maps switched to on reset (0 means cols)")
+    .def_readwrite("render_fps", &Config::render_fps, "Frame rate cap of the human render mode, 0 for uncapped (evaluation and recording) or 60 for interactive play")
+    .def_readwrite("reward", &Config::reward, "Weights of the per-step reward")
     .def("__repr__", [](const Config &) { return "<pacman_rl.Config>"; })
     .def("pretty", pretty_config);
   
   py::enum_<RenderMode>(m, "RenderMode")
     .value("ASCII", RenderMode::ascii, "Render to stdout as ASCII")
     .value("HUMAN", RenderMode::human, "Render in graphics mode using raylib")
-    .value("NONE", RenderMode::none, "Do not render");
+    .value("NONE", RenderMode::none, "Do not render")
+    .value("ANSI", RenderMode::ansi, "Render to the terminal, redrawing only the cells that changed")
+    .value("ANSI_COLOR", RenderMode::ansi_color, "Like ANSI, with a color per entity type");
 
   py::class_<State>(m, "State")
     .def(py::init<>(), "Default constructor")
     .def_readwrite("step_index", &State::step_index, "Current step index")
     .def_readwrite("score", &State::score, "Current score")
     .def_readwrite("lives", &State::lives, "Current number of lives")
+    .def_readwrite("pellets_eaten", &State::pellets_eaten, "Number of pellets and power pellets eaten in this episode")
+    .def_readwrite("reward", &State::reward, "Reward of the last step, see Config.reward")
+    .def_readwrite("hash", &State::hash, "Zobrist hash of actors, lives and remaining pellets, stable across runs")
     .def_readwrite("completed", &State::completed, "Whether the episode is completed")
     .def_readwrite("pacman_location", &State::pacman_location, "Current pacman location")
     .def_readwrite("blinky_location", &State::blinky_location, "Current blinky location")
     .def_readwrite("pinky_location", &State::pinky_location, "Current pinky location")
     .def_readwrite("inky_location", &State::inky_location, "Current inky location")
     .def_readwrite("clyde_location", &State::clyde_location, "Current clyde location")
+    .def_readwrite("ghost_locations", &State::ghost_locations, "Current locations of all ghosts")
+    .def_readwrite("pacman_locations", &State::pacman_locations, "Current locations of all Pacmen")
+    .def_readwrite("scores", &State::scores, "Current score of each Pacman, summing to score")
+    .def_readwrite("rewards", &State::rewards, "Reward of each Pacman in the last step, summing to reward")
     .def_readwrite("grid", &State::grid, "Current grid")
     .def("__repr__", [](const State &) { return "<pacman_rl.State>"; })
     .def("pretty", pretty_state);
@@ -95,58 +661,377 @@ PYBIND11_MODULE(pacman_rl, m) {
     .def("reset", &EnvironmentBase::reset, "Reset the environment")
     .def("step", &EnvironmentBase::step, "Perform an action in the environment")
     .def("get_state", &EnvironmentBase::get_state, "Get the current state of the environment")
+    .def("get_observation", &get_observation, "Get the (channels, rows, cols) uint8 tensor observation, one plane per entity type")
+    .def("get_window_observation", &get_window_observation, py::arg("radius"), "Get the (channels, 2 * radius + 1, 2 * radius + 1) window of the observation centered on pacman")
+    .def("get_features", &get_features, "Get the float32 distance features: nearest pellet, nearest power pellet, each ghost and safe directions")
     .def("render", &EnvironmentBase::render, "Render the environment")
-    .def("close", &EnvironmentBase::close, "Close the environment")
+    .def("close", &close_and_flush<EnvironmentBase>, "Close the environment")
     .def("__repr__", [](const EnvironmentBase &) { return "<pacman_rl.EnvironmentBase>"; })
     .def("pretty", pretty_environment, "Pretty print the environment");
   
-  py::class_<PacmanEnvironment>(m, "PacmanEnvironment")
-    .def(py::init<const Config &, RenderMode>(), py::arg("config"), py::arg("mode") = RenderMode::none, "Constructor with config")
-    .def("reset", &PacmanEnvironment::reset, "Reset the environment")
-    .def("step", &PacmanEnvironment::step, "Perform an action in the environment")
-    .def("get_state", &PacmanEnvironment::get_state, "Get the current state of the environment")
-    .def("render", &PacmanEnvironment::render, "Render the environment")
-    .def("close", &PacmanEnvironment::close, "Close the environment")
-    .def("__repr__", [](const PacmanEnvironment &) { return "<pacman_rl.PacmanEnvironment>"; })
-    .def("pretty", pretty_environment, "Pretty print the environment");
+  py::class_<MapBank, std::shared_ptr<MapBank>>(m, "MapBank")
+    .def(py::init<>(), "Default constructor")
+    .def("add", &MapBank::add, py::arg("map"), "Validate and add a map, returning its id. Fails once the bank is attached to an environment")
+    .def("get", &MapBank::get_map, py::arg("map_id"), "Get the map with the given id")
+    .def("save", &MapBank::save, py::arg("filename"), "Save all maps to a single binary file")
+    .def_static("load", &MapBank::load, py::arg("filename"), "Load maps saved with save()")
+    .def_property_readonly("max_rows", &MapBank::get_max_rows, "Largest number of rows of any map")
+    .def_property_readonly("max_cols", &MapBank::get_max_cols, "Largest number of columns of any map")
+    .def_property_readonly("frozen", &MapBank::is_frozen, "Whether the bank is attached to an environment, after which no map can be added")
+    .def("__len__", &MapBank::size)
+    .def("__repr__", [](const MapBank &) { return "<pacman_rl.MapBank>"; })
+    .doc() = "Preloaded maps that an environment can switch between on reset";
+
+  bind_environment<PacmanEnvironment>(m, "PacmanEnvironment", "Pacman environment for maps of any size");
+  bind_environment<PacmanEnvironment21x19>(m, "PacmanEnvironment21x19", "Pacman environment specialized at compile time for 21 rows and 19 columns");
+  bind_environment<PacmanEnvironment31x28>(m, "PacmanEnvironment31x28", "Pacman environment specialized at compile time for 31 rows and 28 columns");
   
   py::class_<RecordVideoEnvironment>(m, "RecordVideoEnvironment")
     .def(
-      py::init<PacmanEnvironment &, bool, u32, std::string, std::string>(),
+      py::init<EnvironmentBase &, bool, u32, std::string, std::string, i32>(),
       py::arg("env"),
       py::arg("should_record") = true,
       py::arg("fps") = 24,
       py::arg("video_folder") = "recordings",
       py::arg("output_filename") = "recording.mp4",
-      "Constructor with environment and recording parameters"
+      py::arg("snapshot_capacity") = 0,
+      "Constructor with environment and recording parameters. With snapshot_capacity > 0, the "
+      "frames of the last snapshot_capacity rendered steps are also kept in memory"
     )
     .def("reset", &RecordVideoEnvironment::reset, "Reset the environment")
     .def("step", &RecordVideoEnvironment::step, "Perform an action in the environment")
     .def("get_state", &RecordVideoEnvironment::get_state, "Get the current state of the environment")
+    .def("get_observation", &get_observation, "Get the (channels, rows, cols) uint8 tensor observation, one plane per entity type")
+    .def("get_window_observation", &get_window_observation, py::arg("radius"), "Get the (channels, 2 * radius + 1, 2 * radius + 1) window of the observation centered on pacman")
+    .def("get_features", &get_features, "Get the float32 distance features: nearest pellet, nearest power pellet, each ghost and safe directions")
     .def(
       "get_snapshot",
       &RecordVideoEnvironment::get_snapshot,
       py::arg("step_index") = -1,
       "Get a snapshot of the currently rendered environment"
     )
+    .def(
+      "get_snapshot_pixels",
+      [](const RecordVideoEnvironment &env, i32 step_index) {
+        const u8 *pixels = env.get_snapshot_pixels(step_index);
+        const py::ssize_t height = env.get_snapshot_height(), width = env.get_snapshot_width();
+
+        // Read-only view into the snapshot ring, which owns the ring's current allocation so that
+        // it outlives the environment and a move of the ring to a frame of another size
+        return view_of(shared_owner(env.get_snapshot_storage()), pixels, {height, width, py::ssize_t(3)});
+      },
+      py::arg("step_index") = -1,
+      "Get the rendered frame of a step as a (height, width, 3) uint8 RGB array without any file "
+      "access. The array is a view that is overwritten once snapshot_capacity more steps are rendered; "
+      "copy it to keep it"
+    )
     .def("render", &RecordVideoEnvironment::render, "Render the environment")
-    .def("close", &RecordVideoEnvironment::close, "Close the environment")
+    .def("close", &close_and_flush<RecordVideoEnvironment>, "Close the environment")
     .def("__repr__", [](const RecordVideoEnvironment &) { return "<pacman_rl.RecordVideoEnvironment>"; })
     .def(
       "pretty",
       [](const RecordVideoEnvironment &r) {
-        pretty_environment(r.get_env());
+        return pretty_environment(r.get_env());
       },
       "Pretty print the environment"
     )
     .doc() = "Environment wrapper to record videos";
   
+  py::class_<FrameSkipEnvironment, EnvironmentBase>(m, "FrameSkipEnvironment")
+    .def(
+      py::init<EnvironmentBase &, i32, bool>(),
+      py::arg("env"),
+      py::arg("skip") = 4,
+      py::arg("max_pool") = false,
+      py::keep_alive<1, 2>(),
+      "Constructor with the environment to wrap, the number of times every action is repeated and "
+      "whether observations are max-pooled over the last two ticks"
+    )
+    .def("get_score_delta", &FrameSkipEnvironment::get_score_delta, "Score gained during the last step")
+    .def("get_reward", &FrameSkipEnvironment::get_reward, "Sum of the rewards of the ticks of the last step")
+    .def("get_ticks", &FrameSkipEnvironment::get_ticks, "Number of ticks the last step advanced, at most skip")
+    .def("get_life_lost", &FrameSkipEnvironment::get_life_lost, "Whether Pacman lost a life during the last step")
+    .def_property_readonly("skip", &FrameSkipEnvironment::get_skip, "Number of times every action is repeated")
+    .def_property_readonly("max_pool", &FrameSkipEnvironment::get_max_pool, "Whether observations are max-pooled")
+    .def("__repr__", [](const FrameSkipEnvironment &) { return "<pacman_rl.FrameSkipEnvironment>"; })
+    .doc() = "Environment wrapper that repeats every action, stopping early on a completed episode or a lost life";
+
+  py::class_<MetricSummary>(m, "MetricSummary")
+    .def_readonly("mean", &MetricSummary::mean)
+    .def_readonly("min", &MetricSummary::min)
+    .def_readonly("max", &MetricSummary::max)
+    .def_readonly("p25", &MetricSummary::p25)
+    .def_readonly("p50", &MetricSummary::p50)
+    .def_readonly("p75", &MetricSummary::p75)
+    .def("as_dict", &metric_summary_dict, "Fields as a dict")
+    .def("__repr__", [](const MetricSummary &) { return "<pacman_rl.MetricSummary>"; })
+    .doc() = "Mean, extremes and quartiles of one metric over the statistics window";
+
+  py::class_<EpisodeStatisticsSummary>(m, "EpisodeStatistics")
+    .def_readonly("episodes", &EpisodeStatisticsSummary::episodes, "Number of episodes finished since the statistics were cleared")
+    .def_readonly("window_episodes", &EpisodeStatisticsSummary::window_episodes, "Number of episodes in the window")
+    .def_readonly("score", &EpisodeStatisticsSummary::score)
+    .def_readonly("length", &EpisodeStatisticsSummary::length, "Episode length in agent steps")
+    .def_readonly("lives_lost", &EpisodeStatisticsSummary::lives_lost)
+    .def_readonly("pellets_eaten", &EpisodeStatisticsSummary::pellets_eaten)
+    .def(
+      "as_dict",
+      [](const EpisodeStatisticsSummary &summary) {
+        py::dict result;
+        result["episodes"] = summary.episodes;
+        result["window_episodes"] = summary.window_episodes;
+        result["score"] = metric_summary_dict(summary.score);
+        result["length"] = metric_summary_dict(summary.length);
+        result["lives_lost"] = metric_summary_dict(summary.lives_lost);
+        result["pellets_eaten"] = metric_summary_dict(summary.pellets_eaten);
+        return result;
+      },
+      "Fields as a nested dict, e.g. for logging"
+    )
+    .def("__repr__", [](const EpisodeStatisticsSummary &) { return "<pacman_rl.EpisodeStatistics>"; })
+    .doc() = "Summary of the episodes in the rolling window of a vector environment";
+
+  m.attr("FULL_OBSERVATION") = full_observation;
+  m.attr("FEATURE_COUNT") = Features::count;
+
+  py::enum_<PolicyType>(m, "PolicyType")
+    .value("RANDOM", PolicyType::random, "Uniformly random direction")
+    .value("GREEDY", PolicyType::greedy, "Shortest path to the nearest pellet or power pellet")
+    .value("AVOID_GHOSTS", PolicyType::avoid_ghosts, "Greedy, unless a ghost is close, in which case move away from it");
+
+  py::class_<Policy>(m, "Policy")
+    .def(
+      py::init<PolicyType, i32, i32, u64, i32>(),
+      py::arg("type"),
+      py::arg("rows"),
+      py::arg("cols"),
+      py::arg("seed") = 0,
+      py::arg("danger_distance") = 3,
+      "Constructor with the policy type, the map size and the seed of its random generator"
+    )
+    .def(
+      "act",
+      [](Policy &policy, py::array_t<u8, py::array::c_style | py::array::forcecast> observation) {
+        if (observation.size() != observation_size(policy.get_rows(), policy.get_cols()))
+          throw std::runtime_error("Observation does not match the map size of the policy.");
+        return policy.act(observation.data());
+      },
+      py::arg("observation"),
+      "Action for a (channels, rows, cols) observation"
+    )
+    .def("seed", &Policy::seed, py::arg("seed"), "Reseed the random generator")
+    .def_property_readonly("type", &Policy::get_type, "Policy type")
+    .def("__repr__", [](const Policy &) { return "<pacman_rl.Policy>"; })
+    .doc() = "Scripted policy acting on tensor observations";
+
   m.def(
-    "make", &make,
+    "rollout",
+    [](EnvironmentBase &env, Policy &policy, i32 n_steps, py::object observations, py::object actions, py::object rewards, py::object score_deltas, py::object dones) {
+      if (n_steps < 0)
+        throw std::runtime_error("rollout() requires a non-negative number of steps.");
+      const Config &config = env.get_config();
+      RolloutArrays arrays({n_steps}, observation_shape(config.rows, config.cols), observations, actions, rewards, score_deltas, dones);
+      Trajectory trajectory = arrays.trajectory();
+      {
+        py::gil_scoped_release release;
+        rollout(env, policy, n_steps, trajectory);
+      }
+      return arrays.as_tuple();
+    },
+    py::arg("env"),
+    py::arg("policy"),
+    py::arg("n_steps"),
+    py::arg("observations") = py::none(),
+    py::arg("actions") = py::none(),
+    py::arg("rewards") = py::none(),
+    py::arg("score_deltas") = py::none(),
+    py::arg("dones") = py::none(),
+    "Run a policy for n_steps from the current state of the environment, resetting it when an episode "
+    "completes, and return (observations, actions, rewards, score_deltas, dones). Arrays that are passed in are written into"
+  );
+
+  py::class_<RolloutBuffer>(m, "RolloutBuffer")
+    .def(
+      py::init<i32, i32, std::array<i32, 3>, u64>(),
+      py::arg("n_steps"),
+      py::arg("num_envs"),
+      py::arg("observation_shape"),
+      py::arg("seed") = 0,
+      "Constructor with the number of steps per update, the number of environments and the "
+      "observation shape of the vector environment. The seed drives minibatch shuffling"
+    )
+    .def("clear", &RolloutBuffer::clear, "Start the next rollout, overwriting the stored one")
+    .def(
+      "compute_advantages",
+      [](RolloutBuffer &buffer, py::array_t<f32, py::array::c_style | py::array::forcecast> last_values, f32 gamma, f32 gae_lambda) {
+        if (last_values.size() != buffer.get_num_envs())
+          throw std::runtime_error("compute_advantages() expects one last value per environment.");
+        py::gil_scoped_release release;
+        buffer.compute_advantages(last_values.data(), gamma, gae_lambda);
+      },
+      py::arg("last_values"),
+      py::arg("gamma") = 0.99f,
+      py::arg("gae_lambda") = 0.95f,
+      "Compute GAE advantages and returns of the full buffer, given the values of the observations after the last step"
+    )
+    .def("shuffle", &RolloutBuffer::shuffle, "Reshuffle the entry indices used for minibatches")
+    .def(
+      "minibatch_indices",
+      [](py::object self, i64 index, i64 batch_size) {
+        const RolloutBuffer &buffer = self.cast<const RolloutBuffer &>();
+        if (batch_size < 1 or index < 0 or (index + 1) * batch_size > buffer.size())
+          throw std::runtime_error("Minibatch is out of range of the buffer.");
+        return view_of(self, buffer.get_indices() + index * batch_size, {batch_size});
+      },
+      py::arg("index"),
+      py::arg("batch_size"),
+      "View of the shuffled flat indices of minibatch `index`, to index the flat arrays with"
+    )
+    .def_property_readonly(
+      "observations",
+      [](py::object self) {
+        const RolloutBuffer &buffer = self.cast<const RolloutBuffer &>();
+        auto [channels, rows, cols] = buffer.get_observation_shape();
+        return view_of(self, buffer.get_observations(), {buffer.get_n_steps(), buffer.get_num_envs(), channels, rows, cols});
+      },
+      "View of the (n_steps, num_envs, channels, rows, cols) observations"
+    )
+    .def_property_readonly(
+      "actions",
+      [](py::object self) {
+        RolloutBuffer &buffer = self.cast<RolloutBuffer &>();
+        return view_of(self, buffer.get_actions(), {buffer.get_n_steps(), buffer.get_num_envs()});
+      },
+      "View of the (n_steps, num_envs) actions"
+    )
+    .def_property_readonly(
+      "rewards",
+      [](py::object self) {
+        RolloutBuffer &buffer = self.cast<RolloutBuffer &>();
+        return view_of(self, buffer.get_rewards(), {buffer.get_n_steps(), buffer.get_num_envs()});
+      },
+      "View of the (n_steps, num_envs) rewards"
+    )
+    .def_property_readonly(
+      "dones",
+      [](py::object self) {
+        RolloutBuffer &buffer = self.cast<RolloutBuffer &>();
+        return view_of(self, buffer.get_dones(), {buffer.get_n_steps(), buffer.get_num_envs()}, py::dtype::of<bool>());
+      },
+      "View of the (n_steps, num_envs) done flags"
+    )
+    .def_property_readonly(
+      "values",
+      [](py::object self) {
+        RolloutBuffer &buffer = self.cast<RolloutBuffer &>();
+        return mutable_view_of(self, buffer.get_values(), {buffer.get_n_steps(), buffer.get_num_envs()});
+      },
+      "Writeable view of the (n_steps, num_envs) value estimates, filled in by the caller"
+    )
+    .def_property_readonly(
+      "log_probs",
+      [](py::object self) {
+        RolloutBuffer &buffer = self.cast<RolloutBuffer &>();
+        return mutable_view_of(self, buffer.get_log_probs(), {buffer.get_n_steps(), buffer.get_num_envs()});
+      },
+      "Writeable view of the (n_steps, num_envs) log-probabilities of the actions, filled in by the caller"
+    )
+    .def_property_readonly(
+      "advantages",
+      [](py::object self) {
+        const RolloutBuffer &buffer = self.cast<const RolloutBuffer &>();
+        return view_of(self, buffer.get_advantages(), {buffer.get_n_steps(), buffer.get_num_envs()});
+      },
+      "View of the (n_steps, num_envs) advantages of the last compute_advantages()"
+    )
+    .def_property_readonly(
+      "returns",
+      [](py::object self) {
+        const RolloutBuffer &buffer = self.cast<const RolloutBuffer &>();
+        return view_of(self, buffer.get_returns(), {buffer.get_n_steps(), buffer.get_num_envs()});
+      },
+      "View of the (n_steps, num_envs) returns of the last compute_advantages()"
+    )
+    .def_property_readonly("position", &RolloutBuffer::get_position, "Step of the next transitions to be written")
+    .def_property_readonly("full", &RolloutBuffer::is_full, "Whether every step was written")
+    .def("__len__", &RolloutBuffer::size, "Number of entries, n_steps * num_envs")
+    .def("__repr__", [](const RolloutBuffer &) { return "<pacman_rl.RolloutBuffer>"; });
+
+  bind_vector_environment<PacmanEnvironment>(m, "VectorEnvironment", "Batch of environments for maps of any size, stepped together on a thread pool");
+  bind_vector_environment<PacmanEnvironment21x19>(m, "VectorEnvironment21x19", "Batch of environments specialized at compile time for 21 rows and 19 columns");
+
+  py::class_<QLearningConfig>(m, "QLearningConfig")
+    .def(py::init<>(), "Default constructor")
+    .def_readwrite("learning_rate", &QLearningConfig::learning_rate, "Step size of the updates, in (0, 1]")
+    .def_readwrite("discount", &QLearningConfig::discount, "Discount factor of future rewards")
+    .def_readwrite("epsilon", &QLearningConfig::epsilon, "Exploration rate of the first episode")
+    .def_readwrite("epsilon_min", &QLearningConfig::epsilon_min, "Lowest exploration rate")
+    .def_readwrite("epsilon_decay", &QLearningConfig::epsilon_decay, "Factor applied to the exploration rate after every episode")
+    .def_readwrite("initial_value", &QLearningConfig::initial_value, "Value of actions that were never updated")
+    .def_readwrite("shards", &QLearningConfig::shards, "Number of independently locked parts of the table")
+    .def("__repr__", [](const QLearningConfig &) { return "<pacman_rl.QLearningConfig>"; });
+
+  bind_q_learning_trainer<PacmanEnvironment>(m, "QLearningTrainer", "Multi-threaded tabular Q-learning over hashed states, for small maps");
+  bind_q_learning_trainer<PacmanEnvironment21x19>(m, "QLearningTrainer21x19", "Multi-threaded tabular Q-learning specialized for 21 rows and 19 columns");
+
+  m.def(
+    "make",
+    [](const Config &config, RenderMode mode, bool specialize) -> py::object {
+      if (specialize and config.rows == 21 and config.cols == 19)
+        return py::cast(PacmanEnvironment21x19(config, mode));
+      if (specialize and config.rows == 31 and config.cols == 28)
+        return py::cast(PacmanEnvironment31x28(config, mode));
+      return py::cast(PacmanEnvironment(config, mode));
+    },
     py::arg("config"),
     py::arg("mode") = RenderMode::none,
-    py::return_value_policy::move,
-    "Creates and returns an environment with the given config"
+    py::arg("specialize") = true,
+    "Creates and returns an environment with the given config. The classic 21x19 and 31x28 map "
+    "sizes get an environment specialized for that size unless `specialize` is false"
+  );
+
+  py::class_<MazeGeneratorConfig>(m, "MazeGeneratorConfig")
+    .def(py::init<>(), "Default constructor")
+    .def_readwrite("rows", &MazeGeneratorConfig::rows, "Number of rows in the generated map")
+    .def_readwrite("cols", &MazeGeneratorConfig::cols, "Number of columns in the generated map")
+    .def_readwrite("seed", &MazeGeneratorConfig::seed, "Seed used by generate() when none is given")
+    .def_readwrite("braid", &MazeGeneratorConfig::braid, "Probability with which each dead end is opened up into a loop")
+    .def_readwrite("extra_openings", &MazeGeneratorConfig::extra_openings, "Probability with which other walls between corridors are knocked down")
+    .def_readwrite("power_pellets", &MazeGeneratorConfig::power_pellets, "Number of power pellets, placed in mirrored pairs")
+    .def("__repr__", [](const MazeGeneratorConfig &) { return "<pacman_rl.MazeGeneratorConfig>"; });
+
+  py::class_<MazeGenerator>(m, "MazeGenerator")
+    .def(py::init<const MazeGeneratorConfig &>(), py::arg("config"), "Constructor with generator config")
+    .def("generate", py::overload_cast<>(&MazeGenerator::generate), "Generate a map using the configured seed")
+    .def("generate", py::overload_cast<u64>(&MazeGenerator::generate), py::arg("seed"), "Generate a map using the given seed")
+    .def(
+      "generate_many",
+      [](MazeGenerator &generator, u64 first_seed, i32 count) {
+        std::vector<std::vector<std::string>> maps;
+        maps.reserve(count);
+        for (i32 i = 0; i < count; ++i)
+          maps.push_back(generator.generate(first_seed + i));
+        return maps;
+      },
+      py::arg("first_seed"),
+      py::arg("count"),
+      "Generate `count` maps using consecutive seeds"
+    )
+    .def("__repr__", [](const MazeGenerator &) { return "<pacman_rl.MazeGenerator>"; })
+    .doc() = "Seeded generator for symmetric maps with a ghost house, usable as Config.map";
+
+  m.def(
+    "generate_maze", &generate_maze,
+    py::arg("config"),
+    "Generates a single map with the given generator config"
+  );
+
+  m.def(
+    "validate_map", &validate_map,
+    py::arg("map"),
+    py::arg("rows"),
+    py::arg("cols"),
+    "Raises if the map cannot be loaded or if some pellet is unreachable"
   );
 
   m.def(
@@ -157,10 +1042,58 @@ PYBIND11_MODULE(pacman_rl, m) {
     py::arg("padding") = 4,
     "Renders the given grid to a PNG file"
   );
+
+  py::class_<ImageExporter>(m, "ImageExporter")
+    .def(
+      py::init<i32, i32, i32>(),
+      py::arg("threads") = 0,
+      py::arg("cell_size") = 30,
+      py::arg("padding") = 4,
+      "Constructor. Zero threads means one per hardware thread"
+    )
+    .def("get_threads", &ImageExporter::get_threads, "Number of threads drawing and encoding images")
+    .def(
+      "export_grids",
+      py::overload_cast<const std::vector<std::vector<std::string>> &, const std::vector<std::string> &>(&ImageExporter::export_grids),
+      py::arg("grids"),
+      py::arg("filenames"),
+      py::call_guard<py::gil_scoped_release>(),
+      "Write each grid to the PNG file with the same index"
+    )
+    .def(
+      "export_grids",
+      py::overload_cast<const std::vector<std::vector<std::string>> &, const std::string &, i32>(&ImageExporter::export_grids),
+      py::arg("grids"),
+      py::arg("directory"),
+      py::arg("first_index") = 0,
+      py::call_guard<py::gil_scoped_release>(),
+      "Write the grids to `directory`/%08d.png, numbered from `first_index`"
+    )
+    .def("__repr__", [](const ImageExporter &) { return "<pacman_rl.ImageExporter>"; })
+    .doc() = "Exports many grids as PNG files in parallel, reusing one image buffer per thread";
   
+  m.def_submodule("trace", "Chrome trace-event recording of environment activity")
+    .def(
+      "enable",
+      [](const std::string &filename, u64 capacity_per_thread) { Tracer::instance().enable(filename, capacity_per_thread); },
+      py::arg("filename") = "",
+      py::arg("capacity_per_thread") = u64(1) << 16,
+      "Start recording events. If a filename is given, the trace is written there when an environment is closed"
+    )
+    .def("disable", &Tracer::disable, "Stop recording events")
+    .def("is_enabled", &Tracer::is_enabled, "Whether events are currently being recorded")
+    .def("clear", [] { Tracer::instance().clear(); }, "Discard all recorded events")
+    .def(
+      "dump",
+      [](const std::string &filename) { Tracer::instance().dump(filename); },
+      py::arg("filename"),
+      "Write all recorded events as Chrome trace-event JSON (viewable in Perfetto)"
+    );
+
   m.def_submodule("pretty_print")
     .def("pretty_location", pretty_location, "Pretty print a location")
     .def("pretty_ghost_config", pretty_ghost_config, "Pretty print a ghost config")
+    .def("pretty_reward_config", pretty_reward_config, "Pretty print a reward config")
     .def("pretty_config", pretty_config, "Pretty print a config")
     .def("pretty_state", pretty_state, "Pretty print a state")
     .def("pretty_environment", pretty_environment, "Pretty print an environment");
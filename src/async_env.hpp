@@ -0,0 +1,443 @@
+#ifndef HEADER_ASYNC_ENV_H
+#define HEADER_ASYNC_ENV_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "environment.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "pacman/constants.hpp"
+#include "pacman/observation.hpp"
+#include "wrappers/vector_env.hpp"
+
+class CoroutineScheduler;
+
+// Coroutine run by a CoroutineScheduler, typically one actor loop per environment:
+//
+//   EnvTask actor(AsyncEnvironment &env) {
+//     env.reset();
+//     while (not env.get_state_ref().completed) {
+//       MovementDirection action = co_await env.act_async();
+//       co_await env.step_async(action);
+//     }
+//   }
+//
+// It does not start until spawned, and its frame is freed when it returns.
+class EnvTask {
+  public:
+    struct promise_type {
+      CoroutineScheduler *scheduler = nullptr;
+
+      EnvTask get_return_object() {
+        return EnvTask(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+
+      std::suspend_always initial_suspend() noexcept {
+        return {};
+      }
+
+      // Tells the scheduler that the task is done, the frame is then freed
+      struct FinalAwaiter {
+        bool await_ready() noexcept {
+          return false;
+        }
+
+        void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+
+        void await_resume() noexcept { }
+      };
+
+      FinalAwaiter final_suspend() noexcept {
+        return {};
+      }
+
+      void return_void() { }
+
+      void unhandled_exception();
+    };
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+
+    friend class CoroutineScheduler;
+
+  public:
+    explicit EnvTask(std::coroutine_handle<promise_type> handle):
+      handle(handle)
+    { }
+
+    EnvTask(EnvTask &&other) noexcept:
+      handle(std::exchange(other.handle, nullptr))
+    { }
+
+    EnvTask(const EnvTask &) = delete;
+    EnvTask& operator=(const EnvTask &) = delete;
+    EnvTask& operator=(EnvTask &&) = delete;
+
+    ~EnvTask() {
+      if (handle)
+        handle.destroy();
+    }
+};
+
+// Runs many EnvTask coroutines on a few worker threads and batches their inference requests.
+//
+// A coroutine that awaits a step is resumed on a worker thread, where the step runs. A coroutine
+// that awaits an action parks its observation in the pending batch. The thread that called run()
+// hands the batch to the inference function once it holds max_batch_size requests, or as soon as
+// no coroutine is running any more, so inference overlaps with the steps of other coroutines and
+// the batch is never held back waiting for work that cannot come.
+class CoroutineScheduler {
+  public:
+    // Writes one action per observation: inference(observations, count, actions), with count
+    // observations of observation_size bytes back to back
+    using InferenceFunction = std::function<void(const u8 *, i32, i32 *)>;
+
+  private:
+    struct Request {
+      std::coroutine_handle<> handle;
+      MovementDirection *action;
+    };
+
+    i64 observation_size;
+    InferenceFunction inference;
+    i32 max_batch_size;
+
+    // Tasks that did not return yet, and tasks resumed on a worker thread right now. Tasks that
+    // are neither running nor done wait in the pending batch
+    std::mutex mutex;
+    std::condition_variable wake;
+    i64 live = 0;
+    i64 running = 0;
+    std::exception_ptr error;
+
+    // Requests and their observations of the batch being filled and of the one being inferred
+    std::vector<Request> pending;
+    std::vector<u8> pending_observations;
+    std::vector<Request> batch;
+    std::vector<u8> batch_observations;
+    std::vector<i32> batch_actions;
+
+    std::atomic<i64> steps = 0;
+    std::atomic<i64> batches = 0;
+    std::atomic<i64> requests = 0;
+
+    // Destroyed first, so that no worker is left running a task
+    ThreadPool pool;
+
+    friend struct EnvTask::promise_type;
+
+  public:
+    // Zero threads means one per hardware thread
+    CoroutineScheduler(i64 observation_size, InferenceFunction inference, i32 max_batch_size = 256, i32 threads = 0):
+      observation_size(observation_size),
+      inference(std::move(inference)),
+      max_batch_size(max_batch_size),
+      pool(threads) {
+      if (observation_size < 0 or max_batch_size < 1)
+        throw std::runtime_error("CoroutineScheduler requires a non-negative observation size and a batch size of at least one.");
+      pending.reserve(max_batch_size);
+      pending_observations.resize(max_batch_size * observation_size);
+      batch.reserve(max_batch_size);
+      batch_observations.resize(max_batch_size * observation_size);
+      batch_actions.resize(max_batch_size);
+    }
+
+    CoroutineScheduler(const CoroutineScheduler &) = delete;
+    CoroutineScheduler& operator=(const CoroutineScheduler &) = delete;
+
+    // Coroutines still reference the scheduler, so it only goes away once none is running. Tasks
+    // left waiting for an action, when run() was never called or stopped early, are destroyed
+    ~CoroutineScheduler() {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return running == 0; });
+      for (const Request &request: pending)
+        request.handle.destroy();
+      live -= (i64)pending.size();
+      pending.clear();
+    }
+
+    // Takes over a task, which starts on a worker thread. Can be called from inside a task
+    void spawn(EnvTask task) {
+      auto handle = std::exchange(task.handle, nullptr);
+      handle.promise().scheduler = this;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        live += 1;
+        running += 1;
+      }
+      submit(handle);
+    }
+
+    // Runs inference on this thread until every spawned task returned. The first exception thrown
+    // by a task or by the inference function is rethrown here once no task is running or every
+    // task returned, and the tasks still waiting for an action are destroyed
+    void run() {
+      TRACE_SCOPE("scheduler.run", "scheduler");
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        wake.wait(lock, [&] {
+          return live == 0 or running == 0 or (i32)pending.size() >= max_batch_size;
+        });
+        // The last task returns before its worker stops counting it as running, so live can reach
+        // zero while running does not
+        if (error != nullptr and (running == 0 or live == 0)) {
+          for (const Request &request: pending)
+            request.handle.destroy();
+          live -= (i64)pending.size();
+          pending.clear();
+          std::rethrow_exception(std::exchange(error, nullptr));
+        }
+        if (live == 0)
+          return;
+        if (pending.empty())
+          continue;
+
+        std::swap(pending, batch);
+        std::swap(pending_observations, batch_observations);
+        wake.notify_all();
+        lock.unlock();
+        infer_batch();
+        lock.lock();
+      }
+    }
+
+    // Number of steps awaited, inference batches run and actions requested
+    i64 get_steps() const {
+      return steps;
+    }
+
+    i64 get_batches() const {
+      return batches;
+    }
+
+    i64 get_requests() const {
+      return requests;
+    }
+
+    i32 get_max_batch_size() const {
+      return max_batch_size;
+    }
+
+    i32 get_threads() const {
+      return pool.size();
+    }
+
+    i64 get_observation_size() const {
+      return observation_size;
+    }
+
+    // Resumes a coroutine on a worker thread
+    void schedule(std::coroutine_handle<> handle) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        running += 1;
+      }
+      submit(handle);
+    }
+
+    // Awaitable that parks an observation in the pending batch and resumes with its action.
+    // `write` fills the observation_size bytes of the request
+    template <typename Write>
+    auto request_action(Write write) {
+      struct Awaiter {
+        CoroutineScheduler &scheduler;
+        Write write;
+        MovementDirection action = MovementDirection::none;
+
+        bool await_ready() {
+          return false;
+        }
+
+        // Once the request is in the batch the coroutine may be resumed by run() at any time,
+        // so nothing of the awaiter is touched after that
+        bool await_suspend(std::coroutine_handle<> handle) {
+          std::unique_lock<std::mutex> lock(scheduler.mutex);
+          scheduler.wake.wait(lock, [&] { return (i32)scheduler.pending.size() < scheduler.max_batch_size; });
+          write(scheduler.pending_observations.data() + scheduler.pending.size() * scheduler.observation_size);
+          scheduler.pending.push_back(Request{handle, &action});
+          scheduler.requests.fetch_add(1, std::memory_order_relaxed);
+          if ((i32)scheduler.pending.size() == scheduler.max_batch_size)
+            scheduler.wake.notify_all();
+          return true;
+        }
+
+        MovementDirection await_resume() {
+          return action;
+        }
+      };
+      return Awaiter{*this, std::move(write)};
+    }
+
+    // Awaitable that runs fn() on a worker thread and resumes with its result
+    template <typename Function>
+    auto run_on_worker(Function fn) {
+      struct Awaiter {
+        CoroutineScheduler &scheduler;
+        Function fn;
+
+        bool await_ready() {
+          return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+          scheduler.schedule(handle);
+        }
+
+        decltype(auto) await_resume() {
+          TRACE_SCOPE("scheduler.step", "scheduler");
+          scheduler.steps.fetch_add(1, std::memory_order_relaxed);
+          return fn();
+        }
+      };
+      return Awaiter{*this, std::move(fn)};
+    }
+
+  private:
+    // Resumes a coroutine already counted as running
+    void submit(std::coroutine_handle<> handle) {
+      pool.submit([this, handle] {
+        handle.resume();
+        std::lock_guard<std::mutex> lock(mutex);
+        running -= 1;
+        if (running == 0 or live == 0)
+          wake.notify_all();
+      });
+    }
+
+    void infer_batch() {
+      TRACE_SCOPE("scheduler.inference", "scheduler");
+      const i32 count = (i32)batch.size();
+      try {
+        inference(batch_observations.data(), count, batch_actions.data());
+      }
+      catch (...) {
+        // The coroutines of the batch resume with no action, run() stops once none is running
+        record_error(std::current_exception());
+        std::fill_n(batch_actions.data(), count, (i32)MovementDirection::none);
+      }
+
+      batches.fetch_add(1, std::memory_order_relaxed);
+      for (i32 i = 0; i < count; ++i) {
+        const i32 action = batch_actions[i];
+        *batch[i].action = action >= 0 and action <= (i32)MovementDirection::none ? static_cast<MovementDirection>(action) : MovementDirection::none;
+        schedule(batch[i].handle);
+      }
+      batch.clear();
+    }
+
+    void record_error(std::exception_ptr exception) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (error == nullptr)
+        error = exception;
+    }
+
+    // Called by a task that returned, on the worker thread resuming it
+    void finish() {
+      std::lock_guard<std::mutex> lock(mutex);
+      live -= 1;
+    }
+};
+
+inline void EnvTask::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+  CoroutineScheduler *scheduler = handle.promise().scheduler;
+  handle.destroy();
+  if (scheduler != nullptr)
+    scheduler->finish();
+}
+
+inline void EnvTask::promise_type::unhandled_exception() {
+  if (scheduler != nullptr)
+    scheduler->record_error(std::current_exception());
+}
+
+// Awaitable interface to one environment, for tasks of a CoroutineScheduler. Steps run on the
+// scheduler's worker threads and actions come from its batched inference, fed with the tensor
+// observation (see observation.hpp) or a window of it.
+class AsyncEnvironment {
+  private:
+    EnvironmentBase &env;
+    CoroutineScheduler &scheduler;
+    i32 window_radius;
+
+  public:
+    AsyncEnvironment(EnvironmentBase &env, CoroutineScheduler &scheduler, i32 window_radius = full_observation):
+      env(env),
+      scheduler(scheduler),
+      window_radius(window_radius) {
+      const Config &config = env.get_config();
+      if (observation_size(config.rows, config.cols, window_radius) != scheduler.get_observation_size())
+        throw std::runtime_error("Observation size of the environment does not match the scheduler.");
+    }
+
+    // co_await step_async(action) advances the environment on a worker thread and resumes with
+    // its state
+    auto step_async(MovementDirection action) {
+      return scheduler.run_on_worker([this, action] () -> const State& {
+        env.advance(action);
+        return env.get_state_ref();
+      });
+    }
+
+    // co_await act_async() resumes with the action inferred for the current observation
+    auto act_async() {
+      return scheduler.request_action([this] (u8 *observation) {
+        env.write_observation(window_radius, observation);
+      });
+    }
+
+    void reset() {
+      env.reset();
+    }
+
+    const State& get_state_ref() const {
+      return env.get_state_ref();
+    }
+
+    EnvironmentBase& get_env() {
+      return env;
+    }
+};
+
+// Awaitable steps of a whole VectorEnvironment, for actor loops that drive a batch at a time
+// (the vector env steps it on its own threads, inference is left to the caller)
+template <typename Environment = PacmanEnvironment>
+class AsyncVectorEnvironmentT {
+  private:
+    VectorEnvironmentT<Environment> &vector;
+    CoroutineScheduler &scheduler;
+
+  public:
+    AsyncVectorEnvironmentT(VectorEnvironmentT<Environment> &vector, CoroutineScheduler &scheduler):
+      vector(vector),
+      scheduler(scheduler)
+    { }
+
+    // co_await step_async(actions) steps every env with its action from a worker thread of the
+    // scheduler. `actions` must stay valid until the coroutine resumes
+    auto step_async(const i32 *actions) {
+      return scheduler.run_on_worker([this, actions] {
+        vector.step(actions);
+      });
+    }
+
+    VectorEnvironmentT<Environment>& get_vector() {
+      return vector;
+    }
+};
+
+using AsyncVectorEnvironment = AsyncVectorEnvironmentT<PacmanEnvironment>;
+using AsyncVectorEnvironment21x19 = AsyncVectorEnvironmentT<PacmanEnvironment21x19>;
+
+#endif // HEADER_ASYNC_ENV_H
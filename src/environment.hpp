@@ -2,19 +2,31 @@
 #define HEADER_ENVIRONMENT_H
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "random.hpp"
+#include "trace.hpp"
 #include "types.hpp"
 #include "pacman/constants.hpp"
+#include "pacman/distance_field.hpp"
 #include "pacman/entity.hpp"
+#include "pacman/features.hpp"
 #include "pacman/grid.hpp"
+#include "pacman/journal.hpp"
+#include "pacman/map_bank.hpp"
+#include "pacman/observation.hpp"
+#include "pacman/reward.hpp"
 #include "pacman/state.hpp"
 #include "pacman/utils.hpp"
+#include "pacman/zobrist.hpp"
 
+#include "render/ansi_renderer.hpp"
 #include "render/ascii_renderer.hpp"
 #include "render/graphics_renderer.hpp"
 
@@ -87,6 +99,31 @@ struct Config {
 
   // Number of steps for which the effect of power pellet lasts
   i32 power_pellet_steps = 20;
+
+  // Number of Pacmen sharing the maze, the pellets and the lives, at most Actors::max_pacmen.
+  // With more than one, the environment is stepped with advance_agents()
+  i32 pacman_count = 1;
+
+  // Number of ghosts, at most Actors::max_ghosts. The first four are Blinky, Pinky, Inky and
+  // Clyde of the map. Further ghosts start in the house on the cells of Pinky, Inky and Clyde in
+  // turn, with their configs, and leave it `ghost_release_interval` steps apart after Clyde
+  i32 ghost_count = Actors::classic_ghosts;
+  i32 ghost_release_interval = 10;
+
+  // Chase behaviour and scatter corner of every ghost, as one of the four ghost types. Empty
+  // means that ghost i behaves like classic ghost i % 4
+  std::vector<EntityType> ghost_behaviors = {};
+
+  // Buffers are sized for maps up to this size so that switching maps on reset does not
+  // reallocate them. Zero means the size of `map`
+  i32 max_rows = 0;
+  i32 max_cols = 0;
+
+  // Frame rate cap of RenderMode::human. Zero leaves it uncapped, for evaluation and recording;
+  // 60 suits interactive play
+  i32 render_fps = 0;
+
+  RewardConfig reward = {};
 };
 
 class EnvironmentBase {
@@ -94,476 +131,1062 @@ class EnvironmentBase {
     virtual State reset() = 0;
     virtual State step(MovementDirection direction) = 0;
     virtual State get_state() const = 0;
+
+    // Same as step() and get_state() without copying the state, and in particular its grid.
+    // Used by wrappers and batched code that step many times per call
+    virtual void advance(MovementDirection direction) = 0;
+    virtual const State& get_state_ref() const = 0;
+
+    // Reward of the last step, see RewardConfig
+    virtual f32 get_reward() const = 0;
+
+    // Writes the tensor observation (see observation.hpp) of the current state into `out`,
+    // which must hold observation_size(rows, cols) values
+    virtual void get_observation(u8 *out) const = 0;
+
+    // Writes the window observation of the given radius (see observation.hpp) into `out`, which
+    // must hold observation_size(rows, cols, radius) values
+    virtual void get_window_observation(i32 radius, u8 *out) const = 0;
+
+    // Writes the Features::count distance features (see features.hpp) of the current state
+    virtual void get_features(f32 *out) = 0;
+
+    // Full or window observation depending on window_radius
+    void write_observation(i32 window_radius, u8 *out) const {
+      if (window_radius == full_observation)
+        get_observation(out);
+      else
+        get_window_observation(window_radius, out);
+    }
+
+    virtual const Config& get_config() const = 0;
+    virtual RenderMode get_render_mode() const = 0;
     virtual void render() = 0;
     virtual void close() const = 0;
     virtual ~EnvironmentBase() { }
 };
 
-class PacmanEnvironment: EnvironmentBase {
+// Pacman environment for maps of size Rows x Cols. When both are known at compile time, all
+// per-cell storage (grid, background, pellet mask and neighbour table) are std::arrays and loops
+// over the map have constant trip counts. PacmanEnvironment is the runtime-sized variant.
+template <i32 Rows = dynamic_extent, i32 Cols = dynamic_extent>
+class PacmanEnvironmentT: public EnvironmentBase {
+  public:
+    static constexpr bool is_fixed = GridT<Rows, Cols>::is_fixed;
+
   private:
+    static constexpr i32 cells = GridT<Rows, Cols>::size;
+    static constexpr i32 pellet_mask_words = is_fixed ? (cells + 63) / 64 : dynamic_extent;
+
+    // Bits of the neighbour table. For each cell and direction (including none, which refers
+    // to the cell itself), whether that neighbour is free or a gate. Walls have neither bit set
+    static constexpr i32 free_shift = 0;
+    static constexpr i32 gate_shift = 5;
+    static_assert(free_shift == 0, "DistanceField reads the free bits of the neighbour table");
+
+    static constexpr char wall_char = '#';
+    static constexpr char gate_char = 'G';
+
     Config config;
     State state;
-    Grid grid;
+    GridT<Rows, Cols> grid;
     RenderMode mode;
+
+    // Static tiles and remaining pellets as map characters, with actors left out
+    CellArray<char, cells> background;
+    CellArray<u64, pellet_mask_words> pellet_mask;
+    CellArray<u16, cells> neighbours;
     
-    std::unique_ptr<Pacman> pacman;
-    std::unique_ptr<Blinky> blinky;
-    std::unique_ptr<Pinky> pinky;
-    std::unique_ptr<Inky> inky;
-    std::unique_ptr<Clyde> clyde;
-    std::vector<std::unique_ptr<Entity>> entities;
-    std::vector<std::pair<i32, Entity*>> grid_storage;
+    Actors actors;
+    std::array<GhostConfig, Actors::capacity> ghost_configs;
+    GhostAnchors ghost_anchors;
     
     AsciiRenderer ascii_renderer;
+    AnsiRenderer ansi_renderer;
     GraphicsRenderer graphics_renderer;
 
-    Location initial_pacman_location = {};
+    std::array<Location, Actors::max_pacmen> initial_pacman_locations;
+
+    // Map used on reset. Either points into compiled_map or, when map_id is not -1, into the map
+    // bank, in which case it is taken from the bank again on every reset
+    std::vector<EntityType> compiled_map;
+    std::shared_ptr<const MapBank> map_bank;
+    MapView map;
+    i32 map_id = -1;
+    Random random;
+
+    // Bumped whenever the map changes so that renderers can rebuild what they cache per map
+    u64 layout_version = 1;
+
+    // Maze distances from each pacman to the nearest pellet and dangerous ghost after the last
+    // step, and BFS scratch buffers. Only maintained when the reward uses them
+    std::array<i32, Actors::max_pacmen> pellet_distances = {};
+    std::array<i32, Actors::max_pacmen> ghost_distances = {};
+    CellArray<i32, cells> bfs_distances;
+    CellArray<i32, cells> bfs_queue;
+
+    // Distances to the nearest pellet and power pellet from every cell, built by the first
+    // get_features() of an episode and then updated as pellets are eaten
+    DistanceField pellet_field;
+    DistanceField power_pellet_field;
+    bool features_valid = false;
+
+    // Zobrist hash of the current state, kept up to date by every change to it
+    u64 zobrist_hash = 0;
+
+    // Records of the last steps for undo(), disabled unless a capacity is set
+    Journal journal;
 
     using Step = std::pair <Location, MovementDirection>;
-  
-  public:  
-    friend std::string pretty_environment(const PacmanEnvironment &env);
 
-    PacmanEnvironment(const Config &c, RenderMode mode = RenderMode::none):
+    // Per-ghost values of one step, one array per value indexed by actor id, so that the loops
+    // over ghosts in perform_ghost_steps() work on contiguous lanes
+    struct GhostLanes {
+      std::array<i32, Actors::capacity> x, y;
+      std::array<i32, Actors::capacity> target_x, target_y;
+      std::array<i32, Actors::capacity> direction;
+      std::array<i32, Actors::capacity> bits;
+      std::array<i32, Actors::capacity> gate;
+      std::array<i32, Actors::capacity> sign;
+      std::array<i32, Actors::capacity> best;
+      std::array<i32, Actors::capacity> moved;
+      std::array<i32, Actors::capacity> next_x, next_y, next_direction;
+    };
+  
+  public:
+    PacmanEnvironmentT(const Config &c, RenderMode mode = RenderMode::none):
       config(c),
       grid(config.rows, config.cols),
-      mode(mode) {
+      mode(mode),
+      ansi_renderer(mode == RenderMode::ansi_color) {
+      compile_map(config.map, config.rows, config.cols, compiled_map);
+      map = MapView{config.rows, config.cols, compiled_map.data()};
+      reserve_buffers(std::max(config.max_rows, config.rows), std::max(config.max_cols, config.cols));
       reset();
     }
 
-    PacmanEnvironment(PacmanEnvironment &&other):
+    PacmanEnvironmentT(PacmanEnvironmentT &&other):
       config(std::move(other.config)),
       state(std::move(other.state)),
       grid(std::move(other.grid)),
       mode(std::move(other.mode)),
-      pacman(std::move(other.pacman)),
-      blinky(std::move(other.blinky)),
-      pinky(std::move(other.pinky)),
-      inky(std::move(other.inky)),
-      clyde(std::move(other.clyde)),
-      entities(std::move(other.entities)),
-      grid_storage(std::move(other.grid_storage)),
+      background(std::move(other.background)),
+      pellet_mask(std::move(other.pellet_mask)),
+      neighbours(std::move(other.neighbours)),
+      actors(std::move(other.actors)),
+      ghost_configs(std::move(other.ghost_configs)),
+      ghost_anchors(std::move(other.ghost_anchors)),
       ascii_renderer(std::move(other.ascii_renderer)),
+      ansi_renderer(std::move(other.ansi_renderer)),
       graphics_renderer(std::move(other.graphics_renderer)),
-      initial_pacman_location(std::move(other.initial_pacman_location))
+      initial_pacman_locations(std::move(other.initial_pacman_locations)),
+      compiled_map(std::move(other.compiled_map)),
+      map_bank(std::move(other.map_bank)),
+      map(std::move(other.map)),
+      map_id(std::move(other.map_id)),
+      random(std::move(other.random)),
+      layout_version(std::move(other.layout_version)),
+      pellet_distances(std::move(other.pellet_distances)),
+      ghost_distances(std::move(other.ghost_distances)),
+      bfs_distances(std::move(other.bfs_distances)),
+      bfs_queue(std::move(other.bfs_queue)),
+      pellet_field(std::move(other.pellet_field)),
+      power_pellet_field(std::move(other.power_pellet_field)),
+      features_valid(std::move(other.features_valid)),
+      zobrist_hash(std::move(other.zobrist_hash)),
+      journal(std::move(other.journal))
     { }
 
-    PacmanEnvironment& operator=(PacmanEnvironment &&other) {
+    PacmanEnvironmentT& operator=(PacmanEnvironmentT &&other) {
       if (this == &other)
         return *this;
       config = std::move(other.config);
       state = std::move(other.state);
       grid = std::move(other.grid);
       mode = std::move(other.mode);
-      pacman = std::move(other.pacman);
-      blinky = std::move(other.blinky);
-      pinky = std::move(other.pinky);
-      inky = std::move(other.inky);
-      clyde = std::move(other.clyde);
-      entities = std::move(other.entities);
-      grid_storage = std::move(other.grid_storage);
+      background = std::move(other.background);
+      pellet_mask = std::move(other.pellet_mask);
+      neighbours = std::move(other.neighbours);
+      actors = std::move(other.actors);
+      ghost_configs = std::move(other.ghost_configs);
+      ghost_anchors = std::move(other.ghost_anchors);
       ascii_renderer = std::move(other.ascii_renderer);
+      ansi_renderer = std::move(other.ansi_renderer);
       graphics_renderer = std::move(other.graphics_renderer);
-      initial_pacman_location = std::move(other.initial_pacman_location);
+      initial_pacman_locations = std::move(other.initial_pacman_locations);
+      compiled_map = std::move(other.compiled_map);
+      map_bank = std::move(other.map_bank);
+      map = std::move(other.map);
+      map_id = std::move(other.map_id);
+      random = std::move(other.random);
+      layout_version = std::move(other.layout_version);
+      pellet_distances = std::move(other.pellet_distances);
+      ghost_distances = std::move(other.ghost_distances);
+      bfs_distances = std::move(other.bfs_distances);
+      bfs_queue = std::move(other.bfs_queue);
+      pellet_field = std::move(other.pellet_field);
+      power_pellet_field = std::move(other.power_pellet_field);
+      features_valid = std::move(other.features_valid);
+      zobrist_hash = std::move(other.zobrist_hash);
+      journal = std::move(other.journal);
       return *this;
     }
 
-    ~PacmanEnvironment()
+    ~PacmanEnvironmentT()
     { }
 
     State reset() override {
+      TRACE_SCOPE("reset", "env");
+      if (map_id >= 0)
+        load_bank_map();
+
       state.step_index = 0;
       state.score = 0;
       state.lives = config.pacman_lives;
+      state.pellets_eaten = 0;
       state.completed = false;
+      state.reward = 0;
+      features_valid = false;
+      zobrist_hash = zobrist_key(ZobristFeature::lives, 0, state.lives);
+      journal.clear();
       state.pacman_location = {};
       state.blinky_location = {};
       state.pinky_location = {};
       state.inky_location = {};
       state.clyde_location = {};
-      state.grid = std::vector <std::string> (config.rows, std::string(config.cols, ' '));
+      state.grid.resize(config.rows);
+      for (auto &row: state.grid)
+        row.resize(config.cols, ' ');
       
       sync_ghost_config();
-      grid_storage.clear();
-
-      pacman = std::make_unique<Pacman>(Location{}, default_movement_direction(EntityType::pacman));
-      blinky = std::make_unique<Blinky>(config.blinky_config);
-      pinky  = std::make_unique<Pinky>(config.pinky_config, config.pinky_target_offset);
-      inky   = std::make_unique<Inky>(config.inky_config);
-      clyde  = std::make_unique<Clyde>(config.clyde_config, config.clyde_target_switch_distance);
-      grid_storage.emplace_back(entity_type_render_precedence(pacman->type), pacman.get());
-      grid_storage.emplace_back(entity_type_render_precedence(blinky->type), blinky.get());
-      grid_storage.emplace_back(entity_type_render_precedence(pinky->type), pinky.get());
-      grid_storage.emplace_back(entity_type_render_precedence(inky->type), inky.get());
-      grid_storage.emplace_back(entity_type_render_precedence(clyde->type), clyde.get());
+      state.scores.assign(actors.pacmen(), 0);
+      state.rewards.assign(actors.pacmen(), 0);
+      grid.resize(config.rows, config.cols);
 
       initialize_grid();
-      std::sort(grid_storage.begin(), grid_storage.end());
+      reset_actors();
+      zobrist_hash ^= zobrist_actors_hash(actors);
+      if (config.reward.uses_distances())
+        update_reward_distances();
       update_state();
       
       return state;
     }
+
+    // Switches to the given map of the map bank, reusing all buffers, and resets
+    State reset(i32 map_id) {
+      if (map_bank == nullptr)
+        throw std::runtime_error("reset(map_id) requires a map bank. Did you forget to call set_map_bank()?");
+      MapView view = map_bank->get(map_id);
+      if (is_fixed and (view.rows != Rows or view.cols != Cols))
+        throw std::runtime_error("Map " + std::to_string(map_id) + " does not match the compile-time size of the environment.");
+      this->map_id = map_id;
+      layout_version += 1;
+      return reset();
+    }
+
+    // Switches to a uniformly sampled map of the map bank and resets
+    State reset_random_map() {
+      if (map_bank == nullptr)
+        throw std::runtime_error("reset_random_map() requires a map bank. Did you forget to call set_map_bank()?");
+      return reset((i32)random.uniform(map_bank->size()));
+    }
+
+    // Freezes the bank, so that no map can be added to it while the environment reads from it. If
+    // a map of the previous bank is in use, the next reset() takes the map with the same id from
+    // this one
+    void set_map_bank(std::shared_ptr<const MapBank> bank, u64 seed = 0) {
+      bank->freeze();
+      map_bank = std::move(bank);
+      random.seed(seed);
+      if (map_id >= 0)
+        layout_version += 1;
+      reserve_buffers(
+        std::max({config.max_rows, config.rows, map_bank->get_max_rows()}),
+        std::max({config.max_cols, config.cols, map_bank->get_max_cols()})
+      );
+    }
+
+    // Index into the map bank of the current map, or -1 if the map from the config is used
+    i32 get_map_id() const {
+      return map_id;
+    }
     
     State step(MovementDirection direction) override {
-      const auto blinky_target = blinky->get_target(pacman.get());
-      const auto pinky_target  = pinky->get_target(pacman.get());
-      const auto inky_target   = inky->get_target(pacman.get(), blinky.get());
-      const auto clyde_target  = clyde->get_target(pacman.get());
-      
-      auto [pacman_location, pacman_direction] = perform_pacman_step(direction);
-      auto [blinky_location, blinky_direction] = perform_ghost_step(blinky.get(), blinky_target);
-      auto [pinky_location, pinky_direction]   = perform_ghost_step(pinky.get(), pinky_target);
-      auto [inky_location, inky_direction]     = perform_ghost_step(inky.get(), inky_target);
-      auto [clyde_location, clyde_direction]   = perform_ghost_step(clyde.get(), clyde_target);
-      bool pacman_should_step = true;
-      bool blinky_should_step = true;
-      bool pinky_should_step = true;
-      bool inky_should_step = true;
-      bool clyde_should_step = true;
-
-      if (pacman_location == blinky_location or pacman_location == pinky_location or
-          pacman_location == inky_location or pacman_location == clyde_location) {
-        handle_pacman_death();
-        pacman_should_step = false;
-        blinky_should_step = false;
-        pinky_should_step = false;
-        inky_should_step = false;
-        clyde_should_step = false;
-      }
-      else {
-        Entity *entity = grid.get(pacman_location);
-        
-        // If there is no existing entity at this cell, there is nothing to update as positions
-        // are handled elsewhere
-        if (entity == nullptr)
+      advance(direction);
+      return state;
+    }
+
+    void advance(MovementDirection direction) override {
+      if (actors.pacmen() != 1)
+        throw std::runtime_error("An environment with several Pacmen is stepped with advance_agents(), one direction per Pacman.");
+      advance_agents(&direction);
+    }
+
+    // Steps every Pacman with its own direction, `directions` holding one per Pacman, and the
+    // ghosts once. Pacmen are resolved in order: each one that walks into a ghost eats it or is
+    // caught, and the first one to reach a pellet eats it. When any Pacman is caught, the shared
+    // lives go down, nobody eats a pellet on that step and all actors go back to their start.
+    // Per-Pacman scores and rewards are in State::scores and State::rewards, and State::score
+    // and State::reward are their totals. Invalid directions throw before anything changes
+    void advance_agents(const MovementDirection *directions) {
+      TraceScope step_scope(TRACE_SITE("step", "env"));
+      TraceScope phase(TRACE_SITE("step.move", "env"), step_scope);
+
+      const RewardConfig &weights = config.reward;
+      const i32 pacmen = actors.pacmen();
+      for (i32 pacman = 0; pacman < pacmen; ++pacman)
+        if ((i32)directions[pacman] < 0 or directions[pacman] > MovementDirection::none)
+          throw std::runtime_error("Invalid action " + std::to_string((i32)directions[pacman]) + " for Pacman " + std::to_string(pacman) + ".");
+      std::array<i32, Actors::max_pacmen> initial_scores;
+      std::array<f32, Actors::max_pacmen> rewards;
+      std::copy_n(state.scores.begin(), pacmen, initial_scores.begin());
+      std::fill_n(rewards.begin(), pacmen, weights.step);
+      StepRecord *record = journal.is_enabled() ? &record_step() : nullptr;
+
+      // Any actor may change below, so their keys are taken out here and put back at the end
+      zobrist_hash ^= zobrist_actors_hash(actors);
+
+      GhostLanes lanes;
+      ghost_targets(
+        actors, ghost_anchors, config.pinky_target_offset, config.clyde_target_switch_distance, lanes.target_x.data(), lanes.target_y.data()
+      );
+
+      std::array<Step, Actors::max_pacmen> pacman_steps;
+      for (i32 pacman = 0; pacman < pacmen; ++pacman)
+        pacman_steps[pacman] = perform_pacman_step(pacman, directions[pacman]);
+      perform_ghost_steps(lanes);
+      std::array<bool, Actors::capacity> should_step;
+      std::fill_n(should_step.begin(), actors.count, true);
+
+      phase.next(TRACE_SITE("step.collide", "env"));
+      bool pacman_died = false;
+      std::array<bool, Actors::max_pacmen> may_eat;
+      for (i32 pacman = 0; pacman < pacmen; ++pacman) {
+        const Location &pacman_location = pacman_steps[pacman].first;
+        bool caught = false;
+        for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+          caught |= should_step[ghost] and pacman_location.x == lanes.next_x[ghost] and pacman_location.y == lanes.next_y[ghost];
+
+        // Collisions with ghosts that pacman walks into are resolved against the ghost positions
+        // before this step. Pellets only count when pacman actually moved onto them
+        may_eat[pacman] = false;
+        i32 collided_ghost = ghost_at(pacman_location);
+        if (caught or pacman_location == actors.locations[pacman])
           ;
-        
-        // Handle score update and activating power pellet mode based on entity type
-        else if (entity->type == EntityType::pellet or entity->type == EntityType::power_pellet) {
-          Item *item = static_cast<Item*>(entity);
-          state.score += item->points;
-
-          if (item->type == EntityType::power_pellet) {
-            blinky->set_mode(GhostMode::freight);
-            pinky->set_mode(GhostMode::freight);
-            inky->set_mode(GhostMode::freight);
-            clyde->set_mode(GhostMode::freight);
-          }
-          
-          // TODO: Find a better way to do this
-          i32 index = -1;
-          for (i32 i = 0; i < (i32)grid_storage.size(); ++i) {
-            auto &[_, entity] = grid_storage[i];
-            if (entity == item) {
-              index = i;
-              break;
-            }
-          }
-          
-          if (index != -1)
-            grid_storage.erase(grid_storage.begin() + index);
-          else
-            throw std::runtime_error("This should not be possible.");
-        }
 
-        // Handle collision with ghost based on current ghost mode.
         // If ghost is in chase/scatter mode, pacman loses a life.
         // If ghost is in freight mode, pacman eats it and gets extra points while also sending it back inside the house.
-        else if (
-          entity->type == EntityType::blinky or entity->type == EntityType::pinky or
-          entity->type == EntityType::inky   or entity->type == EntityType::clyde
-        ) {
-          Ghost *ghost = static_cast<Ghost*>(entity);
-          if (ghost->config.mode == GhostMode::chase or ghost->config.mode == GhostMode::scatter) {
-            handle_pacman_death();
-            pacman_should_step = false;
-            blinky_should_step = false;
-            pinky_should_step = false;
-            inky_should_step = false;
-            clyde_should_step = false;
-          }
-          else if (ghost->config.mode == GhostMode::freight) {
-            state.score += config.score_per_ghost_eaten;
-            ghost->set(blinky->config.initial_location, ghost->config.initial_direction);
-            ghost->set_mode(GhostMode::scatter);
-            switch (ghost->type) {
-              case EntityType::blinky: blinky_should_step = false; break;
-              case EntityType::pinky: pinky_should_step = false; break;
-              case EntityType::inky: inky_should_step = false; break;
-              case EntityType::clyde: clyde_should_step = false; break;
-              default: __builtin_unreachable();
-            }
+        else if (collided_ghost != -1) {
+          GhostMode ghost_mode = actors.modes[collided_ghost];
+          if (ghost_mode == GhostMode::chase or ghost_mode == GhostMode::scatter)
+            caught = true;
+          else if (ghost_mode == GhostMode::freight) {
+            add_score(pacman, config.score_per_ghost_eaten);
+            rewards[pacman] += weights.ghost_eaten;
+            actors.set(collided_ghost, config.blinky_config.initial_location, ghost_config(collided_ghost).initial_direction);
+            actors.set_mode(collided_ghost, GhostMode::scatter);
+            should_step[collided_ghost] = false;
           }
           else
             throw std::runtime_error("This should not beeee possible.");
         }
+        else
+          may_eat[pacman] = true;
+
+        if (caught)
+          rewards[pacman] += weights.death;
+        pacman_died |= caught;
       }
 
-      for (auto &[_, entity]: grid_storage)
-        unset_grid(entity);
+      // Handle score update and activating power pellet mode based on tile type
+      for (i32 pacman = 0; pacman < pacmen and not pacman_died; ++pacman) {
+        if (not may_eat[pacman])
+          continue;
+        const Location &pacman_location = pacman_steps[pacman].first;
+        EntityType tile = grid.get(pacman_location);
+        if (tile == EntityType::pellet or tile == EntityType::power_pellet) {
+          add_score(pacman, tile == EntityType::pellet ? config.pellet_points : config.power_pellet_points);
+          state.pellets_eaten += 1;
+          rewards[pacman] += tile == EntityType::pellet ? weights.pellet : weights.power_pellet;
+          if (record != nullptr) {
+            record->pellet_indices[pacman] = get_index(pacman_location);
+            record->pellet_types[pacman] = tile;
+          }
+          remove_pellet(pacman_location);
+
+          if (tile == EntityType::power_pellet)
+            for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+              actors.set_mode(ghost, GhostMode::freight);
+        }
+      }
 
-      if (pacman_should_step) pacman->set(pacman_location, pacman_direction);
-      if (blinky_should_step) blinky->step(blinky_location, blinky_direction);
-      if (pinky_should_step) pinky->step(pinky_location, pinky_direction);
-      if (inky_should_step) inky->step(inky_location, inky_direction);
-      if (clyde_should_step) clyde->step(clyde_location, clyde_direction);
+      if (pacman_died) {
+        handle_pacman_death();
+        std::fill_n(should_step.begin(), actors.count, false);
+      }
 
-      for (auto &[_, entity]: grid_storage)
-        set_grid(entity);
+      phase.next(TRACE_SITE("step.actors", "env"));
+      for (i32 pacman = 0; pacman < pacmen; ++pacman)
+        if (should_step[pacman])
+          actors.set(pacman, pacman_steps[pacman].first, pacman_steps[pacman].second);
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        if (should_step[ghost])
+          actors.step_ghost(
+            ghost, ghost_config(ghost), Location{lanes.next_x[ghost], lanes.next_y[ghost]}, static_cast<MovementDirection>(lanes.next_direction[ghost])
+          );
+      zobrist_hash ^= zobrist_actors_hash(actors);
+      phase.stop();
 
       state.step_index += 1;
       if (state.step_index >= config.max_episode_steps)
         state.completed = true;
+
+      for (i32 pacman = 0; pacman < pacmen; ++pacman)
+        rewards[pacman] += weights.score * (state.scores[pacman] - initial_scores[pacman]);
+      if (weights.uses_distances()) {
+        TRACE_SCOPE("step.reward", "env");
+        const auto previous_pellet_distances = pellet_distances, previous_ghost_distances = ghost_distances;
+        update_reward_distances();
+        for (i32 pacman = 0; pacman < pacmen; ++pacman) {
+          rewards[pacman] += weights.pellet_distance * (previous_pellet_distances[pacman] - pellet_distances[pacman]);
+          rewards[pacman] += weights.ghost_distance * (ghost_distances[pacman] - previous_ghost_distances[pacman]);
+        }
+      }
+      std::copy_n(rewards.begin(), pacmen, state.rewards.begin());
+      state.reward = rewards[0];
+      for (i32 pacman = 1; pacman < pacmen; ++pacman)
+        state.reward += rewards[pacman];
       
       update_state();
-      
-      return state;
     }
 
     State get_state() const override {
       return state;
     }
 
+    const State& get_state_ref() const override {
+      return state;
+    }
+
+    f32 get_reward() const override {
+      return state.reward;
+    }
+
+    void get_observation(u8 *out) const override {
+      TRACE_SCOPE("observation", "env");
+
+      const i32 plane = rows() * cols();
+      std::fill_n(out, observation_size(rows(), cols()), 0);
+      for (i32 index = 0; index < plane; ++index) {
+        EntityType tile = grid.tiles[index];
+        if (tile != EntityType::none)
+          out[observation_channel(tile) * plane + index] = 1;
+      }
+      for (i32 actor = 0; actor < actors.count; ++actor)
+        out[observation_channel(actors.types[actor]) * plane + get_index(actors.locations[actor])] = 1;
+    }
+
+    void get_window_observation(i32 radius, u8 *out) const override {
+      TRACE_SCOPE("observation.window", "env");
+      if (radius < 0)
+        throw std::runtime_error("Window radius must be non-negative.");
+      write_window_observation(actors.locations[Actors::pacman], radius, out);
+    }
+
+    // Observations of every Pacman (see agent_observation_shape()), agent after agent, into `out`,
+    // which must hold pacmen x agent_observation_size(rows, cols, window_radius) values
+    void get_agent_observations(i32 window_radius, u8 *out) const {
+      TRACE_SCOPE("observation.agents", "env");
+      if (window_radius < 0 and window_radius != full_observation)
+        throw std::runtime_error("Window radius must be non-negative or full_observation.");
+
+      const auto [channels, height, width] = agent_observation_shape(rows(), cols(), window_radius);
+      const i32 plane = height * width;
+      for (i32 agent = 0; agent < actors.pacmen(); ++agent, out += (i64)channels * plane) {
+        const Location &center = actors.locations[agent];
+        i32 top = 0, left = 0;
+        if (window_radius == full_observation)
+          get_observation(out);
+        else {
+          write_window_observation(center, window_radius, out);
+          top = center.x - window_radius;
+          left = center.y - window_radius;
+        }
+
+        u8 *own = out + observation_channel(EntityType::pacman) * plane;
+        u8 *others = out + other_pacmen_channel * plane;
+        std::fill_n(own, plane, 0);
+        std::fill_n(others, plane, 0);
+        for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman) {
+          const i32 wx = actors.locations[pacman].x - top, wy = actors.locations[pacman].y - left;
+          if (wx >= 0 and wx < height and wy >= 0 and wy < width)
+            (pacman == agent ? own : others)[wx * width + wy] = 1;
+        }
+      }
+    }
+
+    void get_features(f32 *out) override {
+      TRACE_SCOPE("features", "env");
+
+      if (not features_valid) {
+        const i32 c = cols();
+        auto is_tile = [&] (EntityType type) {
+          return [&, type] (i32 index) { return grid.get(Location{index / c, index % c}) == type; };
+        };
+        pellet_field.build(rows(), c, neighbours.data(), is_tile(EntityType::pellet));
+        power_pellet_field.build(rows(), c, neighbours.data(), is_tile(EntityType::power_pellet));
+        features_valid = true;
+      }
+
+      const Location &pacman = actors.locations[Actors::pacman];
+      const i32 start = get_index(pacman);
+      out[Features::pellet_distance] = pellet_field.distance(start);
+      out[Features::power_pellet_distance] = power_pellet_field.distance(start);
+
+      // BFS from pacman through free cells and gates, until every reported ghost is found. Only
+      // the first four ghosts have a distance feature, missing ones are -1
+      const i32 c = cols();
+      const i32 reported = std::min(actors.count, actors.first_ghost + Actors::classic_ghosts);
+      std::fill_n(bfs_distances.begin(), rows() * c, -1);
+      i32 head = 0, tail = 0, remaining = reported - actors.first_ghost;
+      bfs_distances[start] = 0;
+      bfs_queue[tail++] = start;
+      for (i32 ghost = actors.first_ghost; ghost < reported; ++ghost)
+        remaining -= actors.locations[ghost] == pacman;
+      while (head < tail and remaining > 0) {
+        const i32 index = bfs_queue[head++];
+        const u16 bits = neighbours[index];
+        for (i32 d = 0; d < 4; ++d) {
+          if (not (((bits >> (free_shift + d)) | (bits >> (gate_shift + d))) & 1))
+            continue;
+          MovementDirection direction = static_cast<MovementDirection>(d);
+          const i32 next = index + movement_direction_delta_x(direction) * c + movement_direction_delta_y(direction);
+          if (bfs_distances[next] >= 0)
+            continue;
+          bfs_distances[next] = bfs_distances[index] + 1;
+          bfs_queue[tail++] = next;
+          for (i32 ghost = actors.first_ghost; ghost < reported; ++ghost)
+            remaining -= get_index(actors.locations[ghost]) == next;
+        }
+      }
+      for (i32 i = 0; i < Actors::classic_ghosts; ++i) {
+        const i32 ghost = actors.first_ghost + i;
+        out[Features::ghost_distances + i] = ghost < reported ? bfs_distances[get_index(actors.locations[ghost])] : -1;
+      }
+
+      for (i32 d = 0; d < 4; ++d) {
+        MovementDirection direction = static_cast<MovementDirection>(d);
+        bool safe = is_valid_pacman_move(pacman, direction);
+        const i32 x = pacman.x + movement_direction_delta_x(direction), y = pacman.y + movement_direction_delta_y(direction);
+        for (i32 ghost = actors.first_ghost; safe and ghost < actors.count; ++ghost) {
+          const GhostMode ghost_mode = actors.modes[ghost];
+          if (ghost_mode == GhostMode::chase or ghost_mode == GhostMode::scatter)
+            safe = manhattan_distance(x, y, actors.locations[ghost].x, actors.locations[ghost].y) > 1;
+        }
+        out[Features::safe_directions + d] = safe;
+      }
+    }
+
+    const Config& get_config() const override {
+      return config;
+    }
+
     void render() override {
+      TRACE_SCOPE("render", "env");
+
       if (mode == RenderMode::ascii)
         ascii_renderer.render(state);
-      else if (mode == RenderMode::human)
-        graphics_renderer.render(state);
+      else if (mode == RenderMode::ansi or mode == RenderMode::ansi_color)
+        ansi_renderer.render(state);
+      else if (mode == RenderMode::human) {
+        std::array<Location, Actors::capacity> locations;
+        std::array<EntityType, Actors::capacity> types;
+        graphics_renderer.render(state, get_render_layers(locations, types), config.render_fps);
+      }
       else if (mode == RenderMode::none)
         ;
       else
-        throw std::runtime_error("Render mode must be one of ascii, human or none.");
+        throw std::runtime_error("Render mode must be one of ascii, ansi, ansi_color, human or none.");
     }
 
     void close() const override {
       if (mode == RenderMode::ascii)
         ascii_renderer.close();
+      else if (mode == RenderMode::ansi or mode == RenderMode::ansi_color)
+        ansi_renderer.close();
       else if (mode == RenderMode::human)
         graphics_renderer.close();
       else if (mode == RenderMode::none)
         ;
       else
-        throw std::runtime_error("Render mode must be one of ascii, human or none.");
+        throw std::runtime_error("Render mode must be one of ascii, ansi, ansi_color, human or none.");
     }
 
-    RenderMode get_render_mode() const {
+    RenderMode get_render_mode() const override {
       return mode;
     }
+
+    // Layers of the current frame for the renderers, with the actors copied into `locations` and
+    // `types` in drawing order. Ghosts come first, so that the Pacmen are drawn on top of them
+    RenderLayers get_render_layers(std::array<Location, Actors::capacity> &locations, std::array<EntityType, Actors::capacity> &types) const {
+      for (i32 i = 0; i < actors.count; ++i) {
+        i32 actor = (actors.first_ghost + i) % actors.count;
+        locations[i] = actors.locations[actor];
+        types[i] = actors.types[actor];
+      }
+
+      return RenderLayers{
+        .rows = rows(),
+        .cols = cols(),
+        .layout_version = layout_version,
+        .tiles = grid.tiles.data(),
+        .pellet_mask = pellet_mask.data(),
+        .actor_locations = locations.data(),
+        .actor_types = types.data(),
+        .actor_count = actors.count,
+      };
+    }
+
+    // One bit per cell (row-major) that is set while the cell still holds a pellet or power pellet
+    const CellArray<u64, pellet_mask_words>& get_pellet_mask() const {
+      return pellet_mask;
+    }
+
+    // Keeps records of the last `capacity` steps so that they can be undone. Zero disables it
+    void set_journal_capacity(i32 capacity) {
+      journal.set_capacity(capacity);
+    }
+
+    i32 get_journal_capacity() const {
+      return journal.get_capacity();
+    }
+
+    // Number of steps that can currently be undone
+    i32 get_journal_size() const {
+      return journal.get_size();
+    }
+
+    // Reverts the last step, including a death and the respawn that came with it, ghosts eaten
+    // and freight mode started by a power pellet. Only the cells of actors and of the restored
+    // pellet are redrawn, so this does not depend on the map size. Distance features are rebuilt
+    // on the next get_features() after a pellet comes back.
+    void undo() {
+      TRACE_SCOPE("undo", "env");
+      const StepRecord &record = journal.pop();
+
+      std::array<Location, Actors::capacity> previous_locations;
+      std::copy_n(actors.locations.begin(), actors.count, previous_locations.begin());
+      for (i32 actor = 0; actor < actors.count; ++actor) {
+        const ActorRecord &saved = record.actors[actor];
+        actors.locations[actor] = saved.location;
+        actors.directions[actor] = saved.direction;
+        actors.modes[actor] = saved.mode;
+        actors.step_indices[actor] = saved.step_index;
+        actors.house_state_updated[actor] = saved.house_state_updated;
+      }
+      state.step_index = record.step_index;
+      state.score = record.score;
+      state.lives = record.lives;
+      state.pellets_eaten = record.pellets_eaten;
+      state.completed = record.completed;
+      state.reward = record.reward;
+      zobrist_hash = record.hash;
+      std::copy_n(record.scores.begin(), actors.pacmen(), state.scores.begin());
+      std::copy_n(record.rewards.begin(), actors.pacmen(), state.rewards.begin());
+      pellet_distances = record.pellet_distances;
+      ghost_distances = record.ghost_distances;
+
+      for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman) {
+        const i32 index = record.pellet_indices[pacman];
+        if (index < 0)
+          continue;
+        const Location location = {index / cols(), index % cols()};
+        grid.set(location, record.pellet_types[pacman]);
+        background[index] = entity_type_to_char(record.pellet_types[pacman]);
+        pellet_mask[index >> 6] |= u64(1) << (index & 63);
+        features_valid = false;
+        redraw_cell(location);
+      }
+
+      for (i32 actor = 0; actor < actors.count; ++actor) {
+        redraw_cell(previous_locations[actor]);
+        redraw_cell(actors.locations[actor]);
+      }
+      update_state_actors();
+    }
+
+    const Actors& get_actors() const {
+      return actors;
+    }
+
+    // Zobrist hash recomputed from scratch, for checking the incrementally maintained State::hash
+    u64 compute_hash() const {
+      u64 hash = zobrist_key(ZobristFeature::lives, 0, state.lives) ^ zobrist_actors_hash(actors);
+      for (i32 index = 0; index < rows() * cols(); ++index)
+        if ((pellet_mask[index >> 6] >> (index & 63)) & 1)
+          hash ^= zobrist_pellet_key(grid.tiles[index], index);
+      return hash;
+    }
+
+    i32 get_pellets_remaining() const {
+      i32 count = 0;
+      for (u64 word: pellet_mask)
+        count += __builtin_popcountll(word);
+      return count;
+    }
   
   private:
-    Step perform_pacman_step(const MovementDirection &direction) {
-      i32 nx = pacman->location.x + movement_direction_delta_x(direction);
-      i32 ny = pacman->location.y + movement_direction_delta_y(direction);
+    // Static tiles are one-hot encoded one plane at a time with a compare per cell over every
+    // row segment inside the map, which the compiler vectorizes. Actors are set afterwards
+    void write_window_observation(const Location &center, i32 radius, u8 *out) const {
+      const i32 side = window_side(radius);
+      const i32 plane = side * side;
+      const i32 r = rows(), c = cols();
+      const i32 top = center.x - radius, left = center.y - radius;
+
+      std::fill_n(out, observation_size(r, c, radius), 0);
+
+      // Columns of the window that are inside the map, the same for every row
+      const i32 y_begin = std::max(0, -left), y_end = std::min(side, c - left);
+      constexpr EntityType static_types[] = {EntityType::wall, EntityType::gate, EntityType::pellet, EntityType::power_pellet};
+
+      u8 *walls = out + observation_channel(EntityType::wall) * plane;
+      for (i32 wx = 0; wx < side; ++wx) {
+        const i32 x = top + wx;
+        u8 *wall_row = walls + wx * side;
+        if (x < 0 or x >= r or y_begin >= y_end) {
+          std::fill_n(wall_row, side, 1);
+          continue;
+        }
 
-      if (is_valid_pacman_move({nx, ny}))
+        std::fill_n(wall_row, y_begin, 1);
+        std::fill(wall_row + y_end, wall_row + side, 1);
+
+        const EntityType *tiles = grid.tiles.data() + x * c + left + y_begin;
+        const i32 count = y_end - y_begin;
+        for (EntityType type: static_types) {
+          u8 *row = out + observation_channel(type) * plane + wx * side + y_begin;
+          for (i32 k = 0; k < count; ++k)
+            row[k] = tiles[k] == type;
+        }
+      }
+
+      for (i32 actor = 0; actor < actors.count; ++actor) {
+        const i32 wx = actors.locations[actor].x - top, wy = actors.locations[actor].y - left;
+        if (wx >= 0 and wx < side and wy >= 0 and wy < side)
+          out[observation_channel(actors.types[actor]) * plane + wx * side + wy] = 1;
+      }
+    }
+
+    Step perform_pacman_step(i32 pacman, const MovementDirection &direction) {
+      const Location &location = actors.locations[pacman];
+      i32 nx = location.x + movement_direction_delta_x(direction);
+      i32 ny = location.y + movement_direction_delta_y(direction);
+
+      if (is_valid_pacman_move(location, direction))
         return {Location{nx, ny}, direction};
       
-      return {Location{pacman->location.x, pacman->location.y}, pacman->direction};
+      return {location, actors.directions[pacman]};
     }
 
-    Step perform_ghost_step(Ghost *ghost, Location target) {
-      if (ghost->config.mode == GhostMode::house)
-        return {ghost->location, MovementDirection::none};
-      
+    void add_score(i32 pacman, i32 points) {
+      state.score += points;
+      state.scores[pacman] += points;
+    }
+
+    // Moves of all ghosts towards the targets in `lanes`. A ghost takes the allowed direction
+    // whose next cell is closest to its target (furthest in freight mode), the first one in
+    // precedence order on ties, and only turns around when it has no other way to go.
+    //
+    // Cells and neighbour bits are gathered per ghost first. Then every direction is scored for
+    // all ghosts at once, with selects instead of branches so that the compiler vectorizes the
+    // loop over ghosts, and the rare dead ends and the ghosts that stay put are patched after.
+    void perform_ghost_steps(GhostLanes &lanes) {
+      const i32 end = actors.count;
+      const Location &house_exit = config.blinky_config.initial_location;
+
       // TODO: Blinky's initial position is used as the target when a ghost moves out of the
       // house. This is not the correct behaviour since Blinky could start from any position
       // on an arbitrary map. Ideally, some position next to the gate should be used as target.
-      if (ghost->house_state_updated) {
-        if (ghost->location.x == blinky->config.initial_location.x and ghost->location.y == blinky->config.initial_location.y)
-          ghost->house_state_updated = false;
-        target = blinky->config.initial_location;
+      for (i32 ghost = actors.first_ghost; ghost < end; ++ghost) {
+        const Location location = actors.locations[ghost];
+        const GhostMode mode = actors.modes[ghost];
+        const i32 leaving = -(actors.house_state_updated[ghost] & (mode != GhostMode::house));
+        actors.house_state_updated[ghost] = actors.house_state_updated[ghost] & not (leaving & (location == house_exit));
+
+        lanes.x[ghost] = location.x;
+        lanes.y[ghost] = location.y;
+        lanes.target_x[ghost] = select_mask(leaving, house_exit.x, lanes.target_x[ghost]);
+        lanes.target_y[ghost] = select_mask(leaving, house_exit.y, lanes.target_y[ghost]);
+        lanes.direction[ghost] = (i32)actors.directions[ghost];
+        lanes.bits[ghost] = neighbours[get_index(location)];
+        lanes.gate[ghost] = actors.house_state_updated[ghost];
+        lanes.sign[ghost] = mode == GhostMode::freight ? -1 : +1;
+        lanes.best[ghost] = i32_inf;
+        lanes.moved[ghost] = 0;
+        lanes.next_x[ghost] = location.x;
+        lanes.next_y[ghost] = location.y;
+        lanes.next_direction[ghost] = lanes.direction[ghost];
       }
 
-      if (ghost->config.mode == GhostMode::freight) {
-        // TODO: Here, it is hardcoded that if the ghost is in freight mode, updates
-        // will happen every 2 steps. Think of the correct way of handling this.
-        if (ghost->config.step_index % 2 == 0)
-          return {ghost->location, ghost->direction};
+      for (const MovementDirection &direction: movement_direction_precedence) {
+        const i32 d = (i32)direction, reverse = (i32)opposite_direction(direction);
+        const i32 dx = movement_direction_delta_x(direction), dy = movement_direction_delta_y(direction);
+        for (i32 ghost = actors.first_ghost; ghost < end; ++ghost) {
+          const i32 bits = lanes.bits[ghost];
+          const i32 valid = ((bits >> (free_shift + d)) | (lanes.gate[ghost] & (bits >> (gate_shift + d)))) & 1;
+          const i32 allowed = valid & (lanes.direction[ghost] != reverse);
+          const i32 nx = lanes.x[ghost] + dx, ny = lanes.y[ghost] + dy;
+          const i32 score = lanes.sign[ghost] * (std::abs(nx - lanes.target_x[ghost]) + std::abs(ny - lanes.target_y[ghost]));
+          const i32 better = -(allowed & (score < lanes.best[ghost]));
+          lanes.best[ghost] = select_mask(better, score, lanes.best[ghost]);
+          lanes.next_x[ghost] = select_mask(better, nx, lanes.next_x[ghost]);
+          lanes.next_y[ghost] = select_mask(better, ny, lanes.next_y[ghost]);
+          lanes.next_direction[ghost] = select_mask(better, d, lanes.next_direction[ghost]);
+          lanes.moved[ghost] |= allowed;
+        }
       }
-      
-      i32 best_x = ghost->location.x, best_y = ghost->location.y;
-      i32 best_distance = ghost->config.mode != GhostMode::freight ? i32_inf : -i32_inf;
-      MovementDirection best_direction = ghost->direction;
-      bool has_valid_move = false;
-      auto best_criterion = [&] (i32 x, i32 y) {
-        if (ghost->config.mode != GhostMode::freight)
-          return x < y;
-        return x > y;
-      };
 
-      for (const MovementDirection &direction: movement_direction_precedence) {
-      // for (const MovementDirection &direction: legal_ghost_movement_direction[ghost->direction]) {
-        if (direction == opposite_direction(ghost->direction))
+      // Dead ends: turn around if possible, else stay
+      for (i32 ghost = actors.first_ghost; ghost < end; ++ghost) {
+        if (lanes.moved[ghost])
           continue;
-        
-        i32 nx = ghost->location.x + movement_direction_delta_x(direction);
-        i32 ny = ghost->location.y + movement_direction_delta_y(direction);
-
-        if (is_valid_ghost_move(ghost, {nx, ny})) {
-          has_valid_move = true;
-          i32 distance = manhattan_distance(nx, ny, target.x, target.y);
-          if (best_criterion(distance, best_distance)) {
-            best_distance = distance;
-            best_x = nx;
-            best_y = ny;
-            best_direction = direction;
-          }
+        MovementDirection direction = opposite_direction(actors.directions[ghost]);
+        if (is_valid_ghost_move(ghost, direction)) {
+          lanes.next_x[ghost] = lanes.x[ghost] + movement_direction_delta_x(direction);
+          lanes.next_y[ghost] = lanes.y[ghost] + movement_direction_delta_y(direction);
+          lanes.next_direction[ghost] = (i32)direction;
         }
       }
 
-      if (not has_valid_move) {
-        MovementDirection direction = opposite_direction(ghost->direction);
-        i32 nx = ghost->location.x + movement_direction_delta_x(direction);
-        i32 ny = ghost->location.y + movement_direction_delta_y(direction);
-
-        if (is_valid_ghost_move(ghost, {nx, ny})) {
-          i32 distance = manhattan_distance(nx, ny, target.x, target.y);
-          if (best_criterion(distance, best_distance)) {
-            best_x = nx;
-            best_y = ny;
-            best_direction = direction;
-          }
-        }
+      // Ghosts in the house stay put, and those in freight mode only move every other step
+      // TODO: Here, it is hardcoded that if the ghost is in freight mode, updates
+      // will happen every 2 steps. Think of the correct way of handling this.
+      for (i32 ghost = actors.first_ghost; ghost < end; ++ghost) {
+        const i32 mode = (i32)actors.modes[ghost];
+        const i32 house = -(mode == (i32)GhostMode::house);
+        const i32 stay = house | -((mode == (i32)GhostMode::freight) & ~actors.step_indices[ghost]);
+        lanes.next_x[ghost] = select_mask(stay, lanes.x[ghost], lanes.next_x[ghost]);
+        lanes.next_y[ghost] = select_mask(stay, lanes.y[ghost], lanes.next_y[ghost]);
+        lanes.next_direction[ghost] = select_mask(house, (i32)MovementDirection::none, select_mask(stay, lanes.direction[ghost], lanes.next_direction[ghost]));
       }
+    }
 
-      return {Location{best_x, best_y}, best_direction};
+    // Saves everything the coming step may change into a new journal record
+    StepRecord& record_step() {
+      StepRecord &record = journal.push();
+      for (i32 actor = 0; actor < actors.count; ++actor)
+        record.actors[actor] = ActorRecord{
+          actors.locations[actor], actors.directions[actor], actors.modes[actor], actors.step_indices[actor], actors.house_state_updated[actor]
+        };
+      record.step_index = state.step_index;
+      record.score = state.score;
+      record.lives = state.lives;
+      record.pellets_eaten = state.pellets_eaten;
+      record.completed = state.completed;
+      record.reward = state.reward;
+      record.hash = zobrist_hash;
+      const i32 pacmen = actors.pacmen();
+      std::copy_n(state.scores.begin(), pacmen, record.scores.begin());
+      std::copy_n(state.rewards.begin(), pacmen, record.rewards.begin());
+      record.pellet_distances = pellet_distances;
+      record.ghost_distances = ghost_distances;
+      std::fill_n(record.pellet_indices.begin(), pacmen, -1);
+      return record;
     }
 
     void handle_pacman_death() {
+      zobrist_hash ^= zobrist_key(ZobristFeature::lives, 0, state.lives);
       state.lives -= 1;
+      zobrist_hash ^= zobrist_key(ZobristFeature::lives, 0, state.lives);
       
       if (state.lives <= 0)
         state.completed = true;
       
-      unset_grid(pacman.get());
-      unset_grid(blinky.get());
-      unset_grid(pinky.get());
-      unset_grid(inky.get());
-      unset_grid(clyde.get());
-      
-      grid_storage.erase(std::find_if(grid_storage.begin(), grid_storage.end(), [&] (auto &x) { return x.second == pacman.get(); }));
-      grid_storage.erase(std::find_if(grid_storage.begin(), grid_storage.end(), [&] (auto &x) { return x.second == blinky.get(); }));
-      grid_storage.erase(std::find_if(grid_storage.begin(), grid_storage.end(), [&] (auto &x) { return x.second == pinky.get(); }));
-      grid_storage.erase(std::find_if(grid_storage.begin(), grid_storage.end(), [&] (auto &x) { return x.second == inky.get(); }));
-      grid_storage.erase(std::find_if(grid_storage.begin(), grid_storage.end(), [&] (auto &x) { return x.second == clyde.get(); }));
-
-      bool is_blinky_in_house = blinky->config.mode == GhostMode::house;
-      bool is_pinky_in_house = pinky->config.mode == GhostMode::house;
-      bool is_inky_in_house = inky->config.mode == GhostMode::house;
-      bool is_clyde_in_house = clyde->config.mode == GhostMode::house;
-      i32 blinky_step_index = blinky->config.step_index;
-      i32 pinky_step_index = pinky->config.step_index;
-      i32 inky_step_index = inky->config.step_index;
-      i32 clyde_step_index = clyde->config.step_index;
-
-      pacman = std::make_unique<Pacman>(initial_pacman_location, default_movement_direction(EntityType::pacman));
-      blinky = std::make_unique<Blinky>(config.blinky_config);
-      pinky  = std::make_unique<Pinky>(config.pinky_config, config.pinky_target_offset);
-      inky   = std::make_unique<Inky>(config.inky_config);
-      clyde  = std::make_unique<Clyde>(config.clyde_config, config.clyde_target_switch_distance);
-
-      if (not is_blinky_in_house)
-        blinky->config.step_index = blinky->config.house_steps;
-      else
-        blinky->config.step_index = blinky_step_index;
-      if (not is_pinky_in_house)
-        pinky->config.step_index = pinky->config.house_steps;
-      else
-        pinky->config.step_index = pinky_step_index;
-      if (not is_inky_in_house)
-        inky->config.step_index = inky->config.house_steps;
-      else
-        inky->config.step_index = inky_step_index;
-      if (not is_clyde_in_house)
-        clyde->config.step_index = clyde->config.house_steps;
+      // Ghosts that already left the house come back out immediately, the others keep waiting
+      std::array<i32, Actors::capacity> step_indices;
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        step_indices[ghost] = actors.modes[ghost] == GhostMode::house ? actors.step_indices[ghost] : ghost_config(ghost).house_steps;
+
+      reset_actors();
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        actors.step_indices[ghost] = step_indices[ghost];
+    }
+
+    void reset_actors() {
+      for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman) {
+        actors.set(pacman, initial_pacman_locations[pacman], default_movement_direction(EntityType::pacman));
+        actors.modes[pacman] = GhostMode::chase;
+        actors.step_indices[pacman] = 0;
+        actors.house_state_updated[pacman] = false;
+      }
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        actors.reset_ghost(ghost, ghost_config(ghost));
+    }
+
+    const GhostConfig& ghost_config(i32 ghost) const {
+      return ghost_configs[ghost];
+    }
+
+    // Topmost ghost at the given cell, or -1. Later ghosts are drawn on top of earlier ones
+    i32 ghost_at(const Location &location) const {
+      for (i32 ghost = actors.count - 1; ghost >= actors.first_ghost; --ghost)
+        if (actors.locations[ghost] == location)
+          return ghost;
+      return -1;
+    }
+
+    i32 rows() const {
+      if constexpr (is_fixed)
+        return Rows;
       else
-        clyde->config.step_index = clyde_step_index;
+        return config.rows;
+    }
 
-      grid_storage.emplace_back(entity_type_render_precedence(pacman->type), pacman.get());
-      grid_storage.emplace_back(entity_type_render_precedence(blinky->type), blinky.get());
-      grid_storage.emplace_back(entity_type_render_precedence(pinky->type), pinky.get());
-      grid_storage.emplace_back(entity_type_render_precedence(inky->type), inky.get());
-      grid_storage.emplace_back(entity_type_render_precedence(clyde->type), clyde.get());
+    i32 cols() const {
+      if constexpr (is_fixed)
+        return Cols;
+      else
+        return config.cols;
+    }
 
-      std::sort(grid_storage.begin(), grid_storage.end());
+    i32 get_index(const Location &location) const {
+      return location.x * cols() + location.y;
     }
 
-    bool is_valid_pacman_move(const Location &location) {
-      Entity* entity = grid.get(location);
-      return (entity == nullptr or (entity->type != EntityType::wall and entity->type != EntityType::gate));
+    bool is_valid_pacman_move(const Location &location, MovementDirection direction) const {
+      return (neighbours[get_index(location)] >> (free_shift + (i32)direction)) & 1;
     }
 
-    bool is_valid_ghost_move(Ghost *ghost, const Location &location) {
-      Entity* entity = grid.get(location);
-      if (entity == nullptr)
+    bool is_valid_ghost_move(i32 ghost, MovementDirection direction) const {
+      u16 bits = neighbours[get_index(actors.locations[ghost])];
+      if ((bits >> (free_shift + (i32)direction)) & 1)
         return true;
-      if (entity->type == EntityType::gate)
-        return ghost->house_state_updated;
-      return entity->type != EntityType::wall;
+      return actors.house_state_updated[ghost] and ((bits >> (gate_shift + (i32)direction)) & 1);
+    }
+
+    void remove_pellet(const Location &location) {
+      i32 index = get_index(location);
+      const EntityType tile = grid.get(location);
+      zobrist_hash ^= zobrist_pellet_key(tile, index);
+      if (features_valid)
+        (tile == EntityType::pellet ? pellet_field : power_pellet_field).remove_source(index, neighbours.data());
+      grid.unset(location);
+      background[index] = ' ';
+      pellet_mask[index >> 6] &= ~(u64(1) << (index & 63));
+    }
+
+    // BFS from every pacman over the cells it can walk to. Unreachable pellets do not count, and
+    // without a reachable pellet the distance is zero. Ghosts further than the cap count as at the cap
+    void update_reward_distances() {
+      std::array<i32, Actors::capacity> dangerous;
+      i32 dangerous_count = 0;
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        if (actors.modes[ghost] == GhostMode::chase or actors.modes[ghost] == GhostMode::scatter)
+          dangerous[dangerous_count++] = get_index(actors.locations[ghost]);
+
+      for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman)
+        update_reward_distances(pacman, dangerous.data(), dangerous_count);
+    }
+
+    void update_reward_distances(i32 pacman, const i32 *dangerous, i32 dangerous_count) {
+      const i32 cap = config.reward.ghost_distance_cap;
+      const i32 c = cols();
+      const i32 start = get_index(actors.locations[pacman]);
+      i32 &pellet_distance = pellet_distances[pacman];
+      i32 &ghost_distance = ghost_distances[pacman];
+
+      pellet_distance = -1;
+      ghost_distance = -1;
+      std::fill_n(bfs_distances.begin(), rows() * c, -1);
+      i32 head = 0, tail = 0;
+      bfs_distances[start] = 0;
+      bfs_queue[tail++] = start;
+
+      while (head < tail and (pellet_distance < 0 or ghost_distance < 0)) {
+        const i32 index = bfs_queue[head++];
+        const i32 distance = bfs_distances[index];
+        if (pellet_distance < 0 and ((pellet_mask[index >> 6] >> (index & 63)) & 1))
+          pellet_distance = distance;
+        if (ghost_distance < 0) {
+          if (distance >= cap)
+            ghost_distance = cap;
+          else if (std::find(dangerous, dangerous + dangerous_count, index) != dangerous + dangerous_count)
+            ghost_distance = distance;
+        }
+
+        const u16 bits = neighbours[index];
+        for (i32 d = 0; d < 4; ++d) {
+          if (not ((bits >> (free_shift + d)) & 1))
+            continue;
+          MovementDirection direction = static_cast<MovementDirection>(d);
+          const i32 next = index + movement_direction_delta_x(direction) * c + movement_direction_delta_y(direction);
+          if (bfs_distances[next] < 0) {
+            bfs_distances[next] = distance + 1;
+            bfs_queue[tail++] = next;
+          }
+        }
+      }
+
+      if (pellet_distance < 0)
+        pellet_distance = 0;
+      if (ghost_distance < 0)
+        ghost_distance = cap;
+    }
+
+    // Walls and gates never change within an episode, so the neighbour table is built once per
+    // reset from the background
+    void initialize_neighbours() {
+      const i32 r = rows(), c = cols();
+      for (i32 x = 0; x < r; ++x)
+        for (i32 y = 0; y < c; ++y) {
+          u16 bits = 0;
+          for (i32 d = 0; d < 5; ++d) {
+            MovementDirection direction = static_cast<MovementDirection>(d);
+            i32 nx = x + movement_direction_delta_x(direction);
+            i32 ny = y + movement_direction_delta_y(direction);
+            if (nx < 0 or nx >= r or ny < 0 or ny >= c)
+              continue;
+            char tile = background[nx * c + ny];
+            if (tile == gate_char)
+              bits |= u16(1) << (gate_shift + d);
+            else if (tile != wall_char)
+              bits |= u16(1) << (free_shift + d);
+          }
+          neighbours[x * c + y] = bits;
+        }
     }
 
     void initialize_grid() {
+      std::fill(pellet_mask.begin(), pellet_mask.end(), 0);
+
       Location location;
-      for (i32 x = 0; x < config.rows; ++x) {
+      for (i32 x = 0; x < rows(); ++x) {
         location.x = x;
-        for (i32 y = 0; y < config.cols; ++y) {
+        for (i32 y = 0; y < cols(); ++y) {
           location.y = y;
-          char c = config.map[x][y];
-          EntityType type = char_to_entity_type(c);
-
-          switch(type) {
-            case EntityType::wall: {
-              entities.emplace_back(std::make_unique<Wall>(location));
-              Wall *wall = static_cast<Wall*>(entities.back().get());
-              set_grid(wall);
-              grid_storage.emplace_back(entity_type_render_precedence(wall->type), wall);
-            }
-            break;
-
-            case EntityType::gate: {
-              entities.emplace_back(std::make_unique<Gate>(location));
-              Gate *gate = static_cast<Gate*>(entities.back().get());
-              set_grid(gate);
-              grid_storage.emplace_back(entity_type_render_precedence(gate->type), gate);
-            }
-            break;
-
-            case EntityType::pellet: {
-              entities.emplace_back(std::make_unique<Item>(EntityType::pellet, location, config.pellet_points));
-              Item *item = static_cast<Item*>(entities.back().get());
-              set_grid(item);
-              grid_storage.emplace_back(entity_type_render_precedence(item->type), item);
-            }
-            break;
+          EntityType type = map.at(x, y);
+          i32 index = get_index(location);
+
+          background[index] = ' ';
+          if (type == EntityType::wall or type == EntityType::gate or type == EntityType::pellet or type == EntityType::power_pellet)
+            background[index] = entity_type_to_char(type);
+          if (type == EntityType::pellet or type == EntityType::power_pellet) {
+            pellet_mask[index >> 6] |= u64(1) << (index & 63);
+            zobrist_hash ^= zobrist_pellet_key(type, index);
+          }
 
-            case EntityType::power_pellet: {
-              entities.emplace_back(std::make_unique<Item>(EntityType::power_pellet, location, config.power_pellet_points));
-              Item *item = static_cast<Item*>(entities.back().get());
-              set_grid(item);
-              grid_storage.emplace_back(entity_type_render_precedence(item->type), item);
-            }
-            break;
+          switch (type) {
+            case EntityType::wall:
+            case EntityType::gate:
+            case EntityType::pellet:
+            case EntityType::power_pellet:
+              grid.set(location, type);
+              break;
 
             case EntityType::pacman:
-              initial_pacman_location = location;
-              pacman->set(location, default_movement_direction(pacman->type));
-              set_grid(pacman.get());
-              break;
-            
-            case EntityType::blinky:
-              set_grid(blinky.get());
-              break;
-            
-            case EntityType::pinky:
-              set_grid(pinky.get());
-              break;
-            
-            case EntityType::inky:
-              set_grid(inky.get());
-              break;
-            
-            case EntityType::clyde:
-              set_grid(clyde.get());
+              initial_pacman_locations[Actors::pacman] = location;
               break;
             
             default:
@@ -571,28 +1194,89 @@ class PacmanEnvironment: EnvironmentBase {
           }
         }
       }
+
+      initialize_neighbours();
+      place_pacmen();
     }
-    
-    void update_state() {
-      Location location;
-        
-      for (i32 x = 0; x < config.rows; ++x) {
-        location.x = x;
-        for (i32 y = 0; y < config.cols; ++y) {
-          location.y = y;
-          Entity* entity = grid.get(location);
-          if (entity == nullptr)
-            state.grid[x][y] = ' ';
-          else
-            state.grid[x][y] = entity_type_to_char(entity->type);
+
+    // Pacmen after the first start on the free cells closest to the Pacman of the map, in BFS
+    // order, so that they start apart from each other and as far from the ghosts as the map allows
+    void place_pacmen() {
+      const i32 c = cols();
+      const i32 start = get_index(initial_pacman_locations[Actors::pacman]);
+      std::fill_n(bfs_distances.begin(), rows() * c, -1);
+      i32 head = 0, tail = 0;
+      bfs_distances[start] = 0;
+      bfs_queue[tail++] = start;
+
+      for (i32 pacman = 1; pacman < actors.pacmen(); ++pacman) {
+        while (head < tail and tail <= pacman) {
+          const i32 index = bfs_queue[head++];
+          const u16 bits = neighbours[index];
+          for (i32 d = 0; d < 4; ++d) {
+            if (not ((bits >> (free_shift + d)) & 1))
+              continue;
+            MovementDirection direction = static_cast<MovementDirection>(d);
+            const i32 next = index + movement_direction_delta_x(direction) * c + movement_direction_delta_y(direction);
+            if (bfs_distances[next] < 0) {
+              bfs_distances[next] = bfs_distances[index] + 1;
+              bfs_queue[tail++] = next;
+            }
+          }
         }
+        if (tail <= pacman)
+          throw std::runtime_error("The map has no room for " + std::to_string(actors.pacmen()) + " Pacmen.");
+        initial_pacman_locations[pacman] = Location{bfs_queue[pacman] / c, bfs_queue[pacman] % c};
       }
+    }
+    
+    // The grid is the background with actors drawn on top in render precedence order. Walls and
+    // gates take precedence over everything, so ghosts standing on the gate are not drawn
+    void update_state() {
+      TRACE_SCOPE("step.update_state", "env");
+
+      const i32 r = rows(), c = cols();
+      for (i32 x = 0; x < r; ++x)
+        std::copy_n(background.data() + x * c, c, state.grid[x].data());
 
-      state.pacman_location = pacman->location;
-      state.blinky_location = blinky->location;
-      state.pinky_location  = pinky->location;
-      state.inky_location   = inky->location;
-      state.clyde_location  = clyde->location;
+      auto draw = [&] (i32 actor) {
+        const Location &location = actors.locations[actor];
+        char &cell = state.grid[location.x][location.y];
+        if (cell != wall_char and cell != gate_char)
+          cell = entity_type_to_char(actors.types[actor]);
+      };
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        draw(ghost);
+      for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman)
+        draw(pacman);
+
+      update_state_actors();
+    }
+
+    // Same drawing as update_state() for a single cell
+    void redraw_cell(const Location &location) {
+      char &cell = state.grid[location.x][location.y];
+      cell = background[get_index(location)];
+      if (cell == wall_char or cell == gate_char)
+        return;
+      for (i32 ghost = actors.first_ghost; ghost < actors.count; ++ghost)
+        if (actors.locations[ghost] == location)
+          cell = entity_type_to_char(actors.types[ghost]);
+      for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman)
+        if (actors.locations[pacman] == location)
+          cell = entity_type_to_char(EntityType::pacman);
+    }
+
+    void update_state_actors() {
+      auto location = [&] (i32 ghost) { return ghost < actors.ghosts() ? actors.locations[actors.first_ghost + ghost] : Location{}; };
+      state.pacman_location = actors.locations[Actors::pacman];
+      state.blinky_location = location(0);
+      state.pinky_location  = location(1);
+      state.inky_location   = location(2);
+      state.clyde_location  = location(3);
+      state.pacman_locations.assign(actors.locations.begin(), actors.locations.begin() + actors.first_ghost);
+      state.ghost_locations.assign(actors.locations.begin() + actors.first_ghost, actors.locations.begin() + actors.count);
+      state.hash = zobrist_hash;
     }
 
     void sync_ghost_config() {
@@ -602,12 +1286,11 @@ class PacmanEnvironment: EnvironmentBase {
       config.clyde_config.corner  = Location{config.rows + 1, +1};
 
       Location location;
-      for (i32 x = 0; x < config.rows; ++x) {
+      for (i32 x = 0; x < rows(); ++x) {
         location.x = x;
-        for (i32 y = 0; y < config.cols; ++y) {
+        for (i32 y = 0; y < cols(); ++y) {
           location.y = y;
-          char c = config.map[x][y];
-          EntityType type = char_to_entity_type(c);
+          EntityType type = map.at(x, y);
 
           switch(type) {
             case EntityType::blinky:
@@ -631,19 +1314,76 @@ class PacmanEnvironment: EnvironmentBase {
           }
         }
       }
+
+      if (config.pacman_count < 1 or config.pacman_count > Actors::max_pacmen)
+        throw std::runtime_error("Number of Pacmen must be in [1, " + std::to_string(Actors::max_pacmen) + "].");
+      if (config.ghost_count < 0 or config.ghost_count > Actors::max_ghosts)
+        throw std::runtime_error("Number of ghosts must be in [0, " + std::to_string(Actors::max_ghosts) + "].");
+      if (not config.ghost_behaviors.empty() and (i32)config.ghost_behaviors.size() != config.ghost_count)
+        throw std::runtime_error("Ghost behaviors must be empty or have one entry per ghost.");
+
+      const std::array<const GhostConfig*, Actors::classic_ghosts> classic = {
+        &config.blinky_config, &config.pinky_config, &config.inky_config, &config.clyde_config
+      };
+      actors.first_ghost = config.pacman_count;
+      actors.count = actors.first_ghost + config.ghost_count;
+      std::fill_n(actors.types.begin(), actors.first_ghost, EntityType::pacman);
+      for (i32 i = 0; i < config.ghost_count; ++i) {
+        const i32 ghost = actors.first_ghost + i;
+        const EntityType type = config.ghost_behaviors.empty() ? Actors::ghost_types[i % Actors::classic_ghosts] : config.ghost_behaviors[i];
+        if ((u8)type >= Actors::classic_ghosts)
+          throw std::runtime_error("Ghost behaviors must be one of blinky, pinky, inky or clyde.");
+        actors.types[ghost] = type;
+
+        // Ghosts after the fourth wait in the house on the cells of Pinky, Inky and Clyde in turn
+        GhostConfig &configured = ghost_configs[ghost];
+        if (i < Actors::classic_ghosts)
+          configured = *classic[i];
+        else {
+          configured = *classic[1 + (i - Actors::classic_ghosts) % 3];
+          configured.house_steps = config.clyde_config.house_steps + (i - Actors::classic_ghosts + 1) * config.ghost_release_interval;
+        }
+        configured.corner = classic[(u8)type]->corner;
+        ghost_anchors.set(ghost, configured);
+      }
     }
 
-    void unset_grid(Entity *entity) {
-      grid.unset(entity->location);
+    // Points `map` at the current map of the bank, growing the cell buffers if it does not fit
+    void load_bank_map() {
+      MapView view = map_bank->get(map_id);
+      if (is_fixed and (view.rows != Rows or view.cols != Cols))
+        throw std::runtime_error("Map " + std::to_string(map_id) + " does not match the compile-time size of the environment.");
+      if constexpr (not is_fixed)
+        if ((u64)view.rows * view.cols > background.size())
+          reserve_buffers(view.rows, view.cols);
+      map = view;
+      config.rows = map.rows;
+      config.cols = map.cols;
     }
 
-    void set_grid(Entity *entity) {
-      grid.set(entity->location, entity);
+    void reserve_buffers(i32 max_rows, i32 max_cols) {
+      if constexpr (not is_fixed) {
+        background.resize(max_rows * max_cols);
+        pellet_mask.resize((max_rows * max_cols + 63) / 64);
+        neighbours.resize(max_rows * max_cols);
+        bfs_distances.resize(max_rows * max_cols);
+        bfs_queue.resize(max_rows * max_cols);
+      }
+      grid.reserve(max_rows, max_cols);
+      state.grid.reserve(max_rows);
+      for (auto &row: state.grid)
+        row.reserve(max_cols);
     }
 };
 
 
 
+using PacmanEnvironment = PacmanEnvironmentT<>;
+
+// Sizes of the classic maps, for which Python picks a compile-time specialized environment
+using PacmanEnvironment21x19 = PacmanEnvironmentT<21, 19>;
+using PacmanEnvironment31x28 = PacmanEnvironmentT<31, 28>;
+
 inline PacmanEnvironment make(const Config &config, RenderMode mode = RenderMode::none) {
   return PacmanEnvironment(config, mode);
 }
@@ -0,0 +1,199 @@
+#ifndef HEADER_EPISODE_STATISTICS_H
+#define HEADER_EPISODE_STATISTICS_H
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "pacman/state.hpp"
+
+// Metrics of one finished episode
+struct EpisodeRecord {
+  i32 score = 0;
+  i32 length = 0;
+  i32 lives_lost = 0;
+  i32 pellets_eaten = 0;
+};
+
+// Aggregate of one metric over the episodes in the window
+struct MetricSummary {
+  f64 mean = 0;
+  f64 min = 0;
+  f64 max = 0;
+  f64 p25 = 0;
+  f64 p50 = 0;
+  f64 p75 = 0;
+};
+
+struct EpisodeStatisticsSummary {
+  i64 episodes = 0;
+  i32 window_episodes = 0;
+  MetricSummary score;
+  MetricSummary length;
+  MetricSummary lives_lost;
+  MetricSummary pellets_eaten;
+};
+
+// Per-episode metrics of several environments, and a rolling window over the last `window`
+// finished episodes of all of them.
+//
+// update() only touches the entries of its own env, so envs can be updated from different threads.
+// Episodes finished by update() queue up per env until commit(), which must be called from a
+// single thread and adds them in env order, then in the order they finished, so the window does
+// not depend on scheduling. An env can finish any number of episodes between commits, e.g. in a
+// rollout.
+class EpisodeStatistics {
+  private:
+    i32 window;
+
+    // Episode in progress, initial lives and finished episodes waiting for commit(), per env
+    std::vector<EpisodeRecord> running;
+    std::vector<i32> initial_lives;
+    std::vector<std::vector<EpisodeRecord>> finished;
+
+    // Ring buffer of the last `window` episodes
+    std::vector<EpisodeRecord> records;
+    i64 episodes = 0;
+
+    mutable std::vector<f64> scratch;
+
+  public:
+    explicit EpisodeStatistics(i32 num_envs = 1, i32 window = 100):
+      window(window),
+      running(num_envs),
+      initial_lives(num_envs, 0),
+      finished(num_envs) {
+      if (num_envs < 1 or window < 1)
+        throw std::runtime_error("EpisodeStatistics requires at least one env and a window of at least one episode.");
+      records.reserve(window);
+    }
+
+    // Starts a new episode of `env` from its state right after reset
+    void begin(i32 env, const State &state) {
+      running[env] = EpisodeRecord{};
+      initial_lives[env] = state.lives;
+    }
+
+    // Accounts one step of `env` given the state right after it. When the episode completed, it
+    // is queued for commit(), and the caller must begin() the next one
+    void update(i32 env, i32 score_delta, const State &state) {
+      EpisodeRecord &record = running[env];
+      record.score += score_delta;
+      record.length += 1;
+      record.lives_lost = initial_lives[env] - state.lives;
+      record.pellets_eaten = state.pellets_eaten;
+      if (state.completed)
+        finished[env].push_back(record);
+    }
+
+    // Moves the episodes finished since the last call into the window
+    void commit() {
+      commit(0, (i32)finished.size());
+    }
+
+    // Same for the envs in [begin, end) only, while other envs may still be updated
+    void commit(i32 begin, i32 end) {
+      for (i32 env = begin; env < end; ++env) {
+        for (const EpisodeRecord &record: finished[env]) {
+          if ((i32)records.size() < window)
+            records.push_back(record);
+          else
+            records[episodes % window] = record;
+          episodes += 1;
+        }
+        finished[env].clear();
+      }
+    }
+
+    // Forgets the window and all episodes in progress
+    void clear() {
+      std::fill(running.begin(), running.end(), EpisodeRecord{});
+      for (auto &queue: finished)
+        queue.clear();
+      records.clear();
+      episodes = 0;
+    }
+
+    EpisodeStatisticsSummary summary() const {
+      EpisodeStatisticsSummary result;
+      result.episodes = episodes;
+      result.window_episodes = (i32)records.size();
+      result.score = summarize(&EpisodeRecord::score);
+      result.length = summarize(&EpisodeRecord::length);
+      result.lives_lost = summarize(&EpisodeRecord::lives_lost);
+      result.pellets_eaten = summarize(&EpisodeRecord::pellets_eaten);
+      return result;
+    }
+
+    // Percentile q in [0, 100] of a metric over the window, linearly interpolated. Zero when the
+    // window is empty
+    f64 percentile(i32 EpisodeRecord::*metric, f64 q) const {
+      if (q < 0 or q > 100)
+        throw std::runtime_error("Percentile must be in [0, 100], got " + std::to_string(q) + ".");
+      if (not sorted_values(metric))
+        return 0;
+      return interpolate(q);
+    }
+
+    // Episodes in the window, oldest first
+    std::vector<EpisodeRecord> get_records() const {
+      std::vector<EpisodeRecord> result;
+      result.reserve(records.size());
+      i64 first = (i32)records.size() < window ? 0 : episodes % window;
+      for (u64 i = 0; i < records.size(); ++i)
+        result.push_back(records[(first + i) % records.size()]);
+      return result;
+    }
+
+    const EpisodeRecord& get_running(i32 env) const {
+      return running[env];
+    }
+
+    i64 get_episodes() const {
+      return episodes;
+    }
+
+    i32 get_window() const {
+      return window;
+    }
+
+  private:
+    // Fills scratch with the sorted values of a metric, returns false if there are none
+    bool sorted_values(i32 EpisodeRecord::*metric) const {
+      scratch.clear();
+      for (const EpisodeRecord &record: records)
+        scratch.push_back(record.*metric);
+      std::sort(scratch.begin(), scratch.end());
+      return not scratch.empty();
+    }
+
+    f64 interpolate(f64 q) const {
+      f64 position = q / 100 * (scratch.size() - 1);
+      u64 below = (u64)std::floor(position);
+      u64 above = std::min(below + 1, (u64)scratch.size() - 1);
+      return scratch[below] + (position - below) * (scratch[above] - scratch[below]);
+    }
+
+    MetricSummary summarize(i32 EpisodeRecord::*metric) const {
+      MetricSummary result;
+      if (not sorted_values(metric))
+        return result;
+
+      f64 sum = 0;
+      for (f64 value: scratch)
+        sum += value;
+      result.mean = sum / scratch.size();
+      result.min = scratch.front();
+      result.max = scratch.back();
+      result.p25 = interpolate(25);
+      result.p50 = interpolate(50);
+      result.p75 = interpolate(75);
+      return result;
+    }
+};
+
+#endif // HEADER_EPISODE_STATISTICS_H
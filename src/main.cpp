@@ -38,6 +38,7 @@ Config config = {
     "###################",
   },
   .pacman_lives = 3,
+  .render_fps = 60,
 };
 
 int main() {
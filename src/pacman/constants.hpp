@@ -2,13 +2,15 @@
 #define PACMAN_CONSTANTS_H
 #pragma once
 
+#include <array>
 #include <ostream>
-#include <unordered_map>
+#include <stdexcept>
+#include <string>
 #include <utility>
 
 #include "types.hpp"
 
-enum class EntityType {
+enum class EntityType: u8 {
   blinky,
   pinky,
   inky,
@@ -41,110 +43,124 @@ enum class RenderMode {
   ascii,
   human,
   none,
+  ansi,
+  ansi_color,
 };
 
-inline char entity_type_to_char(EntityType entity_type) {
-  static const std::unordered_map<EntityType, char> entity_type_to_char = {
-    { EntityType::blinky,       '0' },
-    { EntityType::pinky,        '1' },
-    { EntityType::inky,         '2' },
-    { EntityType::clyde,        '3' },
-    { EntityType::pacman,       'P' },
-    { EntityType::wall,         '#' },
-    { EntityType::gate,         'G' },
-    { EntityType::pellet,       '.' },
-    { EntityType::power_pellet, '@' },
-    { EntityType::none,         ' ' },
-  };
-
-  return entity_type_to_char.at(entity_type);
+inline constexpr i32 entity_type_count = 10;
+inline constexpr i32 movement_direction_count = 5;
+
+// The mappings below are used per cell and per step, so they are dense tables indexed by the
+// enum value (or by the character) rather than hash maps: no static guard, no hashing and no
+// exceptions on the fast path.
+
+inline constexpr std::array<char, entity_type_count> entity_type_chars = {
+  '0', // blinky
+  '1', // pinky
+  '2', // inky
+  '3', // clyde
+  'P', // pacman
+  '#', // wall
+  'G', // gate
+  '.', // pellet
+  '@', // power_pellet
+  ' ', // none
+};
+
+// Entity type of every map character, or invalid_map_char for characters that are not part of
+// the map format. The flag bit lets map parsing OR the looked up values together and check them
+// once per map instead of once per character.
+inline constexpr u8 invalid_map_char = 0x80;
+
+inline constexpr std::array<u8, 256> map_char_entity_types = [] {
+  std::array<u8, 256> table = {};
+  table.fill(invalid_map_char);
+  for (i32 i = 0; i < entity_type_count; ++i)
+    table[(u8)entity_type_chars[i]] = (u8)i;
+  return table;
+}();
+
+inline constexpr std::array<i32, entity_type_count> entity_type_render_precedences = {
+  1, // blinky
+  1, // pinky
+  1, // inky
+  1, // clyde
+  2, // pacman
+  3, // wall
+  3, // gate
+  0, // pellet
+  0, // power_pellet
+  0, // none
+};
+
+inline constexpr std::array<i32, movement_direction_count> movement_direction_deltas_x = {
+  -1, // up
+   0, // left
+  +1, // down
+   0, // right
+   0, // none
+};
+
+inline constexpr std::array<i32, movement_direction_count> movement_direction_deltas_y = {
+   0, // up
+  -1, // left
+   0, // down
+  +1, // right
+   0, // none
+};
+
+inline constexpr char entity_type_to_char(EntityType entity_type) {
+  return entity_type_chars[(u8)entity_type];
 }
 
-inline EntityType char_to_entity_type(char c) {
-  static const std::unordered_map<char, EntityType> char_to_entity_type = {
-    { '0', EntityType::blinky },
-    { '1', EntityType::pinky },
-    { '2', EntityType::inky },
-    { '3', EntityType::clyde },
-    { 'P', EntityType::pacman },
-    { '#', EntityType::wall },
-    { 'G', EntityType::gate },
-    { '.', EntityType::pellet },
-    { '@', EntityType::power_pellet },
-    { ' ', EntityType::none },
-  };
-
-  return char_to_entity_type.at(c);
+inline constexpr bool is_valid_map_char(char c) {
+  return map_char_entity_types[(u8)c] != invalid_map_char;
 }
 
-inline i32 entity_type_render_precedence(EntityType entity_type) {
-  static const std::unordered_map<EntityType, i32> entity_type_render_precedence = {
-    { EntityType::blinky,       1 },
-    { EntityType::pinky,        1 },
-    { EntityType::inky,         1 },
-    { EntityType::clyde,        1 },
-    { EntityType::pacman,       2 },
-    { EntityType::wall,         3 },
-    { EntityType::gate,         3 },
-    { EntityType::pellet,       0 },
-    { EntityType::power_pellet, 0 },
-    { EntityType::none,         0 },
-  };
-
-  return entity_type_render_precedence.at(entity_type);
+// For characters that are known to be valid, e.g. after validate_map()
+inline constexpr EntityType char_to_entity_type_unchecked(char c) {
+  return static_cast<EntityType>(map_char_entity_types[(u8)c]);
 }
 
-inline i32 movement_direction_delta_x(MovementDirection direction) {
-  static const std::unordered_map<MovementDirection, i32> movement_direction_delta_x = {
-    { MovementDirection::up,    -1 },
-    { MovementDirection::left,   0 },
-    { MovementDirection::down,  +1 },
-    { MovementDirection::right,  0 },
-    { MovementDirection::none,   0 },
-  };
+inline constexpr EntityType char_to_entity_type(char c) {
+  if (not is_valid_map_char(c))
+    throw std::runtime_error(std::string("Unknown map character '") + c + "'.");
+  return char_to_entity_type_unchecked(c);
+}
 
-  return movement_direction_delta_x.at(direction);
+inline constexpr i32 entity_type_render_precedence(EntityType entity_type) {
+  return entity_type_render_precedences[(u8)entity_type];
 }
 
-inline i32 movement_direction_delta_y(MovementDirection direction) {
-  static const std::unordered_map<MovementDirection, i32> movement_direction_delta_y = {
-    { MovementDirection::up,     0 },
-    { MovementDirection::left,  -1 },
-    { MovementDirection::down,   0 },
-    { MovementDirection::right, +1 },
-    { MovementDirection::none,   0 },
-  };
+inline constexpr i32 movement_direction_delta_x(MovementDirection direction) {
+  return movement_direction_deltas_x[(i32)direction];
+}
 
-  return movement_direction_delta_y.at(direction);
+inline constexpr i32 movement_direction_delta_y(MovementDirection direction) {
+  return movement_direction_deltas_y[(i32)direction];
 }
 
-inline MovementDirection default_movement_direction(EntityType entity_type) {
-  static const std::unordered_map<EntityType, MovementDirection> default_movement_direction = {
-    { EntityType::blinky,       MovementDirection::left },
-    { EntityType::pinky,        MovementDirection::none },
-    { EntityType::inky,         MovementDirection::none },
-    { EntityType::clyde,        MovementDirection::none },
-    { EntityType::pacman,       MovementDirection::none },
-  };
-
-  auto it = default_movement_direction.find(entity_type);
-  if (it == default_movement_direction.end())
-    throw std::runtime_error("Invalid entity type");
-  return it->second;
+inline constexpr MovementDirection default_movement_direction(EntityType entity_type) {
+  switch (entity_type) {
+    case EntityType::blinky: return MovementDirection::left;
+    case EntityType::pinky:  return MovementDirection::none;
+    case EntityType::inky:   return MovementDirection::none;
+    case EntityType::clyde:  return MovementDirection::none;
+    case EntityType::pacman: return MovementDirection::none;
+    default:
+      throw std::runtime_error("Invalid entity type");
+  }
 }
 
-inline GhostMode default_ghost_mode(EntityType entity_type) {
-  static const std::unordered_map<EntityType, GhostMode> default_ghost_mode = {
-    { EntityType::blinky,       GhostMode::chase },
-    { EntityType::pinky,        GhostMode::house },
-    { EntityType::inky,         GhostMode::house },
-    { EntityType::clyde,        GhostMode::house },
-  };
-
-  auto it = default_ghost_mode.find(entity_type);
-  if (it == default_ghost_mode.end())
-    throw std::runtime_error("Invalid entity type");
-  return it->second;
+inline constexpr GhostMode default_ghost_mode(EntityType entity_type) {
+  switch (entity_type) {
+    case EntityType::blinky: return GhostMode::chase;
+    case EntityType::pinky:  return GhostMode::house;
+    case EntityType::inky:   return GhostMode::house;
+    case EntityType::clyde:  return GhostMode::house;
+    default:
+      throw std::runtime_error("Invalid entity type");
+  }
 }
 
 inline constexpr MovementDirection opposite_direction(MovementDirection direction) {
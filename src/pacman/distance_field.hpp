@@ -0,0 +1,144 @@
+#ifndef PACMAN_DISTANCE_FIELD_H
+#define PACMAN_DISTANCE_FIELD_H
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "pacman/constants.hpp"
+#include "types.hpp"
+
+// Maze distance from every cell to the nearest of a set of source cells (e.g. the remaining
+// pellets), over a neighbour table where bit d of a cell is set when the neighbour in direction d
+// is walkable. Cells that cannot reach any source have distance `unreachable`.
+//
+// Sources are only ever removed, as pellets are eaten, so the field is updated incrementally:
+// every cell remembers which source it is nearest to, and removing a source only recomputes the
+// cells that were nearest to it. Those form a connected region (the BFS parent of a cell has the
+// same source), which is refilled from its boundary.
+class DistanceField {
+  public:
+    static constexpr i32 unreachable = -1;
+
+  private:
+    i32 rows = 0;
+    i32 cols = 0;
+    std::vector<i32> distances;
+    std::vector<i32> sources;
+    std::vector<i32> queue;
+    std::vector<i32> seeds;
+    i32 source_count = 0;
+
+  public:
+    // Multi-source BFS from every cell for which is_source(index) holds
+    template <typename IsSource>
+    void build(i32 rows, i32 cols, const u16 *neighbours, IsSource &&is_source) {
+      this->rows = rows;
+      this->cols = cols;
+      const i32 cells = rows * cols;
+      distances.assign(cells, unreachable);
+      sources.assign(cells, -1);
+      queue.resize(cells);
+
+      i32 tail = 0;
+      source_count = 0;
+      for (i32 index = 0; index < cells; ++index)
+        if (is_source(index)) {
+          distances[index] = 0;
+          sources[index] = index;
+          queue[tail++] = index;
+          source_count += 1;
+        }
+      expand(neighbours, 0, tail);
+    }
+
+    void remove_source(i32 source, const u16 *neighbours) {
+      if (sources[source] != source)
+        return;
+      source_count -= 1;
+
+      // Collect and clear the region of the removed source
+      i32 tail = 0;
+      queue[tail++] = source;
+      sources[source] = -1;
+      distances[source] = unreachable;
+      for (i32 head = 0; head < tail; ++head)
+        for_each_neighbour(queue[head], neighbours, [&] (i32 next) {
+          if (sources[next] == source) {
+            sources[next] = -1;
+            distances[next] = unreachable;
+            queue[tail++] = next;
+          }
+        });
+
+      // Cells just outside the region, nearest first, restart the BFS into it
+      seeds.clear();
+      for (i32 i = 0; i < tail; ++i)
+        for_each_neighbour(queue[i], neighbours, [&] (i32 next) {
+          if (sources[next] >= 0)
+            seeds.push_back(next);
+        });
+      std::sort(seeds.begin(), seeds.end());
+      seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+      std::stable_sort(seeds.begin(), seeds.end(), [&] (i32 a, i32 b) { return distances[a] < distances[b]; });
+
+      refill(neighbours);
+    }
+
+    i32 distance(i32 index) const {
+      return distances[index];
+    }
+
+    i32 get_source_count() const {
+      return source_count;
+    }
+
+  private:
+    template <typename Function>
+    void for_each_neighbour(i32 index, const u16 *neighbours, Function &&fn) const {
+      const u16 bits = neighbours[index];
+      for (i32 d = 0; d < 4; ++d)
+        if ((bits >> d) & 1) {
+          MovementDirection direction = static_cast<MovementDirection>(d);
+          fn(index + movement_direction_delta_x(direction) * cols + movement_direction_delta_y(direction));
+        }
+    }
+
+    // Plain BFS over queue[head, tail)
+    void expand(const u16 *neighbours, i32 head, i32 tail) {
+      for (; head < tail; ++head) {
+        const i32 index = queue[head];
+        for_each_neighbour(index, neighbours, [&] (i32 next) {
+          if (distances[next] == unreachable) {
+            distances[next] = distances[index] + 1;
+            sources[next] = sources[index];
+            queue[tail++] = next;
+          }
+        });
+      }
+    }
+
+    // BFS from seeds with different distances: merges the sorted seeds with the FIFO queue, so
+    // cells are still settled in order of distance
+    void refill(const u16 *neighbours) {
+      i32 head = 0, tail = 0;
+      u64 next_seed = 0;
+      while (head < tail or next_seed < seeds.size()) {
+        i32 index;
+        if (next_seed < seeds.size() and (head == tail or distances[seeds[next_seed]] <= distances[queue[head]]))
+          index = seeds[next_seed++];
+        else
+          index = queue[head++];
+
+        for_each_neighbour(index, neighbours, [&] (i32 next) {
+          if (distances[next] == unreachable) {
+            distances[next] = distances[index] + 1;
+            sources[next] = sources[index];
+            queue[tail++] = next;
+          }
+        });
+      }
+    }
+};
+
+#endif // PACMAN_DISTANCE_FIELD_H
@@ -2,9 +2,11 @@
 #define PACMAN_ENTITY_H
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <ostream>
 #include <string>
-#include <cmath>
 
 #include "pacman/constants.hpp"
 #include "pacman/utils.hpp"
@@ -40,302 +42,185 @@ struct GhostConfig {
   GhostMode mode;
 };
 
-class Entity {
-  public:
-    EntityType type;
-    Location location;
-    MovementDirection direction;
-  
-  public:
-    Entity(EntityType type, Location location, MovementDirection direction):
-      type(type), location(location), direction(direction)
-    { }
-    
-    virtual ~Entity() = default;
-
-    void set(const Location &location) {
-      this->location = location;
-    }
-
-    void set(const MovementDirection &direction) {
-      this->direction = direction;
-    }
-
-    void set(const Location &location, const MovementDirection &direction) {
-      set(location);
-      set(direction);
-    }
-};
-
+// Up to max_pacmen Pacmen and max_ghosts ghosts, stored as a struct of arrays indexed by actor
+// id: the Pacmen first, from 0 to first_ghost, then the ghosts up to count. Static tiles (walls,
+// gates and pellets) are not actors and live in GridT as entity types instead.
+//
+// Arrays have a fixed capacity, so that actors are copied (e.g. into the undo journal) without
+// allocating, and only the first `count` entries are in use. The first four ghosts are Blinky,
+// Pinky, Inky and Clyde of the map, and every ghost is tagged with the ghost type whose chase
+// behaviour it follows, which is also the observation channel it is drawn into.
+//
+// The per-ghost parameters that never change during an episode (mode durations, corners and
+// initial placement) are read from the GhostConfig of each ghost; only the state that changes
+// while stepping is stored here.
+struct Actors {
+  static constexpr i32 pacman = 0;
+  static constexpr i32 classic_ghosts = 4;
+  static constexpr i32 max_pacmen = 8;
+  static constexpr i32 max_ghosts = 64;
+  static constexpr i32 capacity = max_pacmen + max_ghosts;
+
+  static constexpr std::array<EntityType, classic_ghosts> ghost_types = {
+    EntityType::blinky, EntityType::pinky, EntityType::inky, EntityType::clyde
+  };
+
+  i32 first_ghost = 1;
+  i32 count = 1 + classic_ghosts;
+  std::array<EntityType, capacity> types;
+
+  std::array<Location, capacity> locations;
+  std::array<MovementDirection, capacity> directions;
+  std::array<GhostMode, capacity> modes;
+  std::array<i32, capacity> step_indices;
+  std::array<bool, capacity> house_state_updated;
+
+  i32 pacmen() const {
+    return first_ghost;
+  }
 
+  i32 ghosts() const {
+    return count - first_ghost;
+  }
 
-class Ghost: public Entity {
-  public:
-    GhostConfig config;
-    bool house_state_updated = false;
+  void set(i32 actor, const Location &location, const MovementDirection &direction) {
+    locations[actor] = location;
+    directions[actor] = direction;
+  }
 
-  public:
-    Ghost(EntityType type, Location location, MovementDirection direction, GhostConfig config):
-      Entity(type, location, direction),
-      config(config)
-    { }
+  void reset_ghost(i32 ghost, const GhostConfig &config) {
+    locations[ghost] = config.initial_location;
+    directions[ghost] = config.initial_direction;
+    modes[ghost] = config.mode;
+    step_indices[ghost] = config.step_index;
+    house_state_updated[ghost] = false;
+  }
 
-    void step(const Location &location, const MovementDirection &direction) {
-      this->location = location;
-      this->direction = direction;
-      config.step_index += 1;
+  void step_ghost(i32 ghost, const GhostConfig &config, const Location &location, const MovementDirection &direction) {
+    locations[ghost] = location;
+    directions[ghost] = direction;
+    step_indices[ghost] += 1;
 
-      switch (config.mode) {
-        case GhostMode::chase: {
-          if (config.step_index >= config.chase_steps) {
-            config.step_index = 0;
-            set_mode(GhostMode::scatter);
-          }
-        }
-        break;
-        
-        case GhostMode::scatter: {
-          if (config.step_index >= config.scatter_steps) {
-            config.step_index = 0;
-            set_mode(GhostMode::chase);
-          }
-        }
-        break;
-        
-        case GhostMode::freight: {
-          if (config.step_index >= config.freight_steps) {
-            config.step_index = 0;
-            set_mode(GhostMode::chase);
-          }
-        }
-        break;
-        
-        case GhostMode::eaten:
-          break;
-        
-        case GhostMode::house: {
-          if (config.step_index >= config.house_steps) {
-            config.step_index = 0;
-            house_state_updated = true;
-            set_mode(GhostMode::chase);
-          }
+    switch (modes[ghost]) {
+      case GhostMode::chase: {
+        if (step_indices[ghost] >= config.chase_steps) {
+          step_indices[ghost] = 0;
+          set_mode(ghost, GhostMode::scatter);
         }
-        break;
-      }
-    }
-
-    void set_corner(const Location &corner) {
-      config.corner = corner;
-    }
-
-    void set_mode(const GhostMode &mode) {
-      if (config.mode == mode) {
-        if (config.mode == GhostMode::freight)
-          config.step_index = 0;
-        return;
       }
+      break;
       
-      // Ignore mode change if target is freight but the ghost is inside house
-      if (mode == GhostMode::freight and config.mode == GhostMode::house)
-        return;
-      
-      if (config.mode == GhostMode::chase or config.mode == GhostMode::scatter)
-        direction = opposite_direction(direction);
-      config.mode = mode;
-      config.step_index = 0;
-    }
-};
-
-class Pacman: public Entity {
-  public:
-    Pacman(Location location, MovementDirection direction):
-      Entity(EntityType::pacman, location, direction)
-    { }
-
-    ~Pacman() = default;
-};
-
-class Blinky: public Ghost {
-  public:
-    Blinky(GhostConfig config):
-      Ghost(EntityType::blinky, config.initial_location, config.initial_direction, config)
-    { }
-
-    Location get_target(Pacman* pacman) {
-      switch (config.mode) {
-        case GhostMode::chase: {
-          return Location{
-            .x = pacman->location.x,
-            .y = pacman->location.y
-          };
+      case GhostMode::scatter: {
+        if (step_indices[ghost] >= config.scatter_steps) {
+          step_indices[ghost] = 0;
+          set_mode(ghost, GhostMode::chase);
         }
-        
-        case GhostMode::scatter:
-          return config.corner;
-        
-        case GhostMode::freight: return config.corner;
-        case GhostMode::eaten: return config.corner;
-        
-        case GhostMode::house:
-          return config.initial_location;
-
-        default:
-          __builtin_unreachable();
       }
-    }
-};
-
-
-
-class Pinky: public Ghost {
-  public:
-    i32 target_offset;
-  
-  public:
-    Pinky(GhostConfig config, i32 target_offset):
-      Ghost(EntityType::pinky, config.initial_location, config.initial_direction, config),
-      target_offset(target_offset)
-    { }
-
-    Location get_target(Pacman* pacman) {
-      switch (config.mode) {
-        case GhostMode::chase: {
-          i32 parity_x = movement_direction_delta_x(pacman->direction) < 0 ? -1 : +1;
-          i32 parity_y = movement_direction_delta_y(pacman->direction) < 0 ? -1 : +1;
-          Location target = {
-            .x = pacman->location.x + target_offset * parity_x,
-            .y = pacman->location.y + target_offset * parity_y
-          };
-          return target;
+      break;
+      
+      case GhostMode::freight: {
+        if (step_indices[ghost] >= config.freight_steps) {
+          step_indices[ghost] = 0;
+          set_mode(ghost, GhostMode::chase);
         }
-
-        case GhostMode::scatter:
-          return config.corner;
-        
-        case GhostMode::freight: return config.corner;
-        case GhostMode::eaten: return config.corner;
-        
-        case GhostMode::house:
-          return config.initial_location;
-
-        default:
-          __builtin_unreachable();
       }
-    }
-};
-
-
-
-class Inky: public Ghost {
-  public:
-    Inky(GhostConfig config):
-      Ghost(EntityType::inky, config.initial_location, config.initial_direction, config)
-    { }
-
-    Location get_target(Pacman* pacman, Blinky* blinky) {
-      switch (config.mode) {
-        case GhostMode::chase: {
-          i32 blinky_distance_x = std::abs(pacman->location.x - blinky->location.x);
-          i32 blinky_distance_y = std::abs(pacman->location.y - blinky->location.y);
-          i32 parity_x = blinky->location.x < pacman->location.x ? +1 : -1;
-          i32 parity_y = blinky->location.y < pacman->location.y ? +1 : -1;
-          Location target = {
-            .x = pacman->location.x + blinky_distance_x * parity_x,
-            .y = pacman->location.y + blinky_distance_y * parity_y
-          };
-          return target;
+      break;
+      
+      case GhostMode::eaten:
+        break;
+      
+      case GhostMode::house: {
+        if (step_indices[ghost] >= config.house_steps) {
+          step_indices[ghost] = 0;
+          house_state_updated[ghost] = true;
+          set_mode(ghost, GhostMode::chase);
         }
-
-        case GhostMode::scatter:
-          return config.corner;
-        
-        case GhostMode::freight: return config.corner;
-        case GhostMode::eaten: return config.corner;
-
-        case GhostMode::house:
-          return config.initial_location;
-
-        default:
-          __builtin_unreachable();
       }
+      break;
     }
-};
-
-
-
-class Clyde: public Ghost {
-  public:
-    i32 target_switch_distance;
-  
-  public:
-    Clyde(GhostConfig config, i32 target_switch_distance):
-      Ghost(EntityType::clyde, config.initial_location, config.initial_direction, config),
-      target_switch_distance(target_switch_distance)
-    { };
-
-    Location get_target(Pacman* pacman) {
-      switch (config.mode) {
-        case GhostMode::chase: {
-          i32 distance = manhattan_distance(location.x, location.y, pacman->location.x, pacman->location.y);
-          Location target = {
-            .x = pacman->location.x,
-            .y = pacman->location.y
-          };
-          if (distance < target_switch_distance)
-            target = config.corner;
-          return target;
-        }
-
-        case GhostMode::scatter:
-          return config.corner;
-        
-        case GhostMode::freight: return config.corner;
-        case GhostMode::eaten: return config.corner;
+  }
 
-        case GhostMode::house:
-          return config.initial_location;
-        
-        default:
-          __builtin_unreachable();
-      }
+  void set_mode(i32 ghost, const GhostMode &mode) {
+    if (modes[ghost] == mode) {
+      if (mode == GhostMode::freight)
+        step_indices[ghost] = 0;
+      return;
     }
-};
-
-
-
-class Item: public Entity {
-  public:
-    i32 points;
-  
-  public:
-    Item(EntityType type, Location location, i32 points):
-      Entity(type, location, MovementDirection::none),
-      points(points)
-    { }
     
-    ~Item() = default;
+    // Ignore mode change if target is freight but the ghost is inside house
+    if (mode == GhostMode::freight and modes[ghost] == GhostMode::house)
+      return;
+    
+    if (modes[ghost] == GhostMode::chase or modes[ghost] == GhostMode::scatter)
+      directions[ghost] = opposite_direction(directions[ghost]);
+    modes[ghost] = mode;
+    step_indices[ghost] = 0;
+  }
 };
 
-
-
-class Wall: public Entity {
-  public:
-    Wall(Location location):
-      Entity(EntityType::wall, location, MovementDirection::none)
-    { }
-
-    ~Wall() = default;
+// Corners and house cells of all ghosts, one array per coordinate indexed by actor id, copied
+// from their GhostConfigs on reset so that ghost_targets() reads them as contiguous lanes
+struct GhostAnchors {
+  std::array<i32, Actors::capacity> corner_x, corner_y;
+  std::array<i32, Actors::capacity> house_x, house_y;
+
+  void set(i32 ghost, const GhostConfig &config) {
+    corner_x[ghost] = config.corner.x;
+    corner_y[ghost] = config.corner.y;
+    house_x[ghost] = config.initial_location.x;
+    house_y[ghost] = config.initial_location.y;
+  }
 };
 
+// Targets of all ghosts at once, written into one array per coordinate indexed by actor id. In
+// chase mode every ghost goes after the nearest Pacman (Manhattan distance, the first one on
+// ties) according to its type: Blinky-style ghosts target that Pacman, Pinky-style ones the cell
+// `pinky_target_offset` ahead of it, Inky-style ones that Pacman mirrored around the first ghost,
+// and Clyde-style ones that Pacman until they are closer than `clyde_target_switch_distance`,
+// then their corner. In every other mode ghosts head for their corner, or stay put in the house.
+//
+// The candidates of each Pacman do not depend on the ghost and are computed once, and every
+// ghost then picks its target with masks rather than branches, so that the loops are vectorized
+// over ghosts
+inline void ghost_targets(
+  const Actors &actors, const GhostAnchors &anchors, i32 pinky_target_offset, i32 clyde_target_switch_distance, i32 *target_x, i32 *target_y
+) {
+  const i32 first = actors.first_ghost, end = actors.count;
+  const Location &partner = actors.locations[first];
+  std::array<i32, Actors::capacity> nearest, near;
+  std::fill(nearest.begin() + first, nearest.begin() + end, i32_inf);
+
+  for (i32 pacman = 0; pacman < actors.pacmen(); ++pacman) {
+    const Location &target = actors.locations[pacman];
+    const MovementDirection direction = actors.directions[pacman];
+    const i32 pinky_x = target.x + pinky_target_offset * (movement_direction_delta_x(direction) < 0 ? -1 : +1);
+    const i32 pinky_y = target.y + pinky_target_offset * (movement_direction_delta_y(direction) < 0 ? -1 : +1);
+    const i32 inky_x = target.x + std::abs(target.x - partner.x) * (partner.x < target.x ? +1 : -1);
+    const i32 inky_y = target.y + std::abs(target.y - partner.y) * (partner.y < target.y ? +1 : -1);
+
+    for (i32 ghost = first; ghost < end; ++ghost) {
+      const i32 type = (i32)actors.types[ghost];
+      const i32 distance = std::abs(actors.locations[ghost].x - target.x) + std::abs(actors.locations[ghost].y - target.y);
+      const i32 closer = -(distance < nearest[ghost]);
+      const i32 pinky = -(type == (i32)EntityType::pinky), inky = -(type == (i32)EntityType::inky);
+
+      nearest[ghost] = select_mask(closer, distance, nearest[ghost]);
+      near[ghost] = select_mask(closer, distance < clyde_target_switch_distance, near[ghost]);
+      target_x[ghost] = select_mask(closer, select_mask(pinky, pinky_x, select_mask(inky, inky_x, target.x)), target_x[ghost]);
+      target_y[ghost] = select_mask(closer, select_mask(pinky, pinky_y, select_mask(inky, inky_y, target.y)), target_y[ghost]);
+    }
+  }
 
-
-class Gate: public Entity {
-  public:
-    Gate(Location location):
-      Entity(EntityType::gate, location, MovementDirection::none)
-    { }
-
-    ~Gate() = default;
-};
+  for (i32 ghost = first; ghost < end; ++ghost) {
+    const i32 type = (i32)actors.types[ghost];
+    const i32 mode = (i32)actors.modes[ghost];
+    const i32 corner = -((mode != (i32)GhostMode::chase) | ((type == (i32)EntityType::clyde) & near[ghost]));
+    const i32 house = -(mode == (i32)GhostMode::house);
+    const i32 x = select_mask(corner, anchors.corner_x[ghost], target_x[ghost]);
+    const i32 y = select_mask(corner, anchors.corner_y[ghost], target_y[ghost]);
+    target_x[ghost] = select_mask(house, anchors.house_x[ghost], x);
+    target_y[ghost] = select_mask(house, anchors.house_y[ghost], y);
+  }
+}
 
 #endif // PACMAN_ENTITY_H
@@ -0,0 +1,22 @@
+#ifndef PACMAN_FEATURES_H
+#define PACMAN_FEATURES_H
+#pragma once
+
+#include "types.hpp"
+
+// Layout of the distance feature vector of an environment, one f32 per entry. Distances are
+// maze distances in steps, -1 when there is nothing (left) to reach:
+// - pellet_distance, power_pellet_distance: from pacman to the nearest one
+// - ghost_distances: from pacman to the first four ghosts (blinky, pinky, inky and clyde on the
+//   classic maps), through the gate
+// - safe_directions: 1 when moving up, left, down or right is possible and does not end next to
+//   a ghost in chase or scatter mode, else 0
+struct Features {
+  static constexpr i32 pellet_distance = 0;
+  static constexpr i32 power_pellet_distance = 1;
+  static constexpr i32 ghost_distances = 2;
+  static constexpr i32 safe_directions = 6;
+  static constexpr i32 count = 10;
+};
+
+#endif // PACMAN_FEATURES_H
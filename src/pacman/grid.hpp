@@ -2,48 +2,97 @@
 #define PACMAN_GRID_H
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 #include "pacman/entity.hpp"
 #include "types.hpp"
 
-class Grid {
+// Rows/Cols template argument for maps whose size is only known at runtime
+inline constexpr i32 dynamic_extent = 0;
+
+// One value per cell. Maps with a size known at compile time use std::array, so that loops over
+// all cells have constant trip counts and can be unrolled and vectorized by the compiler.
+template <typename T, i32 Size>
+using CellArray = std::conditional_t<Size == dynamic_extent, std::vector<T>, std::array<T, Size>>;
+
+// Static tiles of the map (walls, gates, pellets and power pellets) as one byte per cell. Actors
+// are not stored here, see Actors.
+template <i32 Rows = dynamic_extent, i32 Cols = dynamic_extent>
+class GridT {
   public:
+    static constexpr bool is_fixed = Rows != dynamic_extent and Cols != dynamic_extent;
+    static constexpr i32 size = is_fixed ? Rows * Cols : dynamic_extent;
+
     i32 rows;
     i32 cols;
-    std::vector <Entity*> map;
-  
+    CellArray<EntityType, size> tiles;
+
   private:
-    i32 get_index(const Location &location) {
-      return location.x * cols + location.y;
+    i32 get_index(const Location &location) const {
+      if constexpr (is_fixed)
+        return location.x * Cols + location.y;
+      else
+        return location.x * cols + location.y;
     }
-  
+
   public:
-    Grid(i32 rows, i32 cols):
+    GridT(i32 rows, i32 cols):
       rows(rows),
       cols(cols) {
-      map.resize(rows * cols, nullptr);
+      if constexpr (is_fixed) {
+        if (rows != Rows or cols != Cols)
+          throw std::runtime_error("Grid size does not match the compile-time size.");
+        tiles.fill(EntityType::none);
+      }
+      else
+        tiles.resize(rows * cols, EntityType::none);
     }
 
-    ~Grid() {
-      map.clear();
+    ~GridT() {
+      if constexpr (not is_fixed)
+        tiles.clear();
     }
 
     void reset() {
-      map.assign(map.size(), nullptr);
+      std::fill(tiles.begin(), tiles.end(), EntityType::none);
     }
 
-    Entity* get(const Location &location) {
-      return map[get_index(location)];
+    void reserve(i32 max_rows, i32 max_cols) {
+      if constexpr (not is_fixed)
+        tiles.reserve(max_rows * max_cols);
     }
 
-    void set(const Location &location, Entity *e) {
-      map[get_index(location)] = e;
+    // Clears the grid and changes its size. Does not reallocate within the reserved capacity
+    void resize(i32 rows, i32 cols) {
+      if constexpr (is_fixed) {
+        if (rows != Rows or cols != Cols)
+          throw std::runtime_error("Cannot resize a grid with a compile-time size.");
+        tiles.fill(EntityType::none);
+      }
+      else {
+        this->rows = rows;
+        this->cols = cols;
+        tiles.assign(rows * cols, EntityType::none);
+      }
+    }
+
+    EntityType get(const Location &location) const {
+      return tiles[get_index(location)];
+    }
+
+    void set(const Location &location, EntityType type) {
+      tiles[get_index(location)] = type;
     }
 
     void unset(const Location &location) {
-      map[get_index(location)] = nullptr;
+      tiles[get_index(location)] = EntityType::none;
     }
 };
 
+using Grid = GridT<>;
+
 #endif // PACMAN_GRID_H
@@ -0,0 +1,102 @@
+#ifndef PACMAN_JOURNAL_H
+#define PACMAN_JOURNAL_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+#include "pacman/constants.hpp"
+#include "pacman/entity.hpp"
+#include "types.hpp"
+
+// Per-actor state that a step can change. Types and the number of actors only change on reset
+struct ActorRecord {
+  Location location;
+  MovementDirection direction;
+  GhostMode mode;
+  i32 step_index;
+  bool house_state_updated;
+};
+
+// What one step of an environment changed, enough to revert it: the state of the Actors::count
+// live actors, the scalars of State, and the pellets that were eaten, if any. Walls, gates and the
+// other pellets never change within a step.
+struct StepRecord {
+  // Only the first Actors::count entries are written and read
+  std::array<ActorRecord, Actors::capacity> actors;
+
+  i32 step_index;
+  i32 score;
+  i32 lives;
+  i32 pellets_eaten;
+  bool completed;
+  f32 reward;
+  u64 hash;
+
+  // Per-Pacman scores and rewards
+  std::array<i32, Actors::max_pacmen> scores;
+  std::array<f32, Actors::max_pacmen> rewards;
+
+  // Reward shaping distances of every Pacman before the step
+  std::array<i32, Actors::max_pacmen> pellet_distances;
+  std::array<i32, Actors::max_pacmen> ghost_distances;
+
+  // Cell index and type of the pellet each Pacman ate during the step, or -1
+  std::array<i32, Actors::max_pacmen> pellet_indices;
+  std::array<EntityType, Actors::max_pacmen> pellet_types;
+};
+
+// Fixed capacity stack of step records. Pushing onto a full journal drops the oldest record, so
+// the last `capacity` steps can always be undone. Records are preallocated and reused, neither
+// push() nor pop() allocates.
+class Journal {
+  private:
+    std::vector<StepRecord> records;
+    i32 top = 0;
+    i32 size = 0;
+
+  public:
+    void set_capacity(i32 capacity) {
+      if (capacity < 0)
+        throw std::runtime_error("Journal capacity must be non-negative.");
+      records.assign(capacity, StepRecord{});
+      clear();
+    }
+
+    i32 get_capacity() const {
+      return (i32)records.size();
+    }
+
+    i32 get_size() const {
+      return size;
+    }
+
+    bool is_enabled() const {
+      return not records.empty();
+    }
+
+    void clear() {
+      top = 0;
+      size = 0;
+    }
+
+    // Slot for the record of the next step, to be filled by the caller
+    StepRecord& push() {
+      StepRecord &record = records[top];
+      top = (top + 1) % get_capacity();
+      size = std::min(size + 1, get_capacity());
+      return record;
+    }
+
+    const StepRecord& pop() {
+      if (size == 0)
+        throw std::runtime_error("Nothing to undo: the journal is empty.");
+      top = (top + get_capacity() - 1) % get_capacity();
+      size -= 1;
+      return records[top];
+    }
+};
+
+#endif // PACMAN_JOURNAL_H
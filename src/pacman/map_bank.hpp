@@ -0,0 +1,256 @@
+#ifndef PACMAN_MAP_BANK_H
+#define PACMAN_MAP_BANK_H
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pacman/constants.hpp"
+#include "types.hpp"
+
+// Non-owning view over a map whose characters have already been converted to entity types
+struct MapView {
+  i32 rows = 0;
+  i32 cols = 0;
+  const EntityType *tiles = nullptr;
+
+  EntityType at(i32 x, i32 y) const {
+    return tiles[x * cols + y];
+  }
+};
+
+// Converts map characters to entity types with a single table lookup per cell. Unknown
+// characters are collected with a bitwise OR and reported once the whole map has been parsed.
+inline void compile_map(const std::vector<std::string> &map, i32 rows, i32 cols, std::vector<EntityType> &out) {
+  if ((i32)map.size() != rows)
+    throw std::runtime_error("Map has " + std::to_string(map.size()) + " rows, expected " + std::to_string(rows) + ".");
+
+  out.resize(rows * cols);
+  u8 flags = 0;
+  for (i32 x = 0; x < rows; ++x) {
+    if ((i32)map[x].size() != cols)
+      throw std::runtime_error("Row " + std::to_string(x) + " has " + std::to_string(map[x].size()) + " columns, expected " + std::to_string(cols) + ".");
+    const char *row = map[x].data();
+    EntityType *tiles = out.data() + x * cols;
+    for (i32 y = 0; y < cols; ++y) {
+      u8 type = map_char_entity_types[(u8)row[y]];
+      flags |= type;
+      tiles[y] = static_cast<EntityType>(type);
+    }
+  }
+
+  if (flags & invalid_map_char)
+    for (i32 x = 0; x < rows; ++x)
+      for (i32 y = 0; y < cols; ++y)
+        if (not is_valid_map_char(map[x][y]))
+          throw std::runtime_error(std::string("Unknown map character '") + map[x][y] + "' at row " + std::to_string(x) + ".");
+}
+
+// Checks that a map can be loaded by PacmanEnvironment and that every pellet can be eaten.
+// Throws a std::runtime_error describing the first problem found.
+inline void validate_map(const std::vector<std::string> &map, i32 rows, i32 cols) {
+  if ((i32)map.size() != rows)
+    throw std::runtime_error("Map has " + std::to_string(map.size()) + " rows, expected " + std::to_string(rows) + ".");
+
+  i32 pacman = -1, counts[256] = {};
+  for (i32 x = 0; x < rows; ++x) {
+    if ((i32)map[x].size() != cols)
+      throw std::runtime_error("Row " + std::to_string(x) + " has " + std::to_string(map[x].size()) + " columns, expected " + std::to_string(cols) + ".");
+    for (i32 y = 0; y < cols; ++y) {
+      char c = map[x][y];
+      if (not is_valid_map_char(c))
+        throw std::runtime_error(std::string("Unknown map character '") + c + "' at row " + std::to_string(x) + ".");
+      if ((x == 0 or y == 0 or x == rows - 1 or y == cols - 1) and c != '#')
+        throw std::runtime_error("Map border must consist of walls.");
+      counts[(u8)c] += 1;
+      if (c == 'P')
+        pacman = x * cols + y;
+    }
+  }
+  for (char c: std::string_view("0123P"))
+    if (counts[(u8)c] != 1)
+      throw std::runtime_error(std::string("Map must contain exactly one '") + c + "'.");
+
+  std::vector<u8> seen(rows * cols, 0);
+  std::vector<i32> queue = {pacman};
+  seen[pacman] = 1;
+  for (size_t head = 0; head < queue.size(); ++head) {
+    i32 x = queue[head] / cols, y = queue[head] % cols;
+    for (i32 d = 0; d < 4; ++d) {
+      i32 nx = x + (d == 0 ? -1 : d == 2 ? +1 : 0);
+      i32 ny = y + (d == 1 ? -1 : d == 3 ? +1 : 0);
+      i32 next = nx * cols + ny;
+      // Pacman cannot pass through gates, so the ghost house is only reachable by ghosts
+      if (seen[next] or map[nx][ny] == '#' or map[nx][ny] == 'G')
+        continue;
+      seen[next] = 1;
+      queue.push_back(next);
+    }
+  }
+  for (i32 x = 0; x < rows; ++x)
+    for (i32 y = 0; y < cols; ++y)
+      if (not seen[x * cols + y] and (map[x][y] == '.' or map[x][y] == '@'))
+        throw std::runtime_error("Pellet at " + std::to_string(x) + ", " + std::to_string(y) + " is not reachable from Pacman.");
+}
+
+// Preloaded set of validated and compiled maps that environments can switch between on reset
+// without reconstructing anything. All maps live in one contiguous buffer, which add() may
+// reallocate, so a bank is frozen once it is attached to an environment and add() then throws.
+//
+// Binary format (native endianness):
+//   char[8] magic "PMRLMAPS", u32 version, u32 count,
+//   then per map: i32 rows, i32 cols, rows * cols map characters.
+class MapBank {
+  private:
+    struct Entry {
+      i32 rows;
+      i32 cols;
+      u64 offset;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<EntityType> tiles;
+    i32 max_rows = 0;
+    i32 max_cols = 0;
+
+    // Set by freeze(), which environments call through the const bank they share
+    mutable bool frozen = false;
+
+    static constexpr char magic[8] = {'P', 'M', 'R', 'L', 'M', 'A', 'P', 'S'};
+    static constexpr u32 version = 1;
+
+    // Largest number of rows or columns of a map read from a file, well above the sizes used in
+    // practice, so that a corrupt header fails before allocating
+    static constexpr i32 max_side = 8192;
+
+  public:
+    i32 add(const std::vector<std::string> &map) {
+      if (frozen)
+        throw std::runtime_error("The map bank is attached to an environment and can no longer be changed.");
+      i32 rows = (i32)map.size();
+      i32 cols = rows > 0 ? (i32)map[0].size() : 0;
+      validate_map(map, rows, cols);
+
+      u64 offset = tiles.size();
+      tiles.resize(offset + rows * cols);
+      for (i32 x = 0; x < rows; ++x)
+        for (i32 y = 0; y < cols; ++y)
+          tiles[offset + x * cols + y] = char_to_entity_type_unchecked(map[x][y]);
+
+      entries.push_back(Entry{rows, cols, offset});
+      max_rows = std::max(max_rows, rows);
+      max_cols = std::max(max_cols, cols);
+      return (i32)entries.size() - 1;
+    }
+
+    i32 size() const {
+      return (i32)entries.size();
+    }
+
+    void freeze() const {
+      frozen = true;
+    }
+
+    bool is_frozen() const {
+      return frozen;
+    }
+
+    i32 get_max_rows() const {
+      return max_rows;
+    }
+
+    i32 get_max_cols() const {
+      return max_cols;
+    }
+
+    MapView get(i32 map_id) const {
+      if (map_id < 0 or map_id >= size())
+        throw std::runtime_error("Map id " + std::to_string(map_id) + " is out of range for a bank of " + std::to_string(size()) + " maps.");
+      const Entry &entry = entries[map_id];
+      return MapView{entry.rows, entry.cols, tiles.data() + entry.offset};
+    }
+
+    std::vector<std::string> get_map(i32 map_id) const {
+      MapView view = get(map_id);
+      std::vector<std::string> map(view.rows, std::string(view.cols, ' '));
+      for (i32 x = 0; x < view.rows; ++x)
+        for (i32 y = 0; y < view.cols; ++y)
+          map[x][y] = entity_type_to_char(view.at(x, y));
+      return map;
+    }
+
+    void save(const std::string &filename) const {
+      std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(filename.c_str(), "wb"), &std::fclose);
+      if (file == nullptr)
+        throw std::runtime_error("Could not open " + filename + " for writing.");
+
+      auto write = [&] (const void *data, size_t size) {
+        if (std::fwrite(data, 1, size, file.get()) != size)
+          throw std::runtime_error("Could not write map bank file " + filename + ".");
+      };
+
+      u32 count = (u32)entries.size();
+      write(magic, sizeof(magic));
+      write(&version, sizeof(version));
+      write(&count, sizeof(count));
+
+      std::string row;
+      for (i32 map_id = 0; map_id < size(); ++map_id) {
+        MapView view = get(map_id);
+        write(&view.rows, sizeof(view.rows));
+        write(&view.cols, sizeof(view.cols));
+        row.resize(view.cols);
+        for (i32 x = 0; x < view.rows; ++x) {
+          for (i32 y = 0; y < view.cols; ++y)
+            row[y] = entity_type_to_char(view.at(x, y));
+          write(row.data(), view.cols);
+        }
+      }
+
+      // Buffered data is only written out on close, which can fail as well, e.g. on a full disk
+      if (std::fclose(file.release()) != 0)
+        throw std::runtime_error("Could not write map bank file " + filename + ".");
+    }
+
+    static MapBank load(const std::string &filename) {
+      std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(filename.c_str(), "rb"), &std::fclose);
+      if (file == nullptr)
+        throw std::runtime_error("Could not open " + filename + " for reading.");
+
+      auto read = [&] (void *data, size_t size) {
+        if (std::fread(data, 1, size, file.get()) != size)
+          throw std::runtime_error("Unexpected end of map bank file " + filename + ".");
+      };
+
+      char file_magic[8];
+      u32 file_version, count;
+      read(file_magic, sizeof(file_magic));
+      read(&file_version, sizeof(file_version));
+      read(&count, sizeof(count));
+      if (std::memcmp(file_magic, magic, sizeof(magic)) != 0 or file_version != version)
+        throw std::runtime_error(filename + " is not a version " + std::to_string(version) + " map bank.");
+
+      MapBank bank;
+      std::vector<std::string> map;
+      for (u32 i = 0; i < count; ++i) {
+        i32 rows, cols;
+        read(&rows, sizeof(rows));
+        read(&cols, sizeof(cols));
+        if (rows < 1 or cols < 1 or rows > max_side or cols > max_side)
+          throw std::runtime_error("Map " + std::to_string(i) + " of " + filename + " is " + std::to_string(rows) + "x" + std::to_string(cols) + ", expected sides in [1, " + std::to_string(max_side) + "].");
+        map.assign(rows, std::string(cols, ' '));
+        for (i32 x = 0; x < rows; ++x)
+          read(map[x].data(), cols);
+        bank.add(map);
+      }
+      return bank;
+    }
+};
+
+#endif // PACMAN_MAP_BANK_H
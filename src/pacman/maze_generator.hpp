@@ -0,0 +1,350 @@
+#ifndef PACMAN_MAZE_GENERATOR_H
+#define PACMAN_MAZE_GENERATOR_H
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "random.hpp"
+#include "types.hpp"
+
+struct MazeGeneratorConfig {
+  i32 rows = 21;
+  i32 cols = 19;
+  u64 seed = 0;
+
+  // Probability with which each dead end is opened up into a loop. 1 gives a maze without dead ends
+  f32 braid = 1.0f;
+
+  // Probability with which any other wall separating two corridors is knocked down
+  f32 extra_openings = 0.05f;
+
+  // Placed in mirrored pairs, nearest to the corners first
+  i32 power_pellets = 4;
+};
+
+// Generates left-right symmetric maps in the same format as Config::map.
+//
+// Corridors are carved on the odd lattice of the left half with a randomized depth-first
+// search, dead ends are braided into loops and the result is mirrored. The ghost house sits
+// in the middle of the map and is surrounded by a corridor, with Blinky above the gate and
+// Pacman below the house, same as the classic layout. A final union-find pass knocks down
+// walls until every corridor is reachable from Pacman.
+//
+// Buffers are reused across calls to generate(), so keep a generator around when producing
+// many maps of the same size.
+class MazeGenerator {
+  private:
+    MazeGeneratorConfig config;
+    Random random;
+
+    std::vector<char> tiles;
+    std::vector<u8> is_protected;
+    std::vector<u8> is_visited;
+    std::vector<i32> parent;
+    std::vector<i32> stack;
+    std::vector<i32> candidates;
+
+    // Ghost house layout, see stamp_house()
+    i32 gate_row;
+    i32 center_lo;
+    i32 center_hi;
+    i32 house_left;
+    i32 house_right;
+
+    static constexpr char open_tile = ' ';
+    static constexpr char wall_tile = '#';
+    static constexpr i32 dx[4] = {-1, 0, +1, 0};
+    static constexpr i32 dy[4] = {0, -1, 0, +1};
+
+  public:
+    MazeGenerator(const MazeGeneratorConfig &config):
+      config(config),
+      random(config.seed) {
+      if (config.rows < 9 or config.cols < 9)
+        throw std::runtime_error("Generated mazes must be at least 9x9 to fit the ghost house.");
+
+      i32 size = config.rows * config.cols;
+      tiles.resize(size);
+      is_protected.resize(size);
+      is_visited.resize(size);
+      parent.resize(size);
+      stack.reserve(size);
+      candidates.reserve(size);
+
+      gate_row = config.rows / 2 - 2;
+      gate_row -= gate_row % 2;
+      center_lo = (config.cols - 1) / 2;
+      center_hi = config.cols / 2;
+      house_left = center_lo - 2;
+      house_right = center_hi + 2;
+    }
+
+    std::vector<std::string> generate() {
+      return generate(config.seed);
+    }
+
+    std::vector<std::string> generate(u64 seed) {
+      random.seed(seed);
+      std::fill(tiles.begin(), tiles.end(), wall_tile);
+      std::fill(is_protected.begin(), is_protected.end(), 0);
+      std::fill(is_visited.begin(), is_visited.end(), 0);
+
+      carve_house_corridor();
+      carve_lattice();
+      braid();
+      open_extra_walls();
+      connect_components();
+      stamp_house();
+      place_items();
+
+      std::vector<std::string> map(config.rows, std::string(config.cols, wall_tile));
+      for (i32 x = 0; x < config.rows; ++x)
+        map[x].assign(tiles.data() + x * config.cols, config.cols);
+      return map;
+    }
+
+  private:
+    i32 index(i32 x, i32 y) const {
+      return x * config.cols + y;
+    }
+
+    i32 mirror(i32 y) const {
+      return config.cols - 1 - y;
+    }
+
+    bool is_interior(i32 x, i32 y) const {
+      return x >= 1 and x < config.rows - 1 and y >= 1 and y < config.cols - 1;
+    }
+
+    bool is_open(i32 x, i32 y) const {
+      return tiles[index(x, y)] != wall_tile;
+    }
+
+    void open(i32 x, i32 y) {
+      tiles[index(x, y)] = open_tile;
+      tiles[index(x, mirror(y))] = open_tile;
+    }
+
+    i32 count_open_neighbours(i32 x, i32 y) const {
+      i32 count = 0;
+      for (i32 d = 0; d < 4; ++d)
+        count += is_open(x + dx[d], y + dy[d]);
+      return count;
+    }
+
+    // Corridor ring around the house. The house itself is protected so that nothing gets carved into it
+    void carve_house_corridor() {
+      for (i32 x = gate_row; x <= gate_row + 2; ++x)
+        for (i32 y = house_left; y <= house_right; ++y)
+          is_protected[index(x, y)] = 1;
+      for (i32 y = house_left - 1; y <= house_right + 1; ++y) {
+        open(gate_row - 1, y);
+        open(gate_row + 3, y);
+      }
+      for (i32 x = gate_row; x <= gate_row + 2; ++x) {
+        open(x, house_left - 1);
+        open(x, house_right + 1);
+      }
+    }
+
+    // Randomized depth-first search over the odd lattice of the left half
+    void carve_lattice() {
+      const i32 max_x = config.rows - 2;
+      const i32 max_y = std::min(center_lo, config.cols - 2);
+
+      stack.clear();
+      stack.push_back(index(1, 1));
+      is_visited[index(1, 1)] = 1;
+      open(1, 1);
+
+      while (not stack.empty()) {
+        i32 current = stack.back();
+        i32 x = current / config.cols, y = current % config.cols;
+
+        i32 choices[4], num_choices = 0;
+        for (i32 d = 0; d < 4; ++d) {
+          i32 nx = x + 2 * dx[d], ny = y + 2 * dy[d];
+          if (nx < 1 or nx > max_x or ny < 1 or ny > max_y)
+            continue;
+          if (is_visited[index(nx, ny)] or is_protected[index(nx, ny)] or is_protected[index(x + dx[d], y + dy[d])])
+            continue;
+          choices[num_choices++] = d;
+        }
+
+        if (num_choices == 0) {
+          stack.pop_back();
+          continue;
+        }
+
+        i32 d = choices[random.uniform(num_choices)];
+        i32 nx = x + 2 * dx[d], ny = y + 2 * dy[d];
+        open(x + dx[d], y + dy[d]);
+        open(nx, ny);
+        is_visited[index(nx, ny)] = 1;
+        stack.push_back(index(nx, ny));
+      }
+    }
+
+    // Tries to open a wall next to (x, y) that leads into another corridor
+    bool open_towards_corridor(i32 x, i32 y) {
+      i32 choices[4], num_choices = 0;
+      for (i32 d = 0; d < 4; ++d) {
+        i32 wx = x + dx[d], wy = y + dy[d];
+        i32 nx = x + 2 * dx[d], ny = y + 2 * dy[d];
+        if (not is_interior(wx, wy) or is_open(wx, wy) or is_protected[index(wx, wy)])
+          continue;
+        if (not is_interior(nx, ny) or not is_open(nx, ny))
+          continue;
+        choices[num_choices++] = d;
+      }
+      if (num_choices == 0)
+        return false;
+      i32 d = choices[random.uniform(num_choices)];
+      open(x + dx[d], y + dy[d]);
+      return true;
+    }
+
+    void braid() {
+      for (i32 x = 1; x < config.rows - 1; ++x)
+        for (i32 y = 1; y <= center_lo; ++y)
+          if (is_open(x, y) and count_open_neighbours(x, y) <= 1 and random.bernoulli(config.braid))
+            open_towards_corridor(x, y);
+    }
+
+    void open_extra_walls() {
+      if (config.extra_openings <= 0.0f)
+        return;
+      for (i32 x = 1; x < config.rows - 1; ++x)
+        for (i32 y = 1; y <= center_lo; ++y) {
+          if (is_open(x, y) or is_protected[index(x, y)])
+            continue;
+          bool horizontal = is_open(x, y - 1) and is_open(x, y + 1);
+          bool vertical = is_open(x - 1, y) and is_open(x + 1, y);
+          if ((horizontal or vertical) and random.bernoulli(config.extra_openings))
+            open(x, y);
+        }
+    }
+
+    i32 find(i32 i) {
+      while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+      }
+      return i;
+    }
+
+    void unite(i32 a, i32 b) {
+      a = find(a);
+      b = find(b);
+      if (a != b)
+        parent[a] = b;
+    }
+
+    void join_with_neighbours(i32 x, i32 y) {
+      for (i32 d = 0; d < 4; ++d)
+        if (is_open(x + dx[d], y + dy[d]))
+          unite(index(x, y), index(x + dx[d], y + dy[d]));
+    }
+
+    // Knocks down single walls between disconnected corridors, in random order, until the whole
+    // maze is one component (Kruskal style)
+    void connect_components() {
+      for (i32 i = 0; i < (i32)parent.size(); ++i)
+        parent[i] = i;
+      for (i32 x = 1; x < config.rows - 1; ++x)
+        for (i32 y = 1; y < config.cols - 1; ++y)
+          if (is_open(x, y)) {
+            if (is_open(x + 1, y)) unite(index(x, y), index(x + 1, y));
+            if (is_open(x, y + 1)) unite(index(x, y), index(x, y + 1));
+          }
+
+      candidates.clear();
+      for (i32 x = 1; x < config.rows - 1; ++x)
+        for (i32 y = 1; y <= center_lo; ++y) {
+          if (is_open(x, y) or is_protected[index(x, y)])
+            continue;
+          bool horizontal = is_open(x, y - 1) and is_open(x, y + 1);
+          bool vertical = is_open(x - 1, y) and is_open(x + 1, y);
+          if (horizontal or vertical)
+            candidates.push_back(index(x, y));
+        }
+      for (i32 i = (i32)candidates.size() - 1; i > 0; --i)
+        std::swap(candidates[i], candidates[random.uniform(i + 1)]);
+
+      for (i32 wall: candidates) {
+        i32 x = wall / config.cols, y = wall % config.cols;
+        bool should_open = false;
+        if (is_open(x, y - 1) and is_open(x, y + 1) and find(index(x, y - 1)) != find(index(x, y + 1)))
+          should_open = true;
+        if (is_open(x - 1, y) and is_open(x + 1, y) and find(index(x - 1, y)) != find(index(x + 1, y)))
+          should_open = true;
+        if (not should_open)
+          continue;
+        open(x, y);
+        join_with_neighbours(x, y);
+        join_with_neighbours(x, mirror(y));
+      }
+    }
+
+    void stamp_house() {
+      for (i32 y = house_left; y <= house_right; ++y) {
+        tiles[index(gate_row, y)] = (y >= center_lo and y <= center_hi) ? 'G' : wall_tile;
+        tiles[index(gate_row + 1, y)] = (y == house_left or y == house_right) ? wall_tile : open_tile;
+        tiles[index(gate_row + 2, y)] = wall_tile;
+      }
+    }
+
+    bool place_power_pellet(i32 x, i32 y) {
+      if (tiles[index(x, y)] != '.')
+        return false;
+      tiles[index(x, y)] = '@';
+      tiles[index(x, mirror(y))] = '@';
+      return true;
+    }
+
+    // Nearest pellet to the given corner of the left half, by manhattan distance
+    bool place_power_pellet_near(i32 corner_x, i32 corner_y) {
+      const i32 step_x = corner_x == 1 ? +1 : -1;
+      for (i32 distance = 0; distance < config.rows + center_lo; ++distance)
+        for (i32 i = 0; i <= distance; ++i) {
+          i32 x = corner_x + step_x * i, y = corner_y + distance - i;
+          if (is_interior(x, y) and y <= center_lo and place_power_pellet(x, y))
+            return true;
+        }
+      return false;
+    }
+
+    void place_items() {
+      for (i32 x = 1; x < config.rows - 1; ++x)
+        for (i32 y = 1; y < config.cols - 1; ++y)
+          if (tiles[index(x, y)] == open_tile and not is_protected[index(x, y)])
+            tiles[index(x, y)] = '.';
+
+      tiles[index(gate_row - 1, center_lo)] = '0';
+      tiles[index(gate_row + 1, center_lo - 1)] = '1';
+      tiles[index(gate_row + 1, center_lo)] = '2';
+      tiles[index(gate_row + 1, center_lo + 1)] = '3';
+      tiles[index(gate_row + 3, center_lo)] = 'P';
+
+      i32 placed = 0;
+      if (placed < config.power_pellets and place_power_pellet_near(1, 1))
+        placed += 2;
+      if (placed < config.power_pellets and place_power_pellet_near(config.rows - 2, 1))
+        placed += 2;
+      for (i32 attempt = 0; placed < config.power_pellets and attempt < 64 * config.power_pellets; ++attempt) {
+        i32 x = 1 + random.uniform(config.rows - 2);
+        i32 y = 1 + random.uniform(center_lo);
+        if (place_power_pellet(x, y))
+          placed += 2;
+      }
+    }
+};
+
+inline std::vector<std::string> generate_maze(const MazeGeneratorConfig &config) {
+  return MazeGenerator(config).generate();
+}
+
+#endif // PACMAN_MAZE_GENERATOR_H
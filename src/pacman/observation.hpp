@@ -0,0 +1,92 @@
+#ifndef PACMAN_OBSERVATION_H
+#define PACMAN_OBSERVATION_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "pacman/constants.hpp"
+#include "types.hpp"
+
+// Tensor observation: one binary u8 plane per entity type, channels x rows x cols, row-major.
+// Unlike State::grid, every entity is visible: pellets under ghosts, ghosts on top of each other
+// and ghosts standing on the gate all show up in their own plane.
+//
+// The channel of an entity type is its enum value, so `none` (the last one) has no plane.
+inline constexpr i32 observation_channels = entity_type_count - 1;
+
+inline constexpr i32 observation_channel(EntityType type) {
+  return (i32)type;
+}
+
+inline constexpr std::array<i32, 3> observation_shape(i32 rows, i32 cols) {
+  return {observation_channels, rows, cols};
+}
+
+inline constexpr i64 observation_size(i32 rows, i32 cols) {
+  return (i64)observation_channels * rows * cols;
+}
+
+// Egocentric window observation: the same planes cropped to the (2r + 1) x (2r + 1) cells centered
+// on pacman, so that its size does not depend on the map size. Cells outside the map are walls.
+//
+// Window radius that stands for the full map instead of a window
+inline constexpr i32 full_observation = -1;
+
+inline constexpr i32 window_side(i32 radius) {
+  return 2 * radius + 1;
+}
+
+inline constexpr std::array<i32, 3> observation_shape(i32 rows, i32 cols, i32 window_radius) {
+  if (window_radius == full_observation)
+    return observation_shape(rows, cols);
+  return observation_shape(window_side(window_radius), window_side(window_radius));
+}
+
+inline constexpr i64 observation_size(i32 rows, i32 cols, i32 window_radius) {
+  auto [channels, height, width] = observation_shape(rows, cols, window_radius);
+  return (i64)channels * height * width;
+}
+
+// Observation of one agent in multi-agent mode: the planes above, centered on that agent for
+// windows, with only the agent itself in the pacman plane and the other Pacmen in one more plane
+inline constexpr i32 agent_observation_channels = observation_channels + 1;
+inline constexpr i32 other_pacmen_channel = observation_channels;
+
+inline constexpr std::array<i32, 3> agent_observation_shape(i32 rows, i32 cols, i32 window_radius) {
+  auto [channels, height, width] = observation_shape(rows, cols, window_radius);
+  return {agent_observation_channels, height, width};
+}
+
+inline constexpr i64 agent_observation_size(i32 rows, i32 cols, i32 window_radius) {
+  auto [channels, height, width] = agent_observation_shape(rows, cols, window_radius);
+  return (i64)channels * height * width;
+}
+
+// Crops the window of the given radius centered on (x, y) out of a full observation of a
+// rows x cols map. Every row segment inside the map is a contiguous copy
+inline void crop_observation(const u8 *observation, i32 rows, i32 cols, i32 x, i32 y, i32 radius, u8 *out) {
+  const i32 side = window_side(radius);
+  const i32 top = x - radius, left = y - radius;
+  const i32 y_begin = std::clamp(-left, 0, side), y_end = std::clamp(cols - left, y_begin, side);
+
+  for (i32 channel = 0; channel < observation_channels; ++channel) {
+    const u8 padding = channel == observation_channel(EntityType::wall);
+    const u8 *source = observation + (i64)channel * rows * cols;
+    u8 *target = out + (i64)channel * side * side;
+
+    for (i32 wx = 0; wx < side; ++wx, target += side) {
+      const i32 row = top + wx;
+      if (row < 0 or row >= rows) {
+        std::fill_n(target, side, padding);
+        continue;
+      }
+      std::fill_n(target, y_begin, padding);
+      const u8 *segment = source + (i64)row * cols + left + y_begin;
+      std::copy(segment, segment + (y_end - y_begin), target + y_begin);
+      std::fill(target + y_end, target + side, padding);
+    }
+  }
+}
+
+#endif // PACMAN_OBSERVATION_H
@@ -0,0 +1,33 @@
+#ifndef PACMAN_REWARD_H
+#define PACMAN_REWARD_H
+#pragma once
+
+#include "types.hpp"
+
+// Weighted terms of the per-step reward computed by the environment (State::reward). The default
+// is the score delta, every other term is off. Event weights are added once per event, so
+// penalties (death, step) take negative weights.
+//
+// The two distance terms are potential-based shaping over maze distances (shortest paths that
+// pacman can walk, not Manhattan distances), so they do not change which policies are optimal:
+// - pellet_distance rewards getting closer to the nearest pellet or power pellet
+// - ghost_distance rewards getting away from the nearest ghost in chase or scatter mode, with
+//   distances capped at ghost_distance_cap so that far away ghosts do not matter
+struct RewardConfig {
+  f32 score = 1;
+  f32 pellet = 0;
+  f32 power_pellet = 0;
+  f32 ghost_eaten = 0;
+  f32 death = 0;
+  f32 step = 0;
+
+  f32 pellet_distance = 0;
+  f32 ghost_distance = 0;
+  i32 ghost_distance_cap = 10;
+
+  bool uses_distances() const {
+    return pellet_distance != 0 or ghost_distance != 0;
+  }
+};
+
+#endif // PACMAN_REWARD_H
@@ -12,14 +12,30 @@ struct State {
   i32 step_index;
   i32 score;
   i32 lives;
+  i32 pellets_eaten;
   
   bool completed;
 
+  // Reward of the last step, see RewardConfig
+  f32 reward;
+
+  // Zobrist hash of the dynamic state (actors, lives and remaining pellets), see zobrist.hpp
+  u64 hash;
+
   Location pacman_location;
   Location blinky_location;
   Location pinky_location;
   Location inky_location;
   Location clyde_location;
+
+  // All ghosts in actor order, the four above first. Named locations of missing ghosts are (-1, -1)
+  std::vector<Location> ghost_locations;
+
+  // One entry per Pacman, the first one being pacman_location. Score and reward are the totals
+  // of scores and rewards
+  std::vector<Location> pacman_locations;
+  std::vector<i32> scores;
+  std::vector<f32> rewards;
   
   std::vector <std::string> grid;
 };
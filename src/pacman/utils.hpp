@@ -10,4 +10,11 @@ inline i32 manhattan_distance(i32 x1, i32 y1, i32 x2, i32 y2) {
   return std::abs(x1 - x2) + std::abs(y1 - y2);
 }
 
+// `a` where mask is all ones and `b` where it is zero. Loops over ghosts use this instead of
+// `c ? a : b`, which the compiler turns back into a branch around the store, and then does not
+// vectorize them
+inline i32 select_mask(i32 mask, i32 a, i32 b) {
+  return (a & mask) | (b & ~mask);
+}
+
 #endif // PACMAN_UTILS_HPP
@@ -0,0 +1,61 @@
+#ifndef PACMAN_ZOBRIST_H
+#define PACMAN_ZOBRIST_H
+#pragma once
+
+#include "pacman/constants.hpp"
+#include "pacman/entity.hpp"
+#include "types.hpp"
+
+// Zobrist keys of the dynamic state of an environment. The hash of a state is the XOR of the
+// keys of its features, so it is updated by XOR-ing out the keys of a feature before it changes
+// and XOR-ing in the new ones.
+//
+// Keys are not drawn from a table but derived from the feature with the splitmix64 finalizer.
+// That makes them independent of the map size and stable across runs, platforms and versions,
+// which matters for hashes stored in datasets.
+enum class ZobristFeature: u8 {
+  pellet,
+  power_pellet,
+  location,
+  direction,
+  mode,
+  step_index,
+  house_state,
+  lives,
+};
+
+inline constexpr u64 zobrist_key(ZobristFeature feature, i32 owner, i64 value) {
+  u64 z = 0x5851f42d4c957f2dull;
+  z ^= (u64)feature << 56 ^ (u64)(u8)owner << 48 ^ ((u64)value & 0xffffffffffffull);
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Key of the pellet or power pellet at a cell
+inline constexpr u64 zobrist_pellet_key(EntityType type, i32 index) {
+  return zobrist_key(type == EntityType::pellet ? ZobristFeature::pellet : ZobristFeature::power_pellet, 0, index);
+}
+
+// XOR of the keys of everything about one actor: location, direction, and for ghosts their mode,
+// mode timer and whether they left the house
+inline u64 zobrist_actor_hash(const Actors &actors, i32 actor) {
+  const Location &location = actors.locations[actor];
+  u64 hash = zobrist_key(ZobristFeature::location, actor, (i64)location.x << 24 ^ location.y)
+           ^ zobrist_key(ZobristFeature::direction, actor, (i64)actors.directions[actor]);
+  if (actor >= actors.first_ghost)
+    hash ^= zobrist_key(ZobristFeature::mode, actor, (i64)actors.modes[actor])
+          ^ zobrist_key(ZobristFeature::step_index, actor, actors.step_indices[actor])
+          ^ zobrist_key(ZobristFeature::house_state, actor, actors.house_state_updated[actor]);
+  return hash;
+}
+
+inline u64 zobrist_actors_hash(const Actors &actors) {
+  u64 hash = 0;
+  for (i32 actor = 0; actor < actors.count; ++actor)
+    hash ^= zobrist_actor_hash(actors, actor);
+  return hash;
+}
+
+#endif // PACMAN_ZOBRIST_H
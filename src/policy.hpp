@@ -0,0 +1,201 @@
+#ifndef HEADER_POLICY_H
+#define HEADER_POLICY_H
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "random.hpp"
+#include "types.hpp"
+#include "pacman/constants.hpp"
+#include "pacman/observation.hpp"
+
+enum class PolicyType {
+  random,
+  greedy,
+  avoid_ghosts,
+};
+
+// Scripted policies used for data generation. They act on the tensor observation (see
+// observation.hpp), so they work with any environment or wrapper and see exactly what is
+// recorded in a trajectory.
+//
+// - random: uniform over the four directions
+// - greedy: first move of a shortest path to the nearest pellet or power pellet
+// - avoid_ghosts: greedy, unless a ghost is within `danger_distance` moves, in which case it takes
+//   the move that gets furthest away from the nearest ghost
+//
+// Every policy owns its generator and BFS scratch buffers, so one instance per thread is enough.
+class Policy {
+  private:
+    PolicyType type;
+    i32 rows;
+    i32 cols;
+    i32 danger_distance;
+    Random random;
+
+    std::vector<i32> queue;
+    std::vector<i32> distances;
+    std::vector<i32> ghost_distances;
+    std::vector<i8> first_moves;
+
+    static constexpr MovementDirection moves[4] = {
+      MovementDirection::up, MovementDirection::left, MovementDirection::down, MovementDirection::right
+    };
+
+  public:
+    Policy(PolicyType type, i32 rows, i32 cols, u64 seed = 0, i32 danger_distance = 3):
+      type(type),
+      rows(rows),
+      cols(cols),
+      danger_distance(danger_distance),
+      random(seed) {
+      if (rows <= 0 or cols <= 0)
+        throw std::runtime_error("Policy requires a positive number of rows and columns.");
+      queue.resize(rows * cols);
+      distances.resize(rows * cols);
+      ghost_distances.resize(rows * cols);
+      first_moves.resize(rows * cols);
+    }
+
+    MovementDirection act(const u8 *observation) {
+      if (type == PolicyType::random)
+        return random_move();
+
+      const i32 pacman = find(observation, EntityType::pacman);
+      if (pacman < 0)
+        return random_move();
+
+      if (type == PolicyType::avoid_ghosts) {
+        compute_ghost_distances(observation);
+        if (ghost_distances[pacman] <= danger_distance)
+          return escape_move(observation, pacman);
+      }
+
+      return greedy_move(observation, pacman);
+    }
+
+    PolicyType get_type() const {
+      return type;
+    }
+
+    i32 get_rows() const {
+      return rows;
+    }
+
+    i32 get_cols() const {
+      return cols;
+    }
+
+    void seed(u64 seed) {
+      random.seed(seed);
+    }
+
+  private:
+    const u8* plane(const u8 *observation, EntityType type) const {
+      return observation + (i64)observation_channel(type) * rows * cols;
+    }
+
+    i32 find(const u8 *observation, EntityType type) const {
+      const u8 *cells = plane(observation, type);
+      const u8 *cell = std::find(cells, cells + rows * cols, 1);
+      return cell == cells + rows * cols ? -1 : (i32)(cell - cells);
+    }
+
+    // Pacman can neither walk through walls nor through the gate of the ghost house
+    bool is_free(const u8 *observation, i32 index) const {
+      return not plane(observation, EntityType::wall)[index] and not plane(observation, EntityType::gate)[index];
+    }
+
+    // Neighbour of `index` in direction `move`, or -1 if it is off the map or blocked
+    i32 neighbour(const u8 *observation, i32 index, i32 move) const {
+      i32 x = index / cols + movement_direction_delta_x(moves[move]);
+      i32 y = index % cols + movement_direction_delta_y(moves[move]);
+      if (x < 0 or x >= rows or y < 0 or y >= cols)
+        return -1;
+      i32 next = x * cols + y;
+      return is_free(observation, next) ? next : -1;
+    }
+
+    MovementDirection random_move() {
+      return moves[random.uniform(4)];
+    }
+
+    MovementDirection greedy_move(const u8 *observation, i32 pacman) {
+      const u8 *pellets = plane(observation, EntityType::pellet);
+      const u8 *power_pellets = plane(observation, EntityType::power_pellet);
+
+      std::fill(distances.begin(), distances.end(), -1);
+      i32 head = 0, tail = 0;
+      distances[pacman] = 0;
+      queue[tail++] = pacman;
+
+      while (head < tail) {
+        i32 index = queue[head++];
+        if (index != pacman and (pellets[index] or power_pellets[index]))
+          return moves[first_moves[index]];
+
+        for (i32 move = 0; move < 4; ++move) {
+          i32 next = neighbour(observation, index, move);
+          if (next < 0 or distances[next] >= 0)
+            continue;
+          distances[next] = distances[index] + 1;
+          first_moves[next] = index == pacman ? move : first_moves[index];
+          queue[tail++] = next;
+        }
+      }
+
+      // Nothing left to eat within reach
+      return random_move();
+    }
+
+    // Multi-source BFS from all ghosts. Ghosts also move through the gate, so only walls block
+    void compute_ghost_distances(const u8 *observation) {
+      const u8 *walls = plane(observation, EntityType::wall);
+      std::fill(ghost_distances.begin(), ghost_distances.end(), i32_inf);
+
+      i32 head = 0, tail = 0;
+      for (EntityType ghost: {EntityType::blinky, EntityType::pinky, EntityType::inky, EntityType::clyde}) {
+        const u8 *cells = plane(observation, ghost);
+        for (i32 index = 0; index < rows * cols; ++index)
+          if (cells[index] and ghost_distances[index] != 0) {
+            ghost_distances[index] = 0;
+            queue[tail++] = index;
+          }
+      }
+
+      while (head < tail) {
+        i32 index = queue[head++];
+        i32 x = index / cols, y = index % cols;
+        for (MovementDirection move: moves) {
+          i32 nx = x + movement_direction_delta_x(move);
+          i32 ny = y + movement_direction_delta_y(move);
+          if (nx < 0 or nx >= rows or ny < 0 or ny >= cols)
+            continue;
+          i32 next = nx * cols + ny;
+          if (walls[next] or ghost_distances[next] != i32_inf)
+            continue;
+          ghost_distances[next] = ghost_distances[index] + 1;
+          queue[tail++] = next;
+        }
+      }
+    }
+
+    // Move (or standing still) that maximizes the distance to the nearest ghost. Ties go to the
+    // first direction in up, left, down, right order
+    MovementDirection escape_move(const u8 *observation, i32 pacman) {
+      MovementDirection best_move = MovementDirection::none;
+      i32 best_distance = ghost_distances[pacman];
+      for (i32 move = 0; move < 4; ++move) {
+        i32 next = neighbour(observation, pacman, move);
+        if (next >= 0 and ghost_distances[next] > best_distance) {
+          best_distance = ghost_distances[next];
+          best_move = moves[move];
+        }
+      }
+      return best_move;
+    }
+};
+
+#endif // HEADER_POLICY_H
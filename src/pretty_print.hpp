@@ -40,6 +40,21 @@ inline std::string pretty_map(const std::vector<std::string> &map) {
   return result;
 }
 
+inline std::string pretty_reward_config(const RewardConfig &reward) {
+  return
+    "pacman_rl.RewardConfig{\n"
+    "  .score = " + std::to_string(reward.score) + ",\n"
+    "  .pellet = " + std::to_string(reward.pellet) + ",\n"
+    "  .power_pellet = " + std::to_string(reward.power_pellet) + ",\n"
+    "  .ghost_eaten = " + std::to_string(reward.ghost_eaten) + ",\n"
+    "  .death = " + std::to_string(reward.death) + ",\n"
+    "  .step = " + std::to_string(reward.step) + ",\n"
+    "  .pellet_distance = " + std::to_string(reward.pellet_distance) + ",\n"
+    "  .ghost_distance = " + std::to_string(reward.ghost_distance) + ",\n"
+    "  .ghost_distance_cap = " + std::to_string(reward.ghost_distance_cap) + "\n"
+    "}";
+}
+
 inline std::string pretty_config(const Config &config) {
   return
     "pacman_rl.Config{\n"
@@ -57,7 +72,14 @@ inline std::string pretty_config(const Config &config) {
     "  .clyde_target_switch_distance = " + std::to_string(config.clyde_target_switch_distance) + ",\n"
     "  .pellet_points = " + std::to_string(config.pellet_points) + ",\n"
     "  .power_pellet_points = " + std::to_string(config.power_pellet_points) + ",\n"
-    "  .power_pellet_steps = " + std::to_string(config.power_pellet_steps) + "\n"
+    "  .power_pellet_steps = " + std::to_string(config.power_pellet_steps) + ",\n"
+    "  .pacman_count = " + std::to_string(config.pacman_count) + ",\n"
+    "  .ghost_count = " + std::to_string(config.ghost_count) + ",\n"
+    "  .ghost_release_interval = " + std::to_string(config.ghost_release_interval) + ",\n"
+    "  .max_rows = " + std::to_string(config.max_rows) + ",\n"
+    "  .max_cols = " + std::to_string(config.max_cols) + ",\n"
+    "  .render_fps = " + std::to_string(config.render_fps) + ",\n"
+    "  .reward = " + pretty_reward_config(config.reward) + "\n"
     "}";
 }
 
@@ -67,7 +89,10 @@ inline std::string pretty_state(const State &state) {
     "  .step_index = " + std::to_string(state.step_index) + ",\n"
     "  .score = " + std::to_string(state.score) + ",\n"
     "  .lives = " + std::to_string(state.lives) + ",\n"
+    "  .pellets_eaten = " + std::to_string(state.pellets_eaten) + ",\n"
     "  .completed = " + std::string(state.completed ? "true" : "false") + ",\n"
+    "  .reward = " + std::to_string(state.reward) + ",\n"
+    "  .hash = " + std::to_string(state.hash) + ",\n"
     "  .pacman_location = " + pretty_location(state.pacman_location) + ",\n"
     "  .blinky_location = " + pretty_location(state.blinky_location) + ",\n"
     "  .pinky_location = " + pretty_location(state.pinky_location) + ",\n"
@@ -82,34 +107,11 @@ inline std::string pretty_state(const State &state) {
   return result;
 }
 
-// class Environment {
-//   private:
-//     Config config;
-//     State state;
-//     Grid grid;
-    
-//     std::unique_ptr<Pacman> pacman;
-//     std::unique_ptr<Blinky> blinky;
-//     std::unique_ptr<Pinky> pinky;
-//     std::unique_ptr<Inky> inky;
-//     std::unique_ptr<Clyde> clyde;
-//     std::vector<std::unique_ptr<Entity>> entities;
-//     std::vector<std::pair<i32, Entity*>> grid_storage;
-    
-//     AsciiRenderer ascii_renderer;
-
-//     Location initial_pacman_location = {};
-
-inline std::string pretty_environment(const PacmanEnvironment &env) {
+inline std::string pretty_environment(const EnvironmentBase &env) {
   return
     "pacman_rl.Environment{\n"
-    "  .config = " + pretty_config(env.config) + ",\n"
-    "  .state = " + pretty_state(env.state) + ",\n"
-    // "  .pacman = " + env.pacman->to_string() + ",\n"
-    // "  .blinky = " + env.blinky->to_string() + ",\n"
-    // "  .pinky = " + env.pinky->to_string() + ",\n"
-    // "  .inky = " + env.inky->to_string() + ",\n"
-    // "  .clyde = " + env.clyde->to_string() + "\n"
+    "  .config = " + pretty_config(env.get_config()) + ",\n"
+    "  .state = " + pretty_state(env.get_state()) + ",\n"
     "}";
 }
 
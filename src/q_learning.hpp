@@ -0,0 +1,369 @@
+#ifndef HEADER_Q_LEARNING_H
+#define HEADER_Q_LEARNING_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "environment.hpp"
+#include "random.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "pacman/constants.hpp"
+#include "pacman/entity.hpp"
+#include "pacman/zobrist.hpp"
+
+// Key of a state in a Q-table: the locations of all actors, the ghost modes and the remaining
+// pellets. It is State::hash without the actor directions, mode timers and lives, so that
+// states differing only in those share their values, which keeps tables of small mazes small.
+inline u64 q_state_key(const State &state, const Actors &actors) {
+  u64 key = state.hash ^ zobrist_actors_hash(actors) ^ zobrist_key(ZobristFeature::lives, 0, state.lives);
+  for (i32 actor = 0; actor < actors.count; ++actor) {
+    const Location &location = actors.locations[actor];
+    key ^= zobrist_key(ZobristFeature::location, actor, (i64)location.x << 24 ^ location.y);
+    if (actor >= actors.first_ghost)
+      key ^= zobrist_key(ZobristFeature::mode, actor, (i64)actors.modes[actor]);
+  }
+  return key;
+}
+
+// Action values of hashed states, split into shards by key, each an open addressing table with
+// its own lock, so that threads updating different states rarely wait for each other. States
+// that were never updated have `initial_value` for every action.
+class QTable {
+  public:
+    static constexpr i32 actions = 4;
+    using Values = std::array<f32, actions>;
+
+  private:
+    // Key 0 marks an empty slot, so a state with key 0 is stored as 1
+    struct Shard {
+      std::mutex mutex;
+      std::vector<u64> keys;
+      std::vector<Values> values;
+      i64 size = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    f32 initial_value;
+
+  public:
+    explicit QTable(i32 shards = 64, f32 initial_value = 0):
+      initial_value(initial_value) {
+      if (shards < 1)
+        throw std::runtime_error("QTable requires at least one shard.");
+      for (i32 i = 0; i < shards; ++i) {
+        this->shards.push_back(std::make_unique<Shard>());
+        this->shards.back()->keys.assign(64, 0);
+        this->shards.back()->values.resize(64);
+      }
+    }
+
+    Values get(u64 key) const {
+      key = std::max<u64>(key, 1);
+      Shard &shard = shard_of(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const i64 slot = find(shard, key);
+      if (shard.keys[slot] == 0)
+        return filled(initial_value);
+      return shard.values[slot];
+    }
+
+    // Moves the value of (key, action) towards target by learning_rate
+    void update(u64 key, i32 action, f32 target, f32 learning_rate) {
+      key = std::max<u64>(key, 1);
+      Shard &shard = shard_of(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      i64 slot = find(shard, key);
+      if (shard.keys[slot] == 0) {
+        if (2 * (shard.size + 1) > (i64)shard.keys.size()) {
+          grow(shard);
+          slot = find(shard, key);
+        }
+        shard.keys[slot] = key;
+        shard.values[slot] = filled(initial_value);
+        shard.size += 1;
+      }
+      f32 &value = shard.values[slot][action];
+      value += learning_rate * (target - value);
+    }
+
+    // Number of states with values
+    i64 size() const {
+      i64 total = 0;
+      for (const auto &shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->size;
+      }
+      return total;
+    }
+
+    // Fills `keys` and the rows x actions `values` with every state, shard after shard. All shards
+    // are locked for the whole copy, always in the same order, so the output is sized for exactly
+    // the states it holds even while other threads keep training
+    void export_to(std::vector<u64> &keys, std::vector<f32> &values) const {
+      std::vector<std::unique_lock<std::mutex>> locks;
+      i64 size = 0;
+      for (const auto &shard: shards) {
+        locks.emplace_back(shard->mutex);
+        size += shard->size;
+      }
+      keys.resize(size);
+      values.resize(size * actions);
+
+      i64 row = 0;
+      for (const auto &shard: shards)
+        for (u64 slot = 0; slot < shard->keys.size(); ++slot)
+          if (shard->keys[slot] != 0) {
+            keys[row] = shard->keys[slot];
+            std::copy(shard->values[slot].begin(), shard->values[slot].end(), values.begin() + row * actions);
+            row += 1;
+          }
+    }
+
+    void clear() {
+      for (const auto &shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        std::fill(shard->keys.begin(), shard->keys.end(), 0);
+        shard->size = 0;
+      }
+    }
+
+    i32 get_shards() const {
+      return (i32)shards.size();
+    }
+
+    f32 get_initial_value() const {
+      return initial_value;
+    }
+
+  private:
+    static Values filled(f32 value) {
+      Values values;
+      values.fill(value);
+      return values;
+    }
+
+    // Shards are picked by the high bits of the key and slots by the low ones
+    Shard& shard_of(u64 key) const {
+      return *shards[(key >> 32) % shards.size()];
+    }
+
+    // Slot of key, or the empty slot where it would go
+    static i64 find(const Shard &shard, u64 key) {
+      const u64 mask = shard.keys.size() - 1;
+      u64 slot = key & mask;
+      while (shard.keys[slot] != 0 and shard.keys[slot] != key)
+        slot = (slot + 1) & mask;
+      return slot;
+    }
+
+    static void grow(Shard &shard) {
+      std::vector<u64> keys(shard.keys.size() * 2, 0);
+      std::vector<Values> values(shard.values.size() * 2);
+      std::swap(keys, shard.keys);
+      std::swap(values, shard.values);
+      for (u64 slot = 0; slot < keys.size(); ++slot)
+        if (keys[slot] != 0) {
+          const i64 to = find(shard, keys[slot]);
+          shard.keys[to] = keys[slot];
+          shard.values[to] = values[slot];
+        }
+    }
+};
+
+struct QLearningConfig {
+  f32 learning_rate = 0.1f;
+  f32 discount = 0.99f;
+
+  // Exploration rate of episode i is max(epsilon_min, epsilon * epsilon_decay^i)
+  f32 epsilon = 1.0f;
+  f32 epsilon_min = 0.05f;
+  f32 epsilon_decay = 0.999f;
+
+  f32 initial_value = 0;
+  i32 shards = 64;
+};
+
+// One point of the learning curve
+struct QLearningEpisode {
+  i64 episode = 0;
+  f32 epsilon = 0;
+  i32 score = 0;
+  i32 length = 0;
+  f32 reward = 0;
+};
+
+// Tabular Q-learning with an epsilon-greedy policy, run directly against the environment. Every
+// thread plays its own environment and all of them update one shared QTable (states are keyed
+// by q_state_key()). Episodes are numbered in the order they start, which sets their epsilon and
+// their place in the learning curve.
+//
+// Rewards are State::reward, so they follow Config::reward. Episodes end by losing all lives,
+// by eating every pellet (where the environment itself would keep going) or at
+// max_episode_steps. The first two are terminal. Episodes cut off by max_episode_steps are not,
+// and their last update still bootstraps from the next state.
+//
+// With one thread, training is deterministic for a given seed. With more, the order of updates
+// to the shared table depends on scheduling.
+template <typename Environment = PacmanEnvironment>
+class QLearningTrainerT {
+  private:
+    struct Worker {
+      Environment env;
+      Random random;
+      std::vector<QLearningEpisode> curve;
+
+      Worker(const Config &config, u64 seed):
+        env(config),
+        random(seed)
+      { }
+    };
+
+    Config config;
+    QLearningConfig q_config;
+    QTable table;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<QLearningEpisode> curve;
+    i64 episodes = 0;
+
+  public:
+    // Zero threads means one per hardware thread
+    QLearningTrainerT(const Config &config, const QLearningConfig &q_config = {}, i32 threads = 0, u64 seed = 0):
+      config(config),
+      q_config(q_config),
+      table(q_config.shards, q_config.initial_value) {
+      if (q_config.learning_rate <= 0 or q_config.learning_rate > 1)
+        throw std::runtime_error("Learning rate must be in (0, 1].");
+      if (q_config.discount < 0 or q_config.discount > 1)
+        throw std::runtime_error("Discount must be in [0, 1].");
+
+      if (threads != 1) {
+        pool = std::make_unique<ThreadPool>(threads);
+        if (pool->size() == 1)
+          pool.reset();
+      }
+      const i32 count = pool == nullptr ? 1 : pool->size();
+      for (i32 i = 0; i < count; ++i)
+        workers.push_back(std::make_unique<Worker>(config, seed + i));
+    }
+
+    // Plays and learns from `n` more episodes
+    void train(i64 n) {
+      TRACE_SCOPE("q_learning.train", "q_learning");
+      if (n < 0)
+        throw std::runtime_error("Number of episodes must be non-negative.");
+
+      const i64 end = episodes + n;
+      std::atomic<i64> next = episodes;
+      auto work = [&] (Worker &worker) {
+        for (i64 episode = next++; episode < end; episode = next++)
+          worker.curve.push_back(play(worker, episode));
+      };
+      if (pool == nullptr)
+        work(*workers[0]);
+      else
+        pool->parallel_for((i32)workers.size(), [&] (i32 index, i32) { work(*workers[index]); });
+      episodes = end;
+
+      // Episodes are appended in the order they started
+      const u64 first = curve.size();
+      for (auto &worker: workers) {
+        curve.insert(curve.end(), worker->curve.begin(), worker->curve.end());
+        worker->curve.clear();
+      }
+      std::sort(curve.begin() + first, curve.end(), [] (const QLearningEpisode &a, const QLearningEpisode &b) {
+        return a.episode < b.episode;
+      });
+    }
+
+    // Greedy action of a state, ties going to the first direction
+    MovementDirection act(const State &state, const Actors &actors) const {
+      return static_cast<MovementDirection>(best_action(table.get(q_state_key(state, actors))));
+    }
+
+    f32 get_epsilon(i64 episode) const {
+      return std::max(q_config.epsilon_min, q_config.epsilon * std::pow(q_config.epsilon_decay, (f32)episode));
+    }
+
+    const QTable& get_table() const {
+      return table;
+    }
+
+    const std::vector<QLearningEpisode>& get_curve() const {
+      return curve;
+    }
+
+    i64 get_episodes() const {
+      return episodes;
+    }
+
+    i32 get_threads() const {
+      return (i32)workers.size();
+    }
+
+    const Config& get_config() const {
+      return config;
+    }
+
+    const QLearningConfig& get_q_config() const {
+      return q_config;
+    }
+
+  private:
+    static i32 best_action(const QTable::Values &values) {
+      return (i32)(std::max_element(values.begin(), values.end()) - values.begin());
+    }
+
+    QLearningEpisode play(Worker &worker, i64 episode) {
+      TRACE_SCOPE("q_learning.episode", "q_learning");
+      Environment &env = worker.env;
+      const State &state = env.get_state_ref();
+      QLearningEpisode result;
+      result.episode = episode;
+      result.epsilon = get_epsilon(episode);
+
+      env.reset();
+      u64 key = q_state_key(state, env.get_actors());
+      QTable::Values values = table.get(key);
+      while (not state.completed) {
+        const i32 action = worker.random.bernoulli(result.epsilon) ? (i32)worker.random.uniform(QTable::actions) : best_action(values);
+        const i32 score = state.score;
+        env.advance(static_cast<MovementDirection>(action));
+
+        const u64 next_key = q_state_key(state, env.get_actors());
+        const bool terminal = state.lives <= 0 or env.get_pellets_remaining() == 0;
+        f32 target = state.reward;
+        if (not terminal) {
+          values = table.get(next_key);
+          target += q_config.discount * values[best_action(values)];
+        }
+        table.update(key, action, target, q_config.learning_rate);
+        if (not terminal and next_key == key)
+          values = table.get(key);
+        key = next_key;
+
+        result.score += state.score - score;
+        result.length += 1;
+        result.reward += state.reward;
+
+        // The environment keeps running after the maze is cleared, the episode does not
+        if (terminal)
+          break;
+      }
+      return result;
+    }
+};
+
+using QLearningTrainer = QLearningTrainerT<PacmanEnvironment>;
+using QLearningTrainer21x19 = QLearningTrainerT<PacmanEnvironment21x19>;
+
+#endif // HEADER_Q_LEARNING_H
@@ -0,0 +1,59 @@
+#ifndef HEADER_RANDOM_H
+#define HEADER_RANDOM_H
+#pragma once
+
+#include "types.hpp"
+
+// xoshiro256** seeded through splitmix64. Much cheaper than std::mt19937 and, unlike rand(),
+// every instance has its own state so generators can be used from several threads at once.
+class Random {
+  private:
+    u64 s[4];
+
+    static constexpr u64 rotl(u64 x, i32 k) {
+      return (x << k) | (x >> (64 - k));
+    }
+
+  public:
+    explicit Random(u64 seed = 0) {
+      this->seed(seed);
+    }
+
+    void seed(u64 seed) {
+      for (u64 &x: s) {
+        seed += 0x9e3779b97f4a7c15ull;
+        u64 z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        x = z ^ (z >> 31);
+      }
+    }
+
+    u64 next() {
+      const u64 result = rotl(s[1] * 5, 7) * 9;
+      const u64 t = s[1] << 17;
+      s[2] ^= s[0];
+      s[3] ^= s[1];
+      s[1] ^= s[2];
+      s[0] ^= s[3];
+      s[2] ^= t;
+      s[3] = rotl(s[3], 45);
+      return result;
+    }
+
+    // Uniform integer in [0, n) using Lemire's multiply-shift reduction
+    u32 uniform(u32 n) {
+      return (u32)(((next() >> 32) * (u64)n) >> 32);
+    }
+
+    // Uniform float in [0, 1)
+    f32 uniform_real() {
+      return (f32)(next() >> 40) * 0x1.0p-24f;
+    }
+
+    bool bernoulli(f32 p) {
+      return uniform_real() < p;
+    }
+};
+
+#endif // HEADER_RANDOM_H
@@ -0,0 +1,149 @@
+#ifndef RENDER_ANSI_RENDERER_H
+#define RENDER_ANSI_RENDERER_H
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if not defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "constants.hpp"
+#include "types.hpp"
+#include "pacman/state.hpp"
+
+// Terminal renderer that keeps the previous frame and only redraws the cells that changed,
+// using ANSI cursor positioning. A frame is assembled in one buffer and written with a single
+// write(), which avoids flicker and keeps the traffic low over SSH.
+//
+// The layout matches AsciiRenderer: three lines of lives/step/score, a blank line, the grid.
+class AnsiRenderer {
+  private:
+    bool colors;
+    std::vector<std::string> previous;
+    std::string buffer;
+
+    // Cursor and color at the end of the bytes already in the buffer, to skip redundant escapes
+    i32 cursor_row = -1;
+    i32 cursor_col = -1;
+    i32 current_color = -1;
+
+    static constexpr i32 grid_row_offset = 5;
+
+    // SGR color code per entity type
+    static constexpr std::array<i32, entity_type_count> entity_type_colors = {
+      91, // blinky
+      95, // pinky
+      96, // inky
+      33, // clyde
+      93, // pacman
+      34, // wall
+      90, // gate
+      37, // pellet
+      97, // power_pellet
+      0,  // none
+    };
+
+  public:
+    explicit AnsiRenderer(bool colors = false):
+      colors(colors)
+    { }
+
+    void render(const State &state) {
+      buffer.clear();
+
+      const i32 rows = (i32)state.grid.size();
+      const i32 cols = rows > 0 ? (i32)state.grid[0].size() : 0;
+      bool full_redraw = (i32)previous.size() != rows or (rows > 0 and (i32)previous[0].size() != cols);
+      if (full_redraw) {
+        // Clear the screen and hide the cursor
+        buffer += "\x1b[2J\x1b[?25l";
+        previous.assign(rows, std::string(cols, '\0'));
+        cursor_row = cursor_col = current_color = -1;
+      }
+
+      set_color(0);
+      move_to(1, 1);
+      buffer += "Lives: " + std::to_string(state.lives) + "\x1b[K\n";
+      buffer += " Step: " + std::to_string(state.step_index) + "\x1b[K\n";
+      buffer += "Score: " + std::to_string(state.score) + "\x1b[K\n";
+      cursor_row = 4;
+      cursor_col = 1;
+
+      for (i32 x = 0; x < rows; ++x) {
+        const std::string &row = state.grid[x];
+        std::string &previous_row = previous[x];
+        for (i32 y = 0; y < cols; ++y) {
+          char c = row[y];
+          if (c == previous_row[y])
+            continue;
+          move_to(x + grid_row_offset, y + 1);
+          if (colors)
+            set_color(entity_type_colors[(u8)char_to_entity_type_unchecked(c)]);
+          buffer += c;
+          cursor_col += 1;
+          previous_row[y] = c;
+        }
+      }
+
+      set_color(0);
+      flush();
+    }
+
+    void close() const {
+      if (previous.empty())
+        return;
+      // Reset colors, show the cursor again and leave it below the frame
+      std::string epilogue = "\x1b[0m\x1b[?25h\x1b[" + std::to_string((i32)previous.size() + grid_row_offset) + ";1H\n";
+      write_all(epilogue);
+    }
+
+  private:
+    void move_to(i32 row, i32 col) {
+      if (row == cursor_row and col == cursor_col)
+        return;
+      buffer += "\x1b[" + std::to_string(row) + ";" + std::to_string(col) + "H";
+      cursor_row = row;
+      cursor_col = col;
+    }
+
+    void set_color(i32 color) {
+      if (color == current_color)
+        return;
+      buffer += "\x1b[" + std::to_string(color) + "m";
+      current_color = color;
+    }
+
+    void flush() {
+      // Anything printed through std::cout before this frame must come out first
+      std::cout.flush();
+      write_all(buffer);
+    }
+
+    static void write_all(const std::string &data) {
+#if defined(_WIN32)
+      std::fwrite(data.data(), 1, data.size(), stdout);
+      std::fflush(stdout);
+#else
+      std::fflush(stdout);
+      const char *begin = data.data();
+      size_t remaining = data.size();
+      while (remaining > 0) {
+        ssize_t written = ::write(STDOUT_FILENO, begin, remaining);
+        if (written < 0 and errno == EINTR)
+          continue;
+        if (written <= 0)
+          break;
+        begin += written;
+        remaining -= written;
+      }
+#endif
+    }
+};
+
+#endif // RENDER_ANSI_RENDERER_H
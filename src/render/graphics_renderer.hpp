@@ -2,8 +2,8 @@
 #define RENDER_GRAPHICS_RENDERER_H
 #pragma once
 
-#include <algorithm>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 #include "raylib.h"
@@ -15,72 +15,203 @@
 
 #define LIGHTBLACK (Color{24, 24, 24, 255})
 
+// raylib only reads the framebuffer into a new allocation (LoadImageFromScreen), so frames that are
+// read every step go through glReadPixels directly. It is part of OpenGL 1.1, which the GL library
+// raylib links against exports on every platform. Declared here since the system GL headers clash
+// with raylib on Windows
+#if defined(_WIN32) && !defined(_WIN64)
+#define PACMAN_GL_CALL __stdcall
+#else
+#define PACMAN_GL_CALL
+#endif
+
+extern "C" void PACMAN_GL_CALL glReadPixels(int x, int y, int width, int height, unsigned int format, unsigned int type, void *pixels);
+
+// Reads the last frame drawn to the window as RGBA pixels into `rgba`, which is only reallocated
+// when the window size changes. Rows are bottom-up, as OpenGL stores them
+inline void read_screen_pixels(std::vector<u8> &rgba, i32 &width, i32 &height) {
+  constexpr unsigned int gl_rgba = 0x1908;
+  constexpr unsigned int gl_unsigned_byte = 0x1401;
+
+  width = GetRenderWidth();
+  height = GetRenderHeight();
+  rgba.resize((u64)width * height * 4);
+  glReadPixels(0, 0, width, height, gl_rgba, gl_unsigned_byte, rgba.data());
+}
+
+// Draws walls and gates once per map into a texture. Each frame then blits that texture, draws
+// the remaining pellets from the pellet mask and draws the actors on top. Every renderer keeps
+// its own texture, while the window is shared by all renderers of the process.
 class GraphicsRenderer {
   private:
-    i32 window_height = -1;
-    i32 window_width = -1;
+    // There is a single window per process, shared by every renderer that has drawn into it and
+    // closed when the last of them is closed
+    inline static i32 window_users = 0;
+    inline static i32 window_height = -1;
+    inline static i32 window_width = -1;
+    inline static i32 window_target_fps = 0;
 
     i32 grid_height = -1;
     i32 grid_width = -1;
 
-    std::vector<std::pair<Location, EntityType>> entities;
+    // close() is const in the Environment interface, so the resources it releases are mutable
+    mutable RenderTexture2D static_layer = {};
+    u64 static_layer_version = 0;
+    mutable bool is_static_layer_loaded = false;
 
-    bool is_window_initialized = false;
+    mutable bool uses_window = false;
 
     static constexpr i32 cell_size = 30;
     static constexpr i32 padding = 128;
   
   public:
-    void render(const State &state) {
-      [[maybe_unused]] static auto _ = [&] {
-        grid_height = static_cast<int>(state.grid.size());
-        grid_width = static_cast<int>(state.grid[0].size());
-
-        window_height = grid_height * cell_size + 2 * padding;
-        window_width = grid_width * cell_size + 2 * padding;
+    GraphicsRenderer() = default;
+
+    // The texture and the share of the window belong to one renderer, so it can only be moved,
+    // and the moved-from renderer no longer releases them on close()
+    GraphicsRenderer(const GraphicsRenderer &) = delete;
+    GraphicsRenderer& operator=(const GraphicsRenderer &) = delete;
+
+    GraphicsRenderer(GraphicsRenderer &&other) noexcept:
+      grid_height(other.grid_height),
+      grid_width(other.grid_width),
+      static_layer(other.static_layer),
+      static_layer_version(other.static_layer_version),
+      is_static_layer_loaded(std::exchange(other.is_static_layer_loaded, false)),
+      uses_window(std::exchange(other.uses_window, false))
+    { }
+
+    GraphicsRenderer& operator=(GraphicsRenderer &&other) noexcept {
+      if (this == &other)
+        return *this;
+      close();
+      grid_height = other.grid_height;
+      grid_width = other.grid_width;
+      static_layer = other.static_layer;
+      static_layer_version = other.static_layer_version;
+      is_static_layer_loaded = std::exchange(other.is_static_layer_loaded, false);
+      uses_window = std::exchange(other.uses_window, false);
+      return *this;
+    }
 
-        entities.reserve(grid_height * grid_width);
+    // Frames are capped at target_fps, or uncapped with zero. The cap is set on the shared window,
+    // so the renderer that draws last decides it
+    void render(const State &state, const RenderLayers &layers, i32 target_fps = 0) {
+      if (not uses_window) {
+        if (window_users == 0) {
+          resize(layers.rows, layers.cols);
+
+          SetTraceLogLevel(LOG_WARNING);
+          InitWindow(window_width, window_height, "Pacman RL");
+          window_target_fps = -1;
+        }
+        ++window_users;
+        uses_window = true;
+      }
 
-        SetTraceLogLevel(LOG_WARNING);
-        InitWindow(window_width, window_height, "Pacman RL");
-        SetTargetFPS(60);
+      // The map can change between resets, see PacmanEnvironment::reset(map_id), and renderers
+      // sharing the window may draw maps of different sizes
+      if (layers.rows != grid_height or layers.cols != grid_width) {
+        const i32 height = window_height, width = window_width;
+        resize(layers.rows, layers.cols);
+        if (window_height != height or window_width != width)
+          SetWindowSize(window_width, window_height);
+      }
 
-        is_window_initialized = true;
+      if (target_fps != window_target_fps) {
+        SetTargetFPS(target_fps);
+        window_target_fps = target_fps;
+      }
 
-        return 0;
-      }();
+      if (not is_static_layer_loaded or static_layer_version != layers.layout_version)
+        draw_static_layer(layers);
 
-      entities.clear();
-      for (i32 i = 0; i < grid_height; ++i)
-        for (i32 j = 0; j < grid_width; ++j)
-          entities.emplace_back(Location{i, j}, char_to_entity_type(state.grid[i][j]));
-      std::sort(entities.begin(), entities.end(), [](const auto &a, const auto &b) {
-        return entity_type_render_precedence(a.second) < entity_type_render_precedence(b.second);
-      });
+      const i32 origin_x = window_width / 2 - grid_width * cell_size / 2;
+      const i32 origin_y = window_height / 2 - grid_height * cell_size / 2;
       
       BeginDrawing();
       ClearBackground(LIGHTBLACK);
 
+      // Render textures are stored bottom-up, hence the negative source height
+      DrawTextureRec(
+        static_layer.texture,
+        Rectangle{0, 0, (f32)static_layer.texture.width, -(f32)static_layer.texture.height},
+        Vector2{(f32)origin_x, (f32)origin_y},
+        WHITE
+      );
+
+      const i32 words = (grid_height * grid_width + 63) / 64;
+      for (i32 word = 0; word < words; ++word)
+        for (u64 bits = layers.pellet_mask[word]; bits != 0; bits &= bits - 1) {
+          i32 index = word * 64 + __builtin_ctzll(bits);
+          i32 x = index / grid_width, y = index % grid_width;
+          ::draw_entity(layers.tiles[index], origin_x + y * cell_size, origin_y + x * cell_size, cell_size);
+        }
+
+      // Walls and gates take precedence over actors, as in State::grid
+      for (i32 i = 0; i < layers.actor_count; ++i) {
+        const Location &location = layers.actor_locations[i];
+        EntityType tile = layers.tiles[location.x * grid_width + location.y];
+        if (tile == EntityType::wall or tile == EntityType::gate)
+          continue;
+        ::draw_entity(layers.actor_types[i], origin_x + location.y * cell_size, origin_y + location.x * cell_size, cell_size);
+      }
+
       DrawText(TextFormat("Lives: %d", state.lives), 10, 10, 20, GREEN);
       DrawText(TextFormat("Step: %d", state.step_index), 10, 40, 20, GREEN);
       DrawText(TextFormat("Score: %d", state.score), 10, 70, 20, GREEN);
       DrawFPS(10, 100);
 
-      for (const auto &[location, entity_type]: entities) {
-        i32 pos_x = window_width / 2 - grid_width * cell_size / 2 + location.y * cell_size;
-        i32 pos_y = window_height / 2 - grid_height * cell_size / 2 + location.x * cell_size;
-        ::draw_entity(entity_type, pos_x, pos_y, cell_size);
-      }
-
       EndDrawing();
     }
 
     void close() const {
-      if (is_window_initialized)
-        CloseWindow();
+      if (is_static_layer_loaded) {
+        UnloadRenderTexture(static_layer);
+        is_static_layer_loaded = false;
+      }
+      if (uses_window) {
+        uses_window = false;
+        if (--window_users == 0)
+          CloseWindow();
+      }
+    }
+
+  private:
+    void resize(i32 height, i32 width) {
+      grid_height = height;
+      grid_width = width;
+      window_height = grid_height * cell_size + 2 * padding;
+      window_width = grid_width * cell_size + 2 * padding;
+    }
+
+    void draw_static_layer(const RenderLayers &layers) {
+      const i32 width = grid_width * cell_size;
+      const i32 height = grid_height * cell_size;
+      if (is_static_layer_loaded and (static_layer.texture.width != width or static_layer.texture.height != height)) {
+        UnloadRenderTexture(static_layer);
+        is_static_layer_loaded = false;
+      }
+      if (not is_static_layer_loaded) {
+        static_layer = LoadRenderTexture(width, height);
+        is_static_layer_loaded = true;
+      }
+
+      BeginTextureMode(static_layer);
+      ClearBackground(LIGHTBLACK);
+      for (i32 x = 0; x < grid_height; ++x)
+        for (i32 y = 0; y < grid_width; ++y) {
+          EntityType tile = layers.tiles[x * grid_width + y];
+          if (tile == EntityType::wall or tile == EntityType::gate)
+            ::draw_entity(tile, y * cell_size, x * cell_size, cell_size);
+        }
+      EndTextureMode();
+
+      static_layer_version = layers.layout_version;
     }
 };
 
 #undef LIGHTBLACK
+#undef PACMAN_GL_CALL
 
 #endif // RENDER_GRAPHICS_RENDERER_H
@@ -0,0 +1,96 @@
+#ifndef RENDER_IMAGE_EXPORTER_H
+#define RENDER_IMAGE_EXPORTER_H
+#pragma once
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "raylib.h"
+
+#include "constants.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "render_utils.hpp"
+
+// Writes many grids (e.g. a trajectory of State::grid) as PNG files. Drawing and PNG encoding
+// both run on the CPU, so the exporter needs no window or GL context at all. Every worker thread
+// owns an image and a draw list that are reused for all frames of the same size.
+class ImageExporter {
+  private:
+    struct Slot {
+      Image image = {};
+      std::vector<std::pair<Location, EntityType>> entities;
+    };
+
+    i32 cell_size;
+    i32 padding;
+    ThreadPool pool;
+    std::vector<Slot> slots;
+
+  public:
+    // Zero threads means one per hardware thread
+    explicit ImageExporter(i32 threads = 0, i32 cell_size = 30, i32 padding = 4):
+      cell_size(cell_size),
+      padding(padding),
+      pool(threads),
+      slots(pool.size()) {
+      SetTraceLogLevel(LOG_WARNING);
+    }
+
+    ImageExporter(const ImageExporter &) = delete;
+    ImageExporter& operator=(const ImageExporter &) = delete;
+
+    ~ImageExporter() {
+      for (Slot &slot: slots)
+        if (slot.image.data != nullptr)
+          UnloadImage(slot.image);
+    }
+
+    i32 get_threads() const {
+      return pool.size();
+    }
+
+    // Writes grids[i] to filenames[i]
+    void export_grids(const std::vector<std::vector<std::string>> &grids, const std::vector<std::string> &filenames) {
+      if (grids.size() != filenames.size())
+        throw std::runtime_error("export_grids() expects one filename per grid.");
+
+      TRACE_SCOPE("export.batch", "export");
+      pool.parallel_for((i32)grids.size(), [&] (i32 index, i32 slot) {
+        export_grid(slots[slot], grids[index], filenames[index]);
+      });
+    }
+
+    // Writes grids[i] to `directory`/%08d.png with first_index + i, the naming used by
+    // RecordVideoEnvironment for its screenshots
+    void export_grids(const std::vector<std::vector<std::string>> &grids, const std::string &directory, i32 first_index = 0) {
+      TRACE_SCOPE("export.batch", "export");
+      pool.parallel_for((i32)grids.size(), [&] (i32 index, i32 slot) {
+        char filename[32];
+        std::snprintf(filename, sizeof(filename), "/%08d.png", first_index + index);
+        export_grid(slots[slot], grids[index], directory + filename);
+      });
+    }
+
+  private:
+    void export_grid(Slot &slot, const std::vector<std::string> &grid, const std::string &filename) {
+      TRACE_SCOPE("export.frame", "export");
+
+      auto [width, height] = grid_image_size(grid, cell_size, padding);
+      if (slot.image.data == nullptr or slot.image.width != width or slot.image.height != height) {
+        if (slot.image.data != nullptr)
+          UnloadImage(slot.image);
+        slot.image = GenImageColor(width, height, BLACK);
+      }
+
+      draw_grid(&slot.image, grid, slot.entities, cell_size, padding);
+      if (not ExportImage(slot.image, filename.c_str()))
+        throw std::runtime_error("Could not write " + filename + ".");
+    }
+};
+
+#endif // RENDER_IMAGE_EXPORTER_H
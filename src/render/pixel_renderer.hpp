@@ -0,0 +1,254 @@
+#ifndef RENDER_PIXEL_RENDERER_H
+#define RENDER_PIXEL_RENDERER_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+#include "raylib.h"
+
+#include "constants.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "render_utils.hpp"
+
+// Rasterizes frames on the CPU into caller-owned height x width x channels u8 buffers (channels
+// is 3 for RGB, 1 for grayscale), with the colors and shapes of draw_entity() but no padding.
+// Neither raylib nor a GL context is used for drawing, so renderers of different environments
+// can draw from different threads at the same time.
+//
+// The output size is fixed at construction and maps of any size are scaled to it: every output
+// pixel samples the pixel at its center in the rows * cell_size x cols * cell_size frame, so a
+// downscaled frame is drawn at its final size rather than resized afterwards. Walls and gates are
+// drawn once per map into a cached background, see RenderLayers::layout_version. Pellets are kept
+// in a second cached layer on top of it, where only the cells whose pellet was eaten (or came
+// back) since the last frame are redrawn. Each frame copies that layer and draws the actors.
+class PixelRenderer {
+  private:
+    i32 height;
+    i32 width;
+    i32 channels;
+    i32 cell_size;
+
+    // Map size the sampling below was built for
+    i32 rows = 0;
+    i32 cols = 0;
+
+    // Cell and pixel within the cell sampled by every output row and column, and the first output
+    // row (column) of every map row (column), with one more entry for the end
+    std::vector<i32> row_cells, row_offsets, row_begins;
+    std::vector<i32> col_cells, col_offsets, col_begins;
+
+    // cell_size x cell_size mask of every entity type, and its color in the output format
+    std::array<std::vector<u8>, entity_type_count> sprites;
+    std::array<std::array<u8, 3>, entity_type_count> colors;
+    std::array<u8, 3> background_color;
+
+    std::vector<u8> background;
+    u64 background_version = 0;
+
+    // Background with the pellets of pellet_mask drawn on top
+    std::vector<u8> pellet_layer;
+    std::vector<u64> pellet_mask;
+
+  public:
+    PixelRenderer(i32 height, i32 width, bool grayscale = false, i32 cell_size = 8):
+      height(height),
+      width(width),
+      channels(grayscale ? 1 : 3),
+      cell_size(cell_size) {
+      if (height < 1 or width < 1)
+        throw std::runtime_error("PixelRenderer requires a positive height and width.");
+      if (cell_size < 1)
+        throw std::runtime_error("PixelRenderer requires a positive cell size.");
+
+      for (i32 type = 0; type < entity_type_count; ++type) {
+        sprites[type] = sprite(static_cast<EntityType>(type));
+        colors[type] = convert(get_color_for_entity_type(static_cast<EntityType>(type)));
+      }
+      background_color = convert(get_background_color());
+      background.resize(frame_size());
+      pellet_layer.resize(frame_size());
+    }
+
+    i32 get_height() const {
+      return height;
+    }
+
+    i32 get_width() const {
+      return width;
+    }
+
+    i32 get_channels() const {
+      return channels;
+    }
+
+    i32 get_cell_size() const {
+      return cell_size;
+    }
+
+    // height x width x channels
+    i64 frame_size() const {
+      return (i64)height * width * channels;
+    }
+
+    // Draws the frame of `layers` into `out`, which must hold frame_size() values
+    void render(const RenderLayers &layers, u8 *out) {
+      TRACE_SCOPE("render.pixels", "render");
+
+      if (layers.rows != rows or layers.cols != cols) {
+        set_map_size(layers.rows, layers.cols);
+        background_version = 0;
+      }
+      if (background_version != layers.layout_version)
+        draw_background(layers);
+
+      for (i32 word = 0; word < (i32)pellet_mask.size(); ++word) {
+        for (u64 bits = pellet_mask[word] ^ layers.pellet_mask[word]; bits != 0; bits &= bits - 1) {
+          const i32 index = word * 64 + __builtin_ctzll(bits);
+          if ((layers.pellet_mask[word] >> (index & 63)) & 1)
+            draw_sprite(index / cols, index % cols, layers.tiles[index], pellet_layer.data());
+          else
+            erase_cell(index / cols, index % cols);
+        }
+        pellet_mask[word] = layers.pellet_mask[word];
+      }
+
+      std::copy(pellet_layer.begin(), pellet_layer.end(), out);
+
+      // Walls and gates take precedence over actors, as in State::grid
+      for (i32 i = 0; i < layers.actor_count; ++i) {
+        const Location &location = layers.actor_locations[i];
+        const EntityType tile = layers.tiles[location.x * cols + location.y];
+        if (tile == EntityType::wall or tile == EntityType::gate)
+          continue;
+        draw_sprite(location.x, location.y, layers.actor_types[i], out);
+      }
+    }
+
+  private:
+    std::array<u8, 3> convert(const Color &color) const {
+      if (channels == 3)
+        return {color.r, color.g, color.b};
+      const u8 gray = (u8)((299 * color.r + 587 * color.g + 114 * color.b + 500) / 1000);
+      return {gray, gray, gray};
+    }
+
+    // Same shapes as draw_entity(): full cells for walls and gates, and circles centered on the
+    // cell for the others
+    std::vector<u8> sprite(EntityType type) const {
+      std::vector<u8> mask(cell_size * cell_size, 0);
+      f32 radius = 0;
+      switch (type) {
+        case EntityType::wall:
+        case EntityType::gate:
+          std::fill(mask.begin(), mask.end(), 1);
+          return mask;
+
+        case EntityType::pellet:
+          radius = (f32)cell_size / 8;
+          break;
+
+        case EntityType::power_pellet:
+          radius = (f32)cell_size / 3;
+          break;
+
+        case EntityType::none:
+          return mask;
+
+        default:
+          radius = (f32)cell_size / 2;
+          break;
+      }
+
+      // Every shape covers at least the center pixel, so it shows up at any cell size
+      const f32 center = (f32)cell_size / 2;
+      radius = std::max(radius, 0.5f);
+      for (i32 y = 0; y < cell_size; ++y)
+        for (i32 x = 0; x < cell_size; ++x) {
+          const f32 dy = y + 0.5f - center, dx = x + 0.5f - center;
+          mask[y * cell_size + x] = dx * dx + dy * dy <= radius * radius;
+        }
+      return mask;
+    }
+
+    // Output pixel i samples pixel (2i + 1) * frame / (2 * size) of the full-size frame
+    static void sample(i32 size, i32 cells, i32 cell_size, std::vector<i32> &cell, std::vector<i32> &offset, std::vector<i32> &begins) {
+      const i64 frame = (i64)cells * cell_size;
+      cell.resize(size);
+      offset.resize(size);
+      begins.assign(cells + 1, size);
+      for (i32 i = size - 1; i >= 0; --i) {
+        const i64 pixel = (2 * (i64)i + 1) * frame / (2 * (i64)size);
+        cell[i] = (i32)(pixel / cell_size);
+        offset[i] = (i32)(pixel % cell_size);
+        begins[cell[i]] = i;
+      }
+
+      // Cells that no output pixel samples begin where the next one does
+      for (i32 c = cells - 1; c >= 0; --c)
+        begins[c] = std::min(begins[c], begins[c + 1]);
+    }
+
+    void set_map_size(i32 rows, i32 cols) {
+      this->rows = rows;
+      this->cols = cols;
+      sample(height, rows, cell_size, row_cells, row_offsets, row_begins);
+      sample(width, cols, cell_size, col_cells, col_offsets, col_begins);
+    }
+
+    void draw_background(const RenderLayers &layers) {
+      TRACE_SCOPE("render.pixels.background", "render");
+
+      for (i64 pixel = 0; pixel < (i64)height * width; ++pixel)
+        std::copy_n(background_color.begin(), channels, background.data() + pixel * channels);
+      for (i32 x = 0; x < rows; ++x)
+        for (i32 y = 0; y < cols; ++y) {
+          const EntityType tile = layers.tiles[x * cols + y];
+          if (tile == EntityType::wall or tile == EntityType::gate)
+            draw_sprite(x, y, tile, background.data());
+        }
+      background_version = layers.layout_version;
+
+      pellet_layer = background;
+      pellet_mask.assign((rows * cols + 63) / 64, 0);
+    }
+
+    // Restores the pixels of cell (x, y) in the pellet layer from the background
+    void erase_cell(i32 x, i32 y) {
+      const i64 begin = (i64)col_begins[y] * channels, end = (i64)col_begins[y + 1] * channels;
+      for (i32 row = row_begins[x]; row < row_begins[x + 1]; ++row) {
+        const i64 offset = (i64)row * width * channels;
+        std::copy(background.begin() + offset + begin, background.begin() + offset + end, pellet_layer.begin() + offset + begin);
+      }
+    }
+
+    void draw_sprite(i32 x, i32 y, EntityType type, u8 *out) const {
+      if (channels == 1)
+        draw_sprite<1>(x, y, type, out);
+      else
+        draw_sprite<3>(x, y, type, out);
+    }
+
+    // Output pixels of cell (x, y) where the sprite of `type` is set. The number of channels is
+    // a template parameter so that every pixel is written with fixed-size stores
+    template <i32 Channels>
+    void draw_sprite(i32 x, i32 y, EntityType type, u8 *out) const {
+      const u8 *mask = sprites[(u8)type].data();
+      const std::array<u8, 3> color = colors[(u8)type];
+      const i32 col_begin = col_begins[y], col_end = col_begins[y + 1];
+
+      for (i32 row = row_begins[x]; row < row_begins[x + 1]; ++row) {
+        const u8 *mask_row = mask + row_offsets[row] * cell_size;
+        u8 *pixel = out + ((i64)row * width + col_begin) * Channels;
+        for (i32 col = col_begin; col < col_end; ++col, pixel += Channels)
+          if (mask_row[col_offsets[col]])
+            for (i32 channel = 0; channel < Channels; ++channel)
+              pixel[channel] = color[channel];
+      }
+    }
+};
+
+#endif // RENDER_PIXEL_RENDERER_H
@@ -1,7 +1,9 @@
 #ifndef RENDER_UTILS_H
 #define RENDER_UTILS_H
 
+#include <array>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -39,6 +41,56 @@ inline Color get_color_for_entity_type(const EntityType type) {
   }
 }
 
+// Everything the renderers need from the environment to draw a frame, without going through
+// State::grid. All pointers are borrowed for the duration of render().
+struct RenderLayers {
+  i32 rows;
+  i32 cols;
+
+  // Changes whenever walls or gates may have changed, i.e. when the environment switches maps
+  u64 layout_version;
+
+  // Static tiles, row-major. Walls and gates are drawn from here, pellet types are read from here
+  const EntityType *tiles;
+
+  // One bit per cell that still holds a pellet or power pellet, see PacmanEnvironment::get_pellet_mask()
+  const u64 *pellet_mask;
+
+  // Actors in drawing order, i.e. Pacman last
+  const Location *actor_locations;
+  const EntityType *actor_types;
+  i32 actor_count;
+};
+
+inline constexpr i32 render_precedence_levels = 4;
+
+// Cells of the grid in drawing order, lowest render precedence first. There are only a few
+// precedence levels, so this is a counting sort rather than a comparison sort. Grids come from
+// callers, so they are checked to be rectangular and made of map characters.
+inline void build_draw_list(const std::vector<std::string> &grid, std::vector<std::pair<Location, EntityType>> &entities) {
+  if (grid.empty() or grid[0].empty())
+    throw std::runtime_error("Cannot draw an empty grid.");
+  const i32 grid_height = static_cast<int>(grid.size());
+  const i32 grid_width = static_cast<int>(grid[0].size());
+
+  std::array<i32, render_precedence_levels + 1> offsets = {};
+  for (const auto &row: grid) {
+    if ((i32)row.size() != grid_width)
+      throw std::runtime_error("All rows of a grid must have the same length.");
+    for (char c: row)
+      offsets[entity_type_render_precedence(char_to_entity_type(c)) + 1] += 1;
+  }
+  for (i32 level = 0; level < render_precedence_levels; ++level)
+    offsets[level + 1] += offsets[level];
+
+  entities.resize(grid_height * grid_width);
+  for (i32 i = 0; i < grid_height; ++i)
+    for (i32 j = 0; j < grid_width; ++j) {
+      EntityType type = char_to_entity_type_unchecked(grid[i][j]);
+      entities[offsets[entity_type_render_precedence(type)]++] = {Location{i, j}, type};
+    }
+}
+
 inline void draw_entity(const EntityType type, const i32 pos_x, const i32 pos_y, const i32 cell_size) {
   switch (type) {
     case EntityType::blinky:
@@ -95,49 +147,52 @@ inline void draw_entity(Image *image, const EntityType type, const i32 pos_x, co
   }
 }
 
-inline void render_grid_to_png(const std::vector<std::string> &grid, const std::string &filename = "tmp.png", const i32 cell_size = 30.0f, const i32 padding = 4.0f) {
+// Draws the grid into `image`, which must be sized for it (see grid_image_size()). `entities` is
+// scratch space for the draw list so that it can be reused across calls.
+//
+// Only touches the image's pixels on the CPU: no window or GL context is needed, and different
+// images can be drawn from different threads at the same time.
+inline void draw_grid(Image *image, const std::vector<std::string> &grid, std::vector<std::pair<Location, EntityType>> &entities, const i32 cell_size, const i32 padding) {
   const i32 grid_height = static_cast<int>(grid.size());
   const i32 grid_width = static_cast<int>(grid[0].size());
   const i32 window_height = grid_height * cell_size + 2 * padding;
   const i32 window_width = grid_width * cell_size + 2 * padding;
 
-  std::vector<std::pair<Location, EntityType>> entities;
-  entities.reserve(grid_height * grid_width);
-  
-  for (i32 i = 0; i < grid_height; ++i)
-    for (i32 j = 0; j < grid_width; ++j)
-      entities.emplace_back(Location{i, j}, char_to_entity_type(grid[i][j]));
-  std::sort(entities.begin(), entities.end(), [](const auto &a, const auto &b) {
-    return entity_type_render_precedence(a.second) < entity_type_render_precedence(b.second);
-  });
-
-  bool new_window_created = false;
-
-  if (not IsWindowReady()) {
-    SetConfigFlags(FLAG_WINDOW_HIDDEN);
-    SetTraceLogLevel(LOG_WARNING);
-    InitWindow(1, 1, "Headless Window");
-    new_window_created = true;
-  }
-
-  BeginDrawing();
-  
-  Image img = GenImageColor(window_width, window_height, LIGHTBLACK);
-  ImageClearBackground(&img, LIGHTBLACK);
+  build_draw_list(grid, entities);
+  ImageClearBackground(image, LIGHTBLACK);
   
   for (const auto &[location, entity_type]: entities) {
     i32 pos_x = window_width / 2 - grid_width * cell_size / 2 + location.y * cell_size;
     i32 pos_y = window_height / 2 - grid_height * cell_size / 2 + location.x * cell_size;
-    draw_entity(&img, entity_type, pos_x, pos_y, cell_size);
-  }  
+    draw_entity(image, entity_type, pos_x, pos_y, cell_size);
+  }
+}
 
-  EndDrawing();
+// Width and height in pixels of the image for a grid
+inline std::pair<i32, i32> grid_image_size(const std::vector<std::string> &grid, const i32 cell_size, const i32 padding) {
+  if (grid.empty())
+    throw std::runtime_error("Cannot draw an empty grid.");
+  return {
+    static_cast<int>(grid[0].size()) * cell_size + 2 * padding,
+    static_cast<int>(grid.size()) * cell_size + 2 * padding
+  };
+}
 
+// Renders a single grid. To export many grids, use ImageExporter which reuses its buffers and
+// encodes in parallel
+inline void render_grid_to_png(const std::vector<std::string> &grid, const std::string &filename = "tmp.png", const i32 cell_size = 30.0f, const i32 padding = 4.0f) {
+  auto [width, height] = grid_image_size(grid, cell_size, padding);
+  std::vector<std::pair<Location, EntityType>> entities;
+
+  SetTraceLogLevel(LOG_WARNING);
+  Image img = GenImageColor(width, height, LIGHTBLACK);
+  draw_grid(&img, grid, entities, cell_size, padding);
   ExportImage(img, filename.c_str());
   UnloadImage(img);
+}
 
-  if (new_window_created)
-    CloseWindow();
+inline Color get_background_color() {
+  return LIGHTBLACK;
 }
 
 #undef CYAN
@@ -0,0 +1,77 @@
+#ifndef HEADER_ROLLOUT_H
+#define HEADER_ROLLOUT_H
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+
+#include "environment.hpp"
+#include "episode_statistics.hpp"
+#include "policy.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "pacman/observation.hpp"
+
+// Caller-owned output of a rollout of n steps:
+//   observations  n x channels x rows x cols (or the window size), the observation the action
+//                 was chosen from
+//   actions       n MovementDirection values
+//   rewards       n rewards of the action, see RewardConfig
+//   score_deltas  n scores gained by the action
+//   dones         n flags set when the action completed the episode
+struct Trajectory {
+  u8 *observations;
+  i32 *actions;
+  f32 *rewards;
+  i32 *score_deltas;
+  u8 *dones;
+};
+
+// Runs `policy` on `env` for n_steps, starting from its current state, and writes the
+// transitions into `out`. Episodes that complete are reset right away, so the observation after
+// a done flag is the first one of the next episode.
+//
+// When `statistics` is given, every step is accounted to its env `statistics_env`. All episodes
+// that finish are queued there, and committing them is left to the caller.
+//
+// With a window radius, window observations are recorded while the policy still acts on the
+// full observation.
+inline void rollout(EnvironmentBase &env, Policy &policy, i32 n_steps, const Trajectory &out, EpisodeStatistics *statistics = nullptr, i32 statistics_env = 0, i32 window_radius = full_observation) {
+  TRACE_SCOPE("rollout", "rollout");
+
+  const Config &config = env.get_config();
+  if (policy.get_rows() != config.rows or policy.get_cols() != config.cols)
+    throw std::runtime_error("Policy and environment have different map sizes.");
+  const i64 size = observation_size(config.rows, config.cols, window_radius);
+  const State &state = env.get_state_ref();
+  std::vector<u8> full_observation_buffer;
+  if (window_radius != full_observation)
+    full_observation_buffer.resize(observation_size(config.rows, config.cols));
+
+  for (i32 step = 0; step < n_steps; ++step) {
+    u8 *observation = out.observations + step * size;
+    env.write_observation(window_radius, observation);
+    if (window_radius != full_observation) {
+      env.get_observation(full_observation_buffer.data());
+      observation = full_observation_buffer.data();
+    }
+
+    MovementDirection action = policy.act(observation);
+    const i32 score = state.score;
+    env.advance(action);
+
+    out.actions[step] = (i32)action;
+    out.rewards[step] = env.get_reward();
+    out.score_deltas[step] = state.score - score;
+    out.dones[step] = state.completed;
+    if (statistics != nullptr)
+      statistics->update(statistics_env, out.score_deltas[step], state);
+    if (state.completed) {
+      env.reset();
+      if (statistics != nullptr)
+        statistics->begin(statistics_env, state);
+    }
+  }
+}
+
+#endif // HEADER_ROLLOUT_H
@@ -0,0 +1,194 @@
+#ifndef HEADER_ROLLOUT_BUFFER_H
+#define HEADER_ROLLOUT_BUFFER_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "random.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+
+// Transitions of one on-policy update: n_steps x num_envs entries, step-major, so that step t of
+// every env is one contiguous row. A VectorEnvironment writes observations, actions, rewards and
+// done flags (see VectorEnvironmentT::step(actions, buffer)), the caller writes the values and
+// log-probabilities of its policy, and compute_advantages() fills in advantages and returns.
+//
+// Observations are the ones the actions were chosen from, and done flags are set when the action
+// completed the episode, so with autoreset the next row of that env starts a new episode.
+class RolloutBuffer {
+  private:
+    i32 n_steps;
+    i32 num_envs;
+    std::array<i32, 3> observation_shape;
+    i64 observation_size;
+    i32 position = 0;
+
+    std::vector<u8> observations;
+    std::vector<i32> actions;
+    std::vector<f32> rewards;
+    std::vector<u8> dones;
+    std::vector<f32> values;
+    std::vector<f32> log_probs;
+    std::vector<f32> advantages;
+    std::vector<f32> returns;
+
+    // Shuffled entry indices for minibatches, and the advantages after the last step
+    std::vector<i64> indices;
+    std::vector<f32> zeros;
+    Random random;
+
+  public:
+    RolloutBuffer(i32 n_steps, i32 num_envs, std::array<i32, 3> observation_shape, u64 seed = 0):
+      n_steps(n_steps),
+      num_envs(num_envs),
+      observation_shape(observation_shape),
+      observation_size((i64)observation_shape[0] * observation_shape[1] * observation_shape[2]),
+      random(seed) {
+      if (n_steps < 1 or num_envs < 1)
+        throw std::runtime_error("RolloutBuffer requires at least one step and one environment.");
+      if (observation_size <= 0)
+        throw std::runtime_error("RolloutBuffer requires a non-empty observation shape.");
+
+      const i64 entries = size();
+      observations.resize(entries * observation_size);
+      actions.resize(entries, 0);
+      rewards.resize(entries, 0);
+      dones.resize(entries, 0);
+      values.resize(entries, 0);
+      log_probs.resize(entries, 0);
+      advantages.resize(entries, 0);
+      returns.resize(entries, 0);
+      indices.resize(entries);
+      std::iota(indices.begin(), indices.end(), 0);
+      zeros.resize(num_envs, 0);
+    }
+
+    // Step of the next transitions to be written
+    i32 get_position() const {
+      return position;
+    }
+
+    bool is_full() const {
+      return position == n_steps;
+    }
+
+    // Called once every env wrote the transition of the current step
+    void advance() {
+      if (is_full())
+        throw std::runtime_error("RolloutBuffer is full, call clear() before adding more steps.");
+      position += 1;
+    }
+
+    // Starts the next rollout, overwriting the stored one
+    void clear() {
+      position = 0;
+    }
+
+    // Entry of step `step` of env `env` in every per-entry array
+    i64 index(i32 step, i32 env) const {
+      return (i64)step * num_envs + env;
+    }
+
+    // Generalized advantage estimation, over all envs at once per step:
+    //   delta_t = r_t + gamma * V_{t+1} * (1 - done_t) - V_t
+    //   A_t = delta_t + gamma * lambda * (1 - done_t) * A_{t+1}
+    // with `last_values` (one per env) as the values after the last step. Returns are A_t + V_t
+    void compute_advantages(const f32 *last_values, f32 gamma, f32 gae_lambda) {
+      TRACE_SCOPE("rollout_buffer.advantages", "rollout_buffer");
+      if (not is_full())
+        throw std::runtime_error("compute_advantages() requires a full buffer, got " + std::to_string(position) + " of " + std::to_string(n_steps) + " steps.");
+
+      for (i32 t = n_steps - 1; t >= 0; --t) {
+        const bool last = t == n_steps - 1;
+        const f32 *next_values = last ? last_values : values.data() + index(t + 1, 0);
+        const f32 *next_advantages = last ? zeros.data() : advantages.data() + index(t + 1, 0);
+        const f32 *step_values = values.data() + index(t, 0);
+        const f32 *step_rewards = rewards.data() + index(t, 0);
+        const u8 *step_dones = dones.data() + index(t, 0);
+        f32 *step_advantages = advantages.data() + index(t, 0);
+        f32 *step_returns = returns.data() + index(t, 0);
+
+        for (i32 i = 0; i < num_envs; ++i) {
+          const f32 not_done = 1.0f - step_dones[i];
+          const f32 delta = step_rewards[i] + gamma * next_values[i] * not_done - step_values[i];
+          step_advantages[i] = delta + gamma * gae_lambda * not_done * next_advantages[i];
+          step_returns[i] = step_advantages[i] + step_values[i];
+        }
+      }
+    }
+
+    // Reshuffles the entry indices. Minibatch k is indices [k * batch_size, (k + 1) * batch_size)
+    void shuffle() {
+      for (i64 i = size() - 1; i > 0; --i)
+        std::swap(indices[i], indices[random.uniform((u32)(i + 1))]);
+    }
+
+    i32 get_n_steps() const {
+      return n_steps;
+    }
+
+    i32 get_num_envs() const {
+      return num_envs;
+    }
+
+    // Number of entries, n_steps x num_envs
+    i64 size() const {
+      return (i64)n_steps * num_envs;
+    }
+
+    std::array<i32, 3> get_observation_shape() const {
+      return observation_shape;
+    }
+
+    i64 get_observation_size() const {
+      return observation_size;
+    }
+
+    u8* get_observation(i32 step, i32 env) {
+      return observations.data() + index(step, env) * observation_size;
+    }
+
+    // n_steps x num_envs x observation shape
+    const u8* get_observations() const {
+      return observations.data();
+    }
+
+    i32* get_actions() {
+      return actions.data();
+    }
+
+    f32* get_rewards() {
+      return rewards.data();
+    }
+
+    u8* get_dones() {
+      return dones.data();
+    }
+
+    f32* get_values() {
+      return values.data();
+    }
+
+    f32* get_log_probs() {
+      return log_probs.data();
+    }
+
+    const f32* get_advantages() const {
+      return advantages.data();
+    }
+
+    const f32* get_returns() const {
+      return returns.data();
+    }
+
+    const i64* get_indices() const {
+      return indices.data();
+    }
+};
+
+#endif // HEADER_ROLLOUT_BUFFER_H
@@ -0,0 +1,122 @@
+#ifndef HEADER_THREAD_POOL_H
+#define HEADER_THREAD_POOL_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.hpp"
+
+// Fixed set of worker threads fed from a single task queue. Meant for coarse tasks (a batch of
+// frames or environments per task), so the queue is a plain mutex-protected deque.
+class ThreadPool {
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_available;
+    bool stopping = false;
+
+  public:
+    // Zero threads means one per hardware thread
+    explicit ThreadPool(i32 threads = 0) {
+      if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      workers.reserve(threads);
+      for (i32 i = 0; i < threads; ++i)
+        workers.emplace_back([this] { work(); });
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool& operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      task_available.notify_all();
+      for (auto &worker: workers)
+        worker.join();
+    }
+
+    i32 size() const {
+      return (i32)workers.size();
+    }
+
+    void submit(std::function<void()> task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+      }
+      task_available.notify_one();
+    }
+
+    // Calls fn(index, slot) for every index in [0, count) and blocks until all calls returned.
+    // Indices are handed out dynamically. `slot` is in [0, size()) and no two concurrent calls
+    // share it, so callers can keep one scratch buffer per slot. The first exception thrown by
+    // fn is rethrown here once the remaining calls have finished.
+    template <typename Function>
+    void parallel_for(i32 count, Function &&fn) {
+      if (count <= 0)
+        return;
+
+      struct Batch {
+        std::atomic<i32> next = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+        i32 running = 0;
+        std::exception_ptr error;
+      } batch;
+
+      const i32 slots = std::min(size(), count);
+      batch.running = slots;
+      for (i32 slot = 0; slot < slots; ++slot)
+        submit([&batch, &fn, count, slot] {
+          try {
+            for (i32 index = batch.next++; index < count; index = batch.next++)
+              fn(index, slot);
+          }
+          catch (...) {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            if (batch.error == nullptr)
+              batch.error = std::current_exception();
+            batch.next = count;
+          }
+
+          std::lock_guard<std::mutex> lock(batch.mutex);
+          if (--batch.running == 0)
+            batch.done.notify_one();
+        });
+
+      std::unique_lock<std::mutex> lock(batch.mutex);
+      batch.done.wait(lock, [&] { return batch.running == 0; });
+      if (batch.error != nullptr)
+        std::rethrow_exception(batch.error);
+    }
+
+  private:
+    void work() {
+      while (true) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          task_available.wait(lock, [this] { return stopping or not tasks.empty(); });
+          if (tasks.empty())
+            return;
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        task();
+      }
+    }
+};
+
+#endif // HEADER_THREAD_POOL_H
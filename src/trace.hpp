@@ -0,0 +1,337 @@
+#ifndef HEADER_TRACE_H
+#define HEADER_TRACE_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "types.hpp"
+
+#if defined(__GNUC__) && !defined(_WIN32)
+#define TRACE_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#define TRACE_TLS_MODEL
+#endif
+
+// Lightweight tracer that records complete ("X") events into per-thread buffers and dumps
+// them as Chrome trace-event JSON, which can be opened in Perfetto or chrome://tracing.
+//
+// Recording an event only touches the calling thread's buffer: no locks, no allocation and
+// no atomic read-modify-write. Each event reads the clock once per boundary, and consecutive
+// phases share the timestamp between them (see TraceScope::next). Names and categories must be
+// string literals (or otherwise outlive the tracer) since only a pointer to their site is stored.
+
+// Name and category of the events of one call site, see TRACE_SITE
+struct TraceSite {
+  const char *name;
+  const char *category;
+};
+
+struct TraceEvent {
+  const TraceSite *site;
+  u64 begin;
+  u64 end;
+};
+
+class TraceBuffer {
+  public:
+    std::vector<TraceEvent> events;
+    u64 capacity;
+    std::atomic<u64> size = 0;
+
+    // Atomic because dump() and clear() read and reset it from other threads, but only the
+    // owning thread increments it
+    std::atomic<u64> dropped = 0;
+    u32 thread_id;
+
+    // Set once the owning thread exited. The events stay until clear(), and the next thread
+    // that starts tracing takes the buffer over instead of allocating one
+    bool retired = false;
+
+  public:
+    TraceBuffer(u32 thread_id, u64 capacity):
+      events(capacity),
+      capacity(capacity),
+      thread_id(thread_id)
+    { }
+
+    void push(const TraceSite &site, u64 begin, u64 end) {
+      u64 index = size.load(std::memory_order_relaxed);
+      if (index >= capacity) {
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+      }
+      events[index] = TraceEvent{&site, begin, end};
+      size.store(index + 1, std::memory_order_release);
+    }
+
+    // Keeps the first `capacity` events and counts the others as dropped
+    void resize(u64 new_capacity) {
+      const u64 count = size.load(std::memory_order_relaxed);
+      if (count > new_capacity) {
+        dropped.store(dropped.load(std::memory_order_relaxed) + count - new_capacity, std::memory_order_relaxed);
+        size.store(new_capacity, std::memory_order_relaxed);
+      }
+      events.resize(new_capacity);
+      events.shrink_to_fit();
+      capacity = new_capacity;
+    }
+};
+
+class Tracer {
+  private:
+    // Gives the buffer of a thread back to the tracer when the thread exits
+    struct ThreadExit {
+      TraceBuffer *buffer = nullptr;
+
+      ~ThreadExit() {
+        if (buffer != nullptr)
+          Tracer::instance().retire(buffer);
+      }
+    };
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    u64 buffer_capacity = u64(1) << 16;
+    u32 next_thread_id = 0;
+    std::string output_filename;
+
+    // Tick to nanosecond conversion, calibrated between enable() and dump()
+    u64 origin_ticks = 0;
+    std::chrono::steady_clock::time_point origin_time;
+
+    // Kept outside of the singleton so that the disabled fast path is a single relaxed load. The
+    // buffer pointer uses static TLS, so that the Python module reaches it without calling
+    // __tls_get_addr on every event
+    static inline std::atomic<bool> enabled = false;
+    static inline thread_local TraceBuffer *local_buffer TRACE_TLS_MODEL = nullptr;
+
+  public:
+    static Tracer& instance() {
+      static Tracer tracer;
+      return tracer;
+    }
+
+    static u64 now() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+      ).count();
+#endif
+    }
+
+    static bool is_enabled() {
+      return enabled.load(std::memory_order_relaxed);
+    }
+
+    // A capacity different from the current one resizes the buffers of all threads, so like
+    // clear() it must not be called while traced work is in flight on other threads
+    void enable(const std::string &filename = "", u64 capacity_per_thread = u64(1) << 16) {
+      std::lock_guard<std::mutex> lock(mutex);
+      output_filename = filename;
+      if (capacity_per_thread != buffer_capacity) {
+        buffer_capacity = capacity_per_thread;
+        for (auto &buffer: buffers)
+          buffer->resize(capacity_per_thread);
+      }
+      if (origin_ticks == 0) {
+        origin_ticks = now();
+        origin_time = std::chrono::steady_clock::now();
+      }
+      enabled.store(true, std::memory_order_relaxed);
+    }
+
+    static void disable() {
+      enabled.store(false, std::memory_order_relaxed);
+    }
+
+    // Must not be called while traced work is in flight on other threads. The buffers of exited
+    // threads are freed
+    void clear() {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::erase_if(buffers, [] (const auto &buffer) { return buffer->retired; });
+      for (auto &buffer: buffers) {
+        buffer->size.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    static void record(const TraceSite &site, u64 begin, u64 end) {
+      if (local_buffer == nullptr) [[unlikely]]
+        local_buffer = instance().register_thread();
+      local_buffer->push(site, begin, end);
+    }
+
+    // Events recorded by all threads since the last clear(), including dropped ones
+    u64 get_event_count() {
+      std::lock_guard<std::mutex> lock(mutex);
+      u64 count = 0;
+      for (auto &buffer: buffers)
+        count += buffer->size.load(std::memory_order_acquire) + buffer->dropped.load(std::memory_order_relaxed);
+      return count;
+    }
+
+    // Writes the configured output file, if any. Called once per close() by the bindings
+    void flush() {
+      std::string filename;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        filename = output_filename;
+      }
+      if (is_enabled() and not filename.empty())
+        dump(filename);
+    }
+
+    void dump(const std::string &filename) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      FILE *file = std::fopen(filename.c_str(), "w");
+      if (file == nullptr)
+        throw std::runtime_error("Could not open trace file " + filename + " for writing.");
+
+      f64 ns_per_tick = calibrate();
+      bool first = true;
+      auto separator = [&] {
+        if (not first)
+          std::fputs(",\n", file);
+        first = false;
+      };
+
+      std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+      for (auto &buffer: buffers) {
+        separator();
+        std::fprintf(
+          file,
+          "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+          buffer->thread_id, buffer->thread_id
+        );
+
+        u64 size = buffer->size.load(std::memory_order_acquire);
+        for (u64 i = 0; i < size; ++i) {
+          const TraceEvent &event = buffer->events[i];
+          f64 ts = (f64)(event.begin - origin_ticks) * ns_per_tick / 1000.0;
+          f64 dur = (f64)(event.end - event.begin) * ns_per_tick / 1000.0;
+          separator();
+          std::fprintf(
+            file,
+            "{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event.site->name, event.site->category, buffer->thread_id, ts, dur
+          );
+        }
+
+        const u64 dropped = buffer->dropped.load(std::memory_order_relaxed);
+        if (dropped > 0) {
+          separator();
+          std::fprintf(
+            file,
+            "{\"ph\":\"C\",\"name\":\"dropped_events\",\"pid\":0,\"tid\":%u,\"ts\":0,\"args\":{\"dropped\":%lu}}",
+            buffer->thread_id, (unsigned long)dropped
+          );
+        }
+      }
+      std::fputs("\n]}\n", file);
+      std::fclose(file);
+    }
+
+  private:
+    Tracer() = default;
+
+    // Only reached on the first event of a thread, so the thread_local with a destructor stays
+    // off the recording path
+    TraceBuffer* register_thread() {
+      static thread_local ThreadExit thread_exit;
+      std::lock_guard<std::mutex> lock(mutex);
+      auto retired = std::find_if(buffers.begin(), buffers.end(), [] (const auto &buffer) { return buffer->retired; });
+      if (retired != buffers.end()) {
+        (*retired)->retired = false;
+        thread_exit.buffer = retired->get();
+      }
+      else {
+        buffers.emplace_back(std::make_unique<TraceBuffer>(next_thread_id++, buffer_capacity));
+        thread_exit.buffer = buffers.back().get();
+      }
+      return thread_exit.buffer;
+    }
+
+    void retire(TraceBuffer *buffer) {
+      std::lock_guard<std::mutex> lock(mutex);
+      buffer->retired = true;
+    }
+
+    f64 calibrate() const {
+#if defined(__x86_64__) || defined(__i386__)
+      u64 ticks = now() - origin_ticks;
+      f64 ns = (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - origin_time
+      ).count();
+      return ticks > 0 ? ns / (f64)ticks : 1.0;
+#else
+      return 1.0;
+#endif
+    }
+};
+
+class TraceScope {
+  private:
+    const TraceSite *site;
+    u64 begin = 0;
+
+  public:
+    explicit TraceScope(const TraceSite &site):
+      site(&site) {
+      if (Tracer::is_enabled()) [[unlikely]]
+        begin = Tracer::now();
+    }
+
+    // Starts at the same time as `enclosing`, for a first phase that begins with its function
+    TraceScope(const TraceSite &site, const TraceScope &enclosing):
+      site(&site),
+      begin(enclosing.begin)
+    { }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope& operator=(const TraceScope &) = delete;
+
+    ~TraceScope() {
+      stop();
+    }
+
+    // Ends the event before the scope does. Used to split a function into phases
+    void stop() {
+      if (begin != 0) [[unlikely]] {
+        Tracer::record(*site, begin, Tracer::now());
+        begin = 0;
+      }
+    }
+
+    // Ends the event and starts the next phase with the same timestamp
+    void next(const TraceSite &next_site) {
+      if (begin != 0) [[unlikely]] {
+        const u64 end = Tracer::now();
+        Tracer::record(*site, begin, end);
+        begin = end;
+      }
+      site = &next_site;
+    }
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SITE(name, category) ([] () -> const TraceSite& { static constexpr TraceSite site{name, category}; return site; }())
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(TRACE_SITE(name, category))
+
+#endif // HEADER_TRACE_H
@@ -0,0 +1,187 @@
+#ifndef WRAPPERS_FRAME_SKIP_ENV_H
+#define WRAPPERS_FRAME_SKIP_ENV_H
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "constants.hpp"
+#include "environment.hpp"
+#include "state.hpp"
+#include "trace.hpp"
+#include "pacman/observation.hpp"
+
+// Repeats every action `skip` times, as is usual for Atari-style agents that act every k ticks.
+// Repetition stops early when the episode completes or Pacman loses a life, so that a single
+// call never spans a death. The rewards of the repeated ticks are summed up by get_reward(), and
+// the score gained over them is available through get_score_delta().
+//
+// With max_pool, get_observation() returns the element-wise maximum of the observations after
+// the last two ticks, so that actors which moved during the skipped ticks are not missed. Window
+// observations are cropped out of the pooled one around the current pacman location.
+class FrameSkipEnvironment: public EnvironmentBase {
+  private:
+    EnvironmentBase &env;
+    i32 skip;
+    bool max_pool;
+
+    i32 score_delta = 0;
+    f32 reward = 0;
+    i32 ticks = 0;
+    bool life_lost = false;
+
+    // Observations after the last two ticks of the previous step, only used with max_pool
+    std::vector<u8> observations[2];
+    i32 pooled_observations = 0;
+    mutable std::vector<u8> pooled;
+
+  public:
+    FrameSkipEnvironment(EnvironmentBase &env, i32 skip = 4, bool max_pool = false):
+      env(env),
+      skip(skip),
+      max_pool(max_pool) {
+      if (skip < 1)
+        throw std::runtime_error("FrameSkipEnvironment requires skip >= 1.");
+    }
+
+    State reset() override {
+      score_delta = 0;
+      reward = 0;
+      ticks = 0;
+      life_lost = false;
+      pooled_observations = 0;
+      return env.reset();
+    }
+
+    State step(MovementDirection direction) override {
+      advance(direction);
+      return env.get_state();
+    }
+
+    void advance(MovementDirection direction) override {
+      TRACE_SCOPE("frame_skip.step", "wrapper");
+
+      const State &state = env.get_state_ref();
+      const i32 initial_score = state.score;
+      const i32 initial_lives = state.lives;
+      const Config &config = env.get_config();
+      const u64 size = max_pool ? observation_size(config.rows, config.cols) : 0;
+
+      ticks = 0;
+      reward = 0;
+      life_lost = false;
+      pooled_observations = 0;
+      while (ticks < skip) {
+        env.advance(direction);
+        reward += env.get_reward();
+        ticks += 1;
+        life_lost = state.lives < initial_lives;
+        bool stop = state.completed or life_lost;
+
+        if (max_pool and (ticks >= skip - 1 or stop)) {
+          std::vector<u8> &observation = observations[pooled_observations % 2];
+          observation.resize(size);
+          env.get_observation(observation.data());
+          pooled_observations += 1;
+        }
+
+        if (stop)
+          break;
+      }
+
+      score_delta = state.score - initial_score;
+    }
+
+    State get_state() const override {
+      return env.get_state();
+    }
+
+    const State& get_state_ref() const override {
+      return env.get_state_ref();
+    }
+
+    f32 get_reward() const override {
+      return reward;
+    }
+
+    void get_observation(u8 *out) const override {
+      if (not max_pool or pooled_observations == 0) {
+        env.get_observation(out);
+        return;
+      }
+
+      // The most recent observation is written last, so with a single one it is in slot 0
+      const std::vector<u8> &latest = observations[(pooled_observations - 1) % 2];
+      if (pooled_observations == 1) {
+        std::copy(latest.begin(), latest.end(), out);
+        return;
+      }
+
+      const std::vector<u8> &previous = observations[pooled_observations % 2];
+      for (u64 i = 0; i < latest.size(); ++i)
+        out[i] = std::max(latest[i], previous[i]);
+    }
+
+    void get_window_observation(i32 radius, u8 *out) const override {
+      if (not max_pool or pooled_observations == 0) {
+        env.get_window_observation(radius, out);
+        return;
+      }
+
+      const Config &config = env.get_config();
+      const Location &pacman = env.get_state_ref().pacman_location;
+      pooled.resize(observation_size(config.rows, config.cols));
+      get_observation(pooled.data());
+      crop_observation(pooled.data(), config.rows, config.cols, pacman.x, pacman.y, radius, out);
+    }
+
+    void get_features(f32 *out) override {
+      env.get_features(out);
+    }
+
+    const Config& get_config() const override {
+      return env.get_config();
+    }
+
+    RenderMode get_render_mode() const override {
+      return env.get_render_mode();
+    }
+
+    void render() override {
+      env.render();
+    }
+
+    void close() const override {
+      env.close();
+    }
+
+    // Score gained over the ticks of the last step()
+    i32 get_score_delta() const {
+      return score_delta;
+    }
+
+    // Number of ticks the last step() actually advanced, at most `skip`
+    i32 get_ticks() const {
+      return ticks;
+    }
+
+    // Whether Pacman lost a life during the last step()
+    bool get_life_lost() const {
+      return life_lost;
+    }
+
+    i32 get_skip() const {
+      return skip;
+    }
+
+    bool get_max_pool() const {
+      return max_pool;
+    }
+
+    const EnvironmentBase &get_env() const {
+      return env;
+    }
+};
+
+#endif // WRAPPERS_FRAME_SKIP_ENV_H
@@ -4,6 +4,8 @@
 #include <cstdio>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include "pretty_print.hpp"
 #include "raylib.h"
@@ -11,10 +13,13 @@
 #include "constants.hpp"
 #include "environment.hpp"
 #include "state.hpp"
+#include "trace.hpp"
+#include "render/graphics_renderer.hpp"
+#include "wrappers/snapshot_ring.hpp"
 
 class RecordVideoEnvironment: public EnvironmentBase {
   private:
-    PacmanEnvironment &env;
+    EnvironmentBase &env;
 
   private:
     bool should_record;
@@ -22,31 +27,36 @@ class RecordVideoEnvironment: public EnvironmentBase {
     std::filesystem::path video_folder;
     std::filesystem::path tmp_screenshot_folder;
     std::string output_filename;
+    bool has_screenshots = false;
+
+    // In-memory copies of the last rendered frames, see get_snapshot_pixels(), and the RGBA frame
+    // they are read into first, reused from one render() to the next
+    SnapshotRing snapshots;
+    std::vector<u8> screen_pixels;
   
   public:
     RecordVideoEnvironment(
-      PacmanEnvironment &env,
+      EnvironmentBase &env,
       bool should_record = true,
       u32 fps = 24,
       const std::string &video_folder = "recordings",
-      const std::string &output_filename = "recording.mp4"
+      const std::string &output_filename = "recording.mp4",
+      i32 snapshot_capacity = 0
     ):
       env(env),
       should_record(should_record),
       fps(fps),
       video_folder(video_folder),
       tmp_screenshot_folder(video_folder),
-      output_filename(output_filename) {
+      output_filename(output_filename),
+      snapshots(snapshot_capacity) {
       if (env.get_render_mode() != RenderMode::human)
         throw std::runtime_error("RecordVideoEnvironment currently only supports RenderMode::human");
       tmp_screenshot_folder /= "tmp";
-      if (!std::filesystem::exists(video_folder))
-        std::filesystem::create_directory(video_folder);
-      if (!std::filesystem::exists(tmp_screenshot_folder))
-        std::filesystem::create_directory(tmp_screenshot_folder);
     }
 
     State reset() override {
+      snapshots.clear();
       return env.reset();
     }
 
@@ -58,6 +68,38 @@ class RecordVideoEnvironment: public EnvironmentBase {
       return env.get_state();
     }
 
+    void advance(MovementDirection direction) override {
+      env.advance(direction);
+    }
+
+    const State& get_state_ref() const override {
+      return env.get_state_ref();
+    }
+
+    f32 get_reward() const override {
+      return env.get_reward();
+    }
+
+    void get_observation(u8 *out) const override {
+      env.get_observation(out);
+    }
+
+    void get_window_observation(i32 radius, u8 *out) const override {
+      env.get_window_observation(radius, out);
+    }
+
+    void get_features(f32 *out) override {
+      env.get_features(out);
+    }
+
+    const Config& get_config() const override {
+      return env.get_config();
+    }
+
+    RenderMode get_render_mode() const override {
+      return env.get_render_mode();
+    }
+
     std::string get_snapshot(i32 step_index = -1) const {
       if (step_index == -1)
         step_index = env.get_state().step_index;
@@ -67,14 +109,59 @@ class RecordVideoEnvironment: public EnvironmentBase {
       return filename;
     }
 
+    // Pixels (height x width x 3 RGB) of the frame rendered at the given step, without going
+    // through a PNG file. Requires a snapshot capacity greater than zero; only the frames of the
+    // last `snapshot_capacity` rendered steps are kept and the returned buffer is recycled after that.
+    // Rendering a frame of another size, e.g. after a reset to a map of another size, moves the
+    // snapshots to a new allocation; hold get_snapshot_storage() to keep the old one alive
+    const u8* get_snapshot_pixels(i32 step_index = -1) const {
+      if (snapshots.get_capacity() == 0)
+        throw std::runtime_error("In-memory snapshots are disabled. Construct RecordVideoEnvironment with snapshot_capacity > 0.");
+      if (step_index == -1)
+        step_index = env.get_state().step_index;
+      return snapshots.get(step_index);
+    }
+
+    std::shared_ptr<const std::vector<u8>> get_snapshot_storage() const {
+      return snapshots.get_storage();
+    }
+
+    i32 get_snapshot_width() const {
+      return snapshots.get_width();
+    }
+
+    i32 get_snapshot_height() const {
+      return snapshots.get_height();
+    }
+
     void render() override {
       env.render();
-      if (should_record)
-        TakeScreenshot(TextFormat("%s/%08d.png", tmp_screenshot_folder.c_str(), env.get_state().step_index));
+      i32 step_index = env.get_state().step_index;
+
+      if (should_record) {
+        TRACE_SCOPE("record.screenshot", "record");
+        if (not has_screenshots) {
+          std::filesystem::create_directories(tmp_screenshot_folder);
+          has_screenshots = true;
+        }
+        TakeScreenshot(TextFormat("%s/%08d.png", tmp_screenshot_folder.c_str(), step_index));
+      }
+
+      if (snapshots.get_capacity() > 0) {
+        TRACE_SCOPE("record.snapshot", "record");
+        i32 width, height;
+        read_screen_pixels(screen_pixels, width, height);
+        snapshots.store(step_index, screen_pixels.data(), width, height, true);
+      }
     }
 
     void close() const override {
-      env.close();
+      if (not has_screenshots) {
+        env.close();
+        return;
+      }
+
+      TraceScope encode_phase(TRACE_SITE("record.encode", "record"));
 
       std::string command = TextFormat(
         "ffmpeg -y -framerate %d -i %s/%%08d.png -c:v libx264 -pix_fmt yuv420p %s/%s",
@@ -90,6 +177,9 @@ class RecordVideoEnvironment: public EnvironmentBase {
         std::cout << "Error while running ffmpeg. Make sure that it is installed and in your PATH." << std::endl;
       
       std::filesystem::remove_all(tmp_screenshot_folder);
+      encode_phase.stop();
+
+      env.close();
     }
 
     void continue_recording() {
@@ -100,7 +190,7 @@ class RecordVideoEnvironment: public EnvironmentBase {
       should_record = false;
     }
 
-    const PacmanEnvironment &get_env() const {
+    const EnvironmentBase &get_env() const {
       return env;
     }
 };
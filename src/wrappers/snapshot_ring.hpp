@@ -0,0 +1,104 @@
+#ifndef WRAPPERS_SNAPSHOT_RING_H
+#define WRAPPERS_SNAPSHOT_RING_H
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+// Last `capacity` rendered frames as RGB pixels (height x width x 3, row-major), keyed by step
+// index. Frames live in one allocation that is reused until the frame size changes, so memory use
+// is bounded by capacity * height * width * 3 bytes. A frame of another size, e.g. after a reset
+// to a map of another size, drops all stored frames and moves the ring to a new allocation. The
+// old one is shared with get_storage() holders, so views into it stay valid until they let go.
+class SnapshotRing {
+  private:
+    i32 capacity;
+    i32 width = 0;
+    i32 height = 0;
+    std::shared_ptr<std::vector<u8>> pixels;
+
+    // Step index of the frame held by every slot, or -1 if the slot is empty
+    std::vector<i32> step_indices;
+
+  public:
+    explicit SnapshotRing(i32 capacity = 0):
+      capacity(std::max(capacity, 0)),
+      pixels(std::make_shared<std::vector<u8>>()),
+      step_indices(this->capacity, -1)
+    { }
+
+    i32 get_capacity() const {
+      return capacity;
+    }
+
+    i32 get_width() const {
+      return width;
+    }
+
+    i32 get_height() const {
+      return height;
+    }
+
+    u64 get_frame_size() const {
+      return (u64)width * height * 3;
+    }
+
+    // Forgets all frames without releasing memory, e.g. when step indices start over on reset
+    void clear() {
+      std::fill(step_indices.begin(), step_indices.end(), -1);
+    }
+
+    // Copies an RGBA frame into the slot for `step_index`, dropping the alpha channel and, for
+    // frames read from OpenGL, flipping bottom-up rows. If the frame size differs from the stored
+    // ones, those are dropped and the ring moves to a new allocation
+    void store(i32 step_index, const u8 *rgba, i32 frame_width, i32 frame_height, bool bottom_up = false) {
+      if (capacity == 0)
+        return;
+      if (frame_width != width or frame_height != height) {
+        width = frame_width;
+        height = frame_height;
+        pixels = std::make_shared<std::vector<u8>>((u64)capacity * get_frame_size());
+        clear();
+      }
+
+      i32 slot = step_index % capacity;
+      u8 *frame = pixels->data() + (u64)slot * get_frame_size();
+      for (i32 row = 0; row < height; ++row) {
+        const u8 *in = rgba + (u64)(bottom_up ? height - 1 - row : row) * width * 4;
+        u8 *out = frame + (u64)row * width * 3;
+        for (i32 col = 0; col < width; ++col) {
+          out[3 * col + 0] = in[4 * col + 0];
+          out[3 * col + 1] = in[4 * col + 1];
+          out[3 * col + 2] = in[4 * col + 2];
+        }
+      }
+      step_indices[slot] = step_index;
+    }
+
+    bool contains(i32 step_index) const {
+      return capacity > 0 and step_index >= 0 and step_indices[step_index % capacity] == step_index;
+    }
+
+    // Overwritten once `capacity` more frames have been stored. Points into get_storage(), which
+    // stays allocated while someone holds it
+    const u8* get(i32 step_index) const {
+      if (not contains(step_index))
+        throw std::runtime_error(
+          "Snapshot of step " + std::to_string(step_index) + " is not in memory. Only the last " +
+          std::to_string(capacity) + " rendered steps are kept."
+        );
+      return pixels->data() + (u64)(step_index % capacity) * get_frame_size();
+    }
+
+    // Current allocation of the ring, for callers that hand out views into it
+    std::shared_ptr<const std::vector<u8>> get_storage() const {
+      return pixels;
+    }
+};
+
+#endif // WRAPPERS_SNAPSHOT_RING_H
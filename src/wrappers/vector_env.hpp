@@ -0,0 +1,566 @@
+#ifndef WRAPPERS_VECTOR_ENV_H
+#define WRAPPERS_VECTOR_ENV_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "environment.hpp"
+#include "episode_statistics.hpp"
+#include "state.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "policy.hpp"
+#include "rollout.hpp"
+#include "rollout_buffer.hpp"
+#include "pacman/features.hpp"
+#include "pacman/observation.hpp"
+#include "render/pixel_renderer.hpp"
+#include "wrappers/frame_skip_env.hpp"
+
+// N environments stepped together. Results of the last reset() or step() are written into
+// contiguous per-env arrays (observations, rewards, score deltas, done flags) that are allocated once, so
+// that they can be handed to Python as NumPy views without copying.
+//
+// Environments are split into one contiguous batch per worker thread. Every step goes through
+// a FrameSkipEnvironment, so with frame_skip = k a single call advances every env by up to k
+// ticks. With autoreset, an env whose episode completed is reset right away and the observation
+// written for it is the first one of the new episode, as in Gym vector environments.
+//
+// With features, the distance features of every env (see features.hpp) are written along with
+// the observations.
+//
+// With a window radius, observations are egocentric windows (see observation.hpp) rather than the
+// whole map, so that their size does not depend on the map size.
+//
+// Episode metrics (score, length in steps, lives lost, pellets eaten) are tracked per env, and
+// finished episodes go into a rolling window, see EpisodeStatistics.
+//
+// For pipelining, envs can be split into k contiguous groups that are stepped in the background
+// (step_async(), step_wait()), so that the policy runs on the observations of one group while
+// the workers step the others. Each group's observations, rewards and done flags are its slice of
+// the per-env arrays, and its actions are copied into a buffer of its own, so nothing is
+// allocated per call. While any group is in flight, only the pipelined calls may be used.
+//
+// With pixel rendering, render_pixels() draws the current frame of every env into one contiguous
+// num_envs x height x width x channels array on the worker threads, see PixelRenderer. Every env
+// has a renderer of its own, which caches the walls and gates of its current map.
+template <typename Environment = PacmanEnvironment>
+class VectorEnvironmentT {
+  private:
+    struct Slot {
+      Environment env;
+      FrameSkipEnvironment wrapper;
+      std::unique_ptr<PixelRenderer> pixel_renderer;
+
+      Slot(const Config &config, i32 frame_skip, bool max_pool):
+        env(config),
+        wrapper(env, frame_skip, max_pool)
+      { }
+    };
+
+    Config config;
+    i32 num_envs;
+    bool autoreset;
+    i32 window_radius;
+    bool features;
+    i64 observation_size;
+
+    // Slots hold references to themselves, so they are never moved
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::unique_ptr<ThreadPool> pool;
+
+    std::vector<u8> observations;
+    std::vector<f32> feature_values;
+    std::vector<f32> rewards;
+    std::vector<i32> score_deltas;
+    std::vector<u8> dones;
+
+    // Shared with the holders of get_pixel_storage(), see set_pixel_rendering()
+    std::shared_ptr<std::vector<u8>> pixels = std::make_shared<std::vector<u8>>();
+
+    EpisodeStatistics statistics;
+
+    // Envs [begin, end) stepped in the background by `pending` tasks
+    struct PipelineGroup {
+      i32 begin;
+      i32 end;
+      std::vector<i32> actions;
+      std::mutex mutex;
+      std::condition_variable done;
+      i32 pending = 0;
+      std::exception_ptr error;
+    };
+
+    std::vector<std::unique_ptr<PipelineGroup>> groups;
+    i32 next_group = 0;
+
+  public:
+    // Zero threads means one per hardware thread, one thread steps all envs on the calling thread
+    VectorEnvironmentT(const Config &config, i32 num_envs, i32 threads = 0, i32 frame_skip = 1, bool max_pool = false, bool autoreset = true, i32 statistics_window = 100, i32 window_radius = full_observation, bool features = false):
+      config(config),
+      num_envs(num_envs),
+      autoreset(autoreset),
+      window_radius(window_radius),
+      features(features),
+      observation_size(::observation_size(config.rows, config.cols, window_radius)),
+      statistics(std::max(num_envs, 1), statistics_window) {
+      if (num_envs < 1)
+        throw std::runtime_error("VectorEnvironment requires at least one environment.");
+      if (window_radius < 0 and window_radius != full_observation)
+        throw std::runtime_error("Window radius must be non-negative, or full_observation for the whole map.");
+
+      slots.reserve(num_envs);
+      for (i32 i = 0; i < num_envs; ++i)
+        slots.push_back(std::make_unique<Slot>(config, frame_skip, max_pool));
+
+      if (threads != 1) {
+        pool = std::make_unique<ThreadPool>(threads);
+        if (pool->size() == 1)
+          pool.reset();
+      }
+
+      observations.resize(num_envs * observation_size);
+      feature_values.resize(features ? num_envs * Features::count : 0);
+      rewards.resize(num_envs, 0);
+      score_deltas.resize(num_envs, 0);
+      dones.resize(num_envs, 0);
+      set_pipeline_groups(1);
+    }
+
+    VectorEnvironmentT(const VectorEnvironmentT &) = delete;
+    VectorEnvironmentT& operator=(const VectorEnvironmentT &) = delete;
+
+    // Background steps refer to the envs and groups, so they have to finish first
+    ~VectorEnvironmentT() {
+      for (auto &group: groups) {
+        std::unique_lock<std::mutex> lock(group->mutex);
+        group->done.wait(lock, [&] { return group->pending == 0; });
+      }
+    }
+
+    void reset() {
+      TRACE_SCOPE("vector.reset", "vector");
+      check_idle();
+      next_group = 0;
+      for_each_batch([&] (i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i) {
+          Slot &slot = *slots[i];
+          slot.wrapper.reset();
+          statistics.begin(i, slot.wrapper.get_state_ref());
+          write_observation(i);
+          rewards[i] = 0;
+          score_deltas[i] = 0;
+          dones[i] = 0;
+        }
+      });
+    }
+
+    // `actions` holds one MovementDirection value per env
+    void step(const i32 *actions) {
+      TRACE_SCOPE("vector.step", "vector");
+      check_idle();
+      check_actions(actions, num_envs);
+
+      for_each_batch([&] (i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i)
+          step_env(i, static_cast<MovementDirection>(actions[i]));
+      });
+      statistics.commit();
+    }
+
+    // Same as step(actions), and also records the transition of every env into the current step of
+    // `buffer`, from the worker threads: the observation the action is taken from, the action, its
+    // reward and done flag
+    void step(const i32 *actions, RolloutBuffer &buffer) {
+      TRACE_SCOPE("vector.step", "vector");
+      if (buffer.get_num_envs() != num_envs or buffer.get_observation_shape() != get_observation_shape())
+        throw std::runtime_error("RolloutBuffer does not match the number of environments or the observation shape.");
+      if (buffer.is_full())
+        throw std::runtime_error("RolloutBuffer is full, call clear() before adding more steps.");
+      check_idle();
+      check_actions(actions, num_envs);
+
+      const i32 t = buffer.get_position();
+      for_each_batch([&] (i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i) {
+          const i64 entry = buffer.index(t, i);
+          std::copy_n(observations.data() + i * observation_size, observation_size, buffer.get_observation(t, i));
+          buffer.get_actions()[entry] = actions[i];
+          step_env(i, static_cast<MovementDirection>(actions[i]));
+          buffer.get_rewards()[entry] = rewards[i];
+          buffer.get_dones()[entry] = dones[i];
+        }
+      });
+      statistics.commit();
+      buffer.advance();
+    }
+
+    void step(const std::vector<MovementDirection> &actions) {
+      if ((i32)actions.size() != num_envs)
+        throw std::runtime_error("VectorEnvironment::step() expects one action per environment.");
+      std::vector<i32> values(num_envs);
+      for (i32 i = 0; i < num_envs; ++i)
+        values[i] = (i32)actions[i];
+      step(values.data());
+    }
+
+    // Rolls out a scripted policy for n_steps in every env, each with its own Policy seeded from
+    // `seed` and the env index. `out` holds num_envs trajectories of n_steps back to back, see
+    // Trajectory. Afterwards the per-env arrays hold the result of the last step, as after step()
+    void rollout(PolicyType type, i32 n_steps, const Trajectory &out, u64 seed = 0) {
+      TRACE_SCOPE("vector.rollout", "vector");
+      if (n_steps < 0)
+        throw std::runtime_error("rollout() requires a non-negative number of steps.");
+      check_idle();
+
+      for_each_batch([&] (i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i) {
+          Slot &slot = *slots[i];
+          Policy policy(type, config.rows, config.cols, seed + i);
+          const i64 offset = (i64)i * n_steps;
+          ::rollout(slot.wrapper, policy, n_steps, Trajectory{
+            .observations = out.observations + offset * observation_size,
+            .actions = out.actions + offset,
+            .rewards = out.rewards + offset,
+            .score_deltas = out.score_deltas + offset,
+            .dones = out.dones + offset,
+          }, &statistics, i, window_radius);
+
+          rewards[i] = n_steps > 0 ? out.rewards[offset + n_steps - 1] : 0;
+          score_deltas[i] = n_steps > 0 ? out.score_deltas[offset + n_steps - 1] : 0;
+          dones[i] = n_steps > 0 ? out.dones[offset + n_steps - 1] : 0;
+          write_observation(i);
+        }
+      });
+      statistics.commit();
+    }
+
+    const EpisodeStatistics& get_statistics() const {
+      return statistics;
+    }
+
+    // Splits the envs into `count` contiguous groups of nearly equal size for step_async()
+    void set_pipeline_groups(i32 count) {
+      if (count < 1 or count > num_envs)
+        throw std::runtime_error("Number of pipeline groups must be between 1 and the number of environments, got " + std::to_string(count) + ".");
+      check_idle();
+
+      groups.clear();
+      for (i32 g = 0; g < count; ++g) {
+        auto group = std::make_unique<PipelineGroup>();
+        group->begin = g * num_envs / count;
+        group->end = (g + 1) * num_envs / count;
+        group->actions.resize(group->end - group->begin);
+        groups.push_back(std::move(group));
+      }
+      next_group = 0;
+    }
+
+    // Starts stepping the envs of group `g` on the worker threads and returns right away.
+    // `actions` holds one action per env of the group. Without worker threads the group is
+    // stepped here
+    void step_async(i32 g, const i32 *actions) {
+      TRACE_SCOPE("vector.step_async", "vector");
+      PipelineGroup &group = get_group(g);
+      const i32 count = group.end - group.begin;
+      check_actions(actions, count);
+      const i32 batches = pool == nullptr ? 0 : std::min(count, pool->size());
+      {
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (group.pending > 0)
+          throw std::runtime_error("Group " + std::to_string(g) + " is already being stepped, call step_wait() first.");
+        group.pending = batches;
+        group.error = nullptr;
+      }
+      std::copy_n(actions, count, group.actions.data());
+
+      if (pool == nullptr) {
+        step_group(group, group.begin, group.end);
+        return;
+      }
+
+      for (i32 batch = 0; batch < batches; ++batch) {
+        const i32 begin = group.begin + batch * count / batches;
+        const i32 end = group.begin + (batch + 1) * count / batches;
+        pool->submit([this, &group, begin, end] {
+          TRACE_SCOPE("vector.batch", "vector");
+          try {
+            step_group(group, begin, end);
+          }
+          catch (...) {
+            std::lock_guard<std::mutex> lock(group.mutex);
+            if (group.error == nullptr)
+              group.error = std::current_exception();
+          }
+
+          std::lock_guard<std::mutex> lock(group.mutex);
+          if (--group.pending == 0)
+            group.done.notify_all();
+        });
+      }
+    }
+
+    // Blocks until group `g` finished stepping, after which its slices of the per-env arrays hold
+    // the results. Returns right away for a group that is not being stepped
+    void step_wait(i32 g) {
+      TRACE_SCOPE("vector.step_wait", "vector");
+      PipelineGroup &group = get_group(g);
+      std::exception_ptr error;
+      {
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.done.wait(lock, [&] { return group.pending == 0; });
+        std::swap(error, group.error);
+      }
+      statistics.commit(group.begin, group.end);
+      if (error != nullptr)
+        std::rethrow_exception(error);
+    }
+
+    // Round-robin pipelining: starts stepping the next group with `actions`, then waits for the
+    // group after it and returns its index. Its observations are the next ones to act on, while
+    // the group just started keeps stepping. Right after reset() every group is ready, so the
+    // first calls return the reset observations of the later groups
+    i32 step_pipelined(const i32 *actions) {
+      const i32 g = next_group;
+      step_async(g, actions);
+      next_group = (g + 1) % (i32)groups.size();
+      step_wait(next_group);
+      return next_group;
+    }
+
+    i32 get_pipeline_groups() const {
+      return (i32)groups.size();
+    }
+
+    // Group whose observations the next step_pipelined() call expects actions for
+    i32 get_next_group() const {
+      return next_group;
+    }
+
+    // First env of group `g` and the number of envs in it
+    std::pair<i32, i32> get_group_range(i32 g) const {
+      const PipelineGroup &group = get_group(g);
+      return {group.begin, group.end - group.begin};
+    }
+
+    // Sets up render_pixels() to draw height x width frames, in grayscale or RGB, with cells of
+    // cell_size pixels before scaling. Zero height or width means rows * cell_size or cols * cell_size.
+    // Calling it again moves the pixels to a new array. The previous one is freed once no holder of
+    // get_pixel_storage() is left, so earlier views stay valid but are no longer written
+    void set_pixel_rendering(i32 height = 0, i32 width = 0, bool grayscale = false, i32 cell_size = 8) {
+      check_idle();
+      if (height == 0)
+        height = config.rows * cell_size;
+      if (width == 0)
+        width = config.cols * cell_size;
+
+      for (auto &slot: slots)
+        slot->pixel_renderer = std::make_unique<PixelRenderer>(height, width, grayscale, cell_size);
+      pixels = std::make_shared<std::vector<u8>>(num_envs * slots[0]->pixel_renderer->frame_size(), 0);
+    }
+
+    bool get_pixel_rendering_enabled() const {
+      return slots[0]->pixel_renderer != nullptr;
+    }
+
+    // Height, width and channels of every frame of render_pixels()
+    std::array<i32, 3> get_pixel_shape() const {
+      check_pixel_rendering();
+      const PixelRenderer &renderer = *slots[0]->pixel_renderer;
+      return {renderer.get_height(), renderer.get_width(), renderer.get_channels()};
+    }
+
+    // Draws the current frame of every env into the pixel array
+    void render_pixels() {
+      TRACE_SCOPE("vector.render_pixels", "vector");
+      check_idle();
+      check_pixel_rendering();
+
+      const i64 frame_size = slots[0]->pixel_renderer->frame_size();
+      for_each_batch([&] (i32 begin, i32 end) {
+        std::array<Location, Actors::capacity> locations;
+        std::array<EntityType, Actors::capacity> types;
+        for (i32 i = begin; i < end; ++i) {
+          Slot &slot = *slots[i];
+          slot.pixel_renderer->render(slot.env.get_render_layers(locations, types), pixels->data() + i * frame_size);
+        }
+      });
+    }
+
+    // num_envs x height x width x channels, written by render_pixels(). Points into
+    // get_pixel_storage()
+    const u8* get_pixels() const {
+      return pixels->data();
+    }
+
+    // Current pixel array, for callers that hand out views into it
+    std::shared_ptr<const std::vector<u8>> get_pixel_storage() const {
+      return pixels;
+    }
+
+    void clear_statistics() {
+      check_idle();
+      statistics.clear();
+      for (i32 i = 0; i < num_envs; ++i)
+        statistics.begin(i, slots[i]->wrapper.get_state_ref());
+    }
+
+    void close() const {
+      for (const auto &slot: slots)
+        slot->wrapper.close();
+    }
+
+    i32 size() const {
+      return num_envs;
+    }
+
+    i32 get_threads() const {
+      return pool == nullptr ? 1 : pool->size();
+    }
+
+    const Config& get_config() const {
+      return config;
+    }
+
+    std::array<i32, 3> get_observation_shape() const {
+      return ::observation_shape(config.rows, config.cols, window_radius);
+    }
+
+    i32 get_window_radius() const {
+      return window_radius;
+    }
+
+    // num_envs x channels x rows x cols, or the window size instead of the map size
+    const u8* get_observations() const {
+      return observations.data();
+    }
+
+    // num_envs x Features::count, only written when features are enabled
+    const f32* get_features() const {
+      return feature_values.data();
+    }
+
+    bool get_features_enabled() const {
+      return features;
+    }
+
+    const f32* get_rewards() const {
+      return rewards.data();
+    }
+
+    const i32* get_score_deltas() const {
+      return score_deltas.data();
+    }
+
+    const u8* get_dones() const {
+      return dones.data();
+    }
+
+    const State& get_state(i32 index) const {
+      return get_env(index).get_state_ref();
+    }
+
+    Environment& get_env(i32 index) {
+      check_index(index);
+      return slots[index]->env;
+    }
+
+    const Environment& get_env(i32 index) const {
+      check_index(index);
+      return slots[index]->env;
+    }
+
+  private:
+    void check_actions(const i32 *actions, i32 count) const {
+      for (i32 i = 0; i < count; ++i)
+        if (actions[i] < 0 or actions[i] > (i32)MovementDirection::none)
+          throw std::runtime_error("Invalid action " + std::to_string(actions[i]) + " for env " + std::to_string(i) + ".");
+    }
+
+    PipelineGroup& get_group(i32 g) const {
+      if (g < 0 or g >= (i32)groups.size())
+        throw std::runtime_error("Pipeline group " + std::to_string(g) + " is out of range for " + std::to_string(groups.size()) + " groups.");
+      return *groups[g];
+    }
+
+    // Synchronous calls touch every env, so no group may be stepping in the background
+    void check_idle() {
+      for (auto &group: groups) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if (group->pending > 0)
+          throw std::runtime_error("Pipelined steps are in flight, call step_wait() on every group first.");
+      }
+    }
+
+    void step_group(PipelineGroup &group, i32 begin, i32 end) {
+      for (i32 i = begin; i < end; ++i)
+        step_env(i, static_cast<MovementDirection>(group.actions[i - group.begin]));
+    }
+
+    void check_pixel_rendering() const {
+      if (not get_pixel_rendering_enabled())
+        throw std::runtime_error("Pixel rendering is not set up. Did you forget to call set_pixel_rendering()?");
+    }
+
+    void check_index(i32 index) const {
+      if (index < 0 or index >= num_envs)
+        throw std::runtime_error("Environment index " + std::to_string(index) + " is out of range for " + std::to_string(num_envs) + " environments.");
+    }
+
+    void write_observation(i32 i) {
+      Slot &slot = *slots[i];
+      slot.wrapper.write_observation(window_radius, observations.data() + i * observation_size);
+      if (features)
+        slot.wrapper.get_features(feature_values.data() + i * Features::count);
+    }
+
+    void step_env(i32 i, MovementDirection action) {
+      Slot &slot = *slots[i];
+      const State &state = slot.wrapper.get_state_ref();
+
+      // Without autoreset, steps past the end of an episode are not part of any episode
+      const bool was_completed = state.completed;
+      slot.wrapper.advance(action);
+      rewards[i] = slot.wrapper.get_reward();
+      score_deltas[i] = slot.wrapper.get_score_delta();
+      dones[i] = state.completed;
+      if (not was_completed)
+        statistics.update(i, score_deltas[i], state);
+
+      if (autoreset and dones[i]) {
+        slot.wrapper.reset();
+        statistics.begin(i, state);
+      }
+      write_observation(i);
+    }
+
+    // Calls fn(begin, end) for one contiguous range of envs per worker thread
+    template <typename Function>
+    void for_each_batch(Function &&fn) {
+      if (pool == nullptr) {
+        TRACE_SCOPE("vector.batch", "vector");
+        fn(0, num_envs);
+        return;
+      }
+
+      const i32 batches = std::min(num_envs, pool->size());
+      pool->parallel_for(batches, [&] (i32 batch, i32) {
+        TRACE_SCOPE("vector.batch", "vector");
+        fn(batch * num_envs / batches, (batch + 1) * num_envs / batches);
+      });
+    }
+};
+
+using VectorEnvironment = VectorEnvironmentT<PacmanEnvironment>;
+using VectorEnvironment21x19 = VectorEnvironmentT<PacmanEnvironment21x19>;
+
+#endif // WRAPPERS_VECTOR_ENV_H